@@ -1,10 +1,15 @@
 #include"bank_editor.h"
+#include "bank_library.h"
+#include "session_image.h"
+#include "setlist.h"
 #include "plugin_process_callback.h"     // ← без лишней точки!
 #include "custom_audio_playhead.h"
 #include "LearnController.h"
 #include "cpu_load.h"
 #include <memory>
 #include <atomic>
+#include <algorithm>
+#include <utility>
 
 namespace {
     CCMapping combineMapping(const CCMapping& global, const PresetCCMapping& preset)
@@ -19,60 +24,15 @@ namespace {
     }
 }
 //++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
-static juce::File getBootConfigFile()
+// Файл, куда выгружаются state'ы холодных банков без своего файла-источника.
+// Файл только дописывается; когда мёртвые диапазоны (заменённые выгрузки) занимают
+// заметную долю файла, живые забираются в память, а файл — удаляется (следующее поколение)
+static juce::File getStateSpillFile(int generation)
 {
-    auto sysDir = juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
-        .getChildFile("NEXUS_KONTROL_OS");
-    sysDir.createDirectory();
-    return sysDir.getChildFile("boot_config.xml");
-}
-
-static void writeBootConfig(const juce::File& targetFile)
-{
-    juce::XmlElement root("BootConfig");
-    root.setAttribute("FilePath", targetFile.getFullPathName());
-    root.setAttribute("FileName", targetFile.getFileName());
-    getBootConfigFile().replaceWithText(root.toString());
-}
-static juce::File readBootConfig()
-{
-    auto bootFile = getBootConfigFile();
-    if (!bootFile.existsAsFile())
-        return juce::File(); // boot отсутствует → сигнал для loadSettings()
-
-    std::unique_ptr<juce::XmlElement> xml(juce::XmlDocument::parse(bootFile));
-    if (!xml) return juce::File();
-
-    juce::String path = xml->getStringAttribute("FilePath");
-    if (path.isNotEmpty())
-    {
-        juce::File target(path);
-
-        // ⚠️ защита: если путь указывает на сам boot_config.xml → игнорируем
-        if (target.getFileName().equalsIgnoreCase("boot_config.xml"))
-            return juce::File();
-
-        return target;
-    }
-
-    return juce::File(); // если атрибут пустой
+    return SessionStore::getDefaultFile().getSiblingFile("state_spill_" + juce::String(generation) + ".bin");
 }
-static juce::String normalizePluginId(const juce::String& rawId)
-{
-    juce::File f(rawId);
-
-    if (f.getFileExtension() == ".so")
-    {
-        auto archDir = f.getParentDirectory();        // x86_64-linux
-        auto contents = archDir.getParentDirectory();  // Contents
-        auto vst3dir = contents.getParentDirectory(); // *.vst3
 
-        if (vst3dir.hasFileExtension("vst3"))
-            return vst3dir.getFullPathName();
-    }
-
-    return rawId;
-}
+using BankLibraryIO::normalizePluginId;
 // Кастомный LookAndFeel для всплывающего меню.ВЫБОРА БАНКОВ
 class CustomPopupMenuLookAndFeel : public juce::LookAndFeel_V4
 {
@@ -108,11 +68,22 @@ public:
 };
 //==============================================================================
 BankEditor::BankEditor(PluginManager& pm, VSTHostComponent* host, bool loadDefaultFlag)
-    : pluginManager(pm), vstHost(host), shouldLoadDefaultOnStartup(loadDefaultFlag)
+    : pluginManager(pm), vstHost(host), bankLoader(&libraryCache), bankWriter(&libraryCache), importer(bankWriter),
+      shouldLoadDefaultOnStartup(loadDefaultFlag)
 {
   //  loadSettings();
     // говорим JUCE, что мы можем работать с VST и VST3
     formatManager.addDefaultFormats();
+    // state банков декодируются лениво; держим в памяти не больше N декодированных
+    PluginStateRef::setDecodedCacheLimit(maxDecodedBankStates);
+    // индекс файлов для NEXT/PREV строится один раз и дальше следит за папкой
+    bankFiles.setDirectory(getBankDir());
+    bankSearch.setDirectory(getBankDir());
+    // выгруженное в прошлый запуск больше никому не нужно
+    for (const auto& f : SessionStore::getDefaultFile().getParentDirectory()
+                             .findChildFiles(juce::File::findFiles, false, "state_spill*.bin"))
+        f.deleteFile();
+    memoryBudget = (juce::int64)(int)sessionStore.getSetting("MemoryBudgetMB", 0) * 1024 * 1024;
     // Row 0
     addAndMakeVisible(bankIndexLabel);
     bankIndexLabel.setJustificationType(juce::Justification::centred);
@@ -158,7 +129,7 @@ BankEditor::BankEditor(PluginManager& pm, VSTHostComponent* host, bool loadDefau
 
             bankDir.createDirectory();
 
-            auto files = bankDir.findChildFiles(juce::File::findFiles, false, "*.xml");
+            auto files = bankDir.findChildFiles(juce::File::findFiles, false, BankLibraryIO::fileWildcard);
 
             if (files.isEmpty())
             {
@@ -193,14 +164,19 @@ BankEditor::BankEditor(PluginManager& pm, VSTHostComponent* host, bool loadDefau
                     // update editor with name without extension
                     libraryNameEditor.setText(chosen.getFileNameWithoutExtension(), juce::dontSendNotification);
 
-                    // load config
+                    // load config (в фоне; путь и boot_config фиксируются по готовности)
                     loadSettingsFromFile(chosen);
-                    currentlyLoadedBankFile = chosen;
-                    writeBootConfig(chosen);
                 });
         };
 
 
+    // поиск по всем библиотекам: Enter → меню найденного
+    addAndMakeVisible(bankSearchEditor);
+    bankSearchEditor.setMultiLine(false);
+    bankSearchEditor.setReturnKeyStartsNewLine(false);
+    bankSearchEditor.setTextToShowWhenEmpty(juce::String::fromUTF8("🔍 Search banks"), juce::Colours::grey);
+    bankSearchEditor.onReturnKey = [this]() { showBankSearchResults(); };
+
     // назначаем кастомный LookAndFeel кнопкам
     defaultButton.setLookAndFeel(&bigIcons);
     saveButton.setLookAndFeel(&bigIcons);
@@ -213,8 +189,8 @@ BankEditor::BankEditor(PluginManager& pm, VSTHostComponent* host, bool loadDefau
     addAndMakeVisible(selectBankButton);
     selectBankButton.setButtonText(juce::String::fromUTF8("👇 Preset"));
     selectBankButton.addListener(this);
-    // PRESET1…6 
-    for (int i = 0; i < numPresets; ++i)
+    // PRESET1…maxPresets (видны первые numLibraryPresets — см. updateUI)
+    for (int i = 0; i < maxPresets; ++i)
     {
         presetButtons[i].setLookAndFeel(&bigIcons);
         addAndMakeVisible(presetButtons[i]);
@@ -239,7 +215,7 @@ BankEditor::BankEditor(PluginManager& pm, VSTHostComponent* host, bool loadDefau
            onBankEditorChanged();
      };
     // Теперь для presetEditors:
-    for (int i = 0; i < numPresets; ++i)
+    for (int i = 0; i < maxPresets; ++i)
     {
         addAndMakeVisible(presetEditors[i]);
         presetEditors[i].setMultiLine(false);
@@ -251,7 +227,9 @@ BankEditor::BankEditor(PluginManager& pm, VSTHostComponent* host, bool loadDefau
         // Обработчик изменения текста 
         presetEditors[i].onTextChange = [this, i]()
             {
-                banks[activeBankIndex].presetNames[i] = presetEditors[i].getText();
+                if (i >= numLibraryPresets)
+                    return;
+                banks[activeBankIndex].presetNames[(size_t)i] = presetEditors[i].getText();
                 if (i == activePreset)
                     updateSelectedPresetLabel(); // Обновляем отображаемое имя выбранного пресета
                
@@ -278,7 +256,7 @@ BankEditor::BankEditor(PluginManager& pm, VSTHostComponent* host, bool loadDefau
     // Row 3: selectedPresetLabel
     for (int s = 0; s < numSlots; ++s)
     {
-        slotPresetCCMappings[s].resize(numPresets);
+        slotPresetCCMappings[s].resize(maxPresets);
         for (auto& ccArray : slotPresetCCMappings[s])
             for (int i = 0; i < numCCParams; ++i)
                 ccArray[i] = PresetCCMapping{};
@@ -403,13 +381,10 @@ BankEditor::BankEditor(PluginManager& pm, VSTHostComponent* host, bool loadDefau
     cancelButton.setButtonText(juce::String::fromUTF8("🔙 Back"));
     cancelButton.addListener(this);
 
-    banks.assign(numBanks, Bank{});//_______________________________________________________________________
-    for (int i = 0; i < numBanks; ++i)
-    {
+    banks.assign(defaultNumBanks, Bank(numLibraryPresets));//_______________________________________________________________________
+    for (int i = 0; i < defaultNumBanks; ++i)
         banks[i].bankName = "BANK" + juce::String(i + 1);
-        for (int p = 0; p < numPresets; ++p)
-            banks[i].presetNames[p] = "Scene " + juce::String(p + 1);
-    }
+    bankLastUsed.assign(banks.size(), 0);
 
     setActiveBankIndex(0);
     setActivePreset(0);
@@ -491,6 +466,13 @@ BankEditor::BankEditor(PluginManager& pm, VSTHostComponent* host, bool loadDefau
 }
 BankEditor::~BankEditor()
 {
+    // всё, что ещё стоит в очереди на запись, должно лечь на диск до выхода
+    importer.cancel();
+    bankWriter.flush();
+    sessionStore.flush();
+    writeSessionImage();
+    recovery.stopAndDiscard(); // выход штатный — восстанавливать при старте нечего
+
     if (vstHost != nullptr)
         for (juce::Button* b : { &defaultButton, &storeButton, &loadButton,
                              &cancelButton, &saveButton, &vstButton,
@@ -499,7 +481,7 @@ BankEditor::~BankEditor()
             b->setLookAndFeel(nullptr);
         }
 
-    for (int i = 0; i < numPresets; ++i)
+    for (int i = 0; i < maxPresets; ++i)
         presetButtons[i].setLookAndFeel(nullptr);
 
 }
@@ -557,14 +539,15 @@ void BankEditor::paint(juce::Graphics& g)
         saveButton.setBounds(baseX + 7 * (bw + gap), catalogY, bw, rowHeight);
     }
 
-    // Row 1 → теперь Row 2
+    // Row 1 → теперь Row 2: SELECT, пресеты библиотеки, VST — ширина колонки по их числу
+    const int presetCols = numLibraryPresets + 2;
     {
-        int bw = W / 8 - gap;
+        int bw = W / presetCols - gap;
         int rowHeight = int(sH * shrinkFactor);
-        for (int i = 0; i < 8; ++i)
+        for (int i = 0; i < presetCols; ++i)
         {
             juce::Button* b = (i == 0 ? &selectBankButton
-                : i < 7 ? &presetButtons[i - 1]
+                : i <= numLibraryPresets ? &presetButtons[i - 1]
                 : &vstButton);
             b->setBounds(baseX + i * (bw + gap), baseY + (1 + rowOffset) * sH, bw, rowHeight);
         }
@@ -572,18 +555,18 @@ void BankEditor::paint(juce::Graphics& g)
 
     // Row 2 → теперь Row 3
     {
-        int fw = W / 8 - gap;
+        int fw = W / presetCols - gap;
         int fy = baseY + (2 + rowOffset) * sH;
         int rowHeight = int(sH * shrinkFactor);
 
         bankNameEditor.setBounds(baseX + 0 * (fw + gap), fy, fw, rowHeight);
-        for (int i = 0; i < numPresets; ++i)
+        for (int i = 0; i < numLibraryPresets; ++i)
             presetEditors[i].setBounds(baseX + (i + 1) * (fw + gap), fy, fw, rowHeight);
 
         pluginLabel.setFont(juce::Font(sH * 0.45f, juce::Font::plain));
         pluginLabel.setJustificationType(juce::Justification::centredLeft);
         pluginLabel.setMinimumHorizontalScale(0.7f);
-        pluginLabel.setBounds(baseX + 7 * (fw + gap), fy, fw, rowHeight);
+        pluginLabel.setBounds(baseX + (presetCols - 1) * (fw + gap), fy, fw, rowHeight);
     }
 
     // Row 3 → теперь Row 4 (VST + BYPASS)
@@ -680,13 +663,15 @@ void BankEditor::paint(juce::Graphics& g)
 
     // Row 11 (без изменений)
     defaultButton.setBounds(baseX + 0 * sW, baseY + 11 * sH, 2 * sW, sH);
+    bankSearchEditor.setBounds(baseX + 2 * sW + gap, baseY + 11 * sH, 4 * sW - gap, sH);
+    bankSearchEditor.setFont(juce::Font(sH * 0.45f));
     cancelButton.setBounds(baseX + 18 * sW, baseY + 11 * sH, 2 * sW, sH);
 }
 
 //==============================================================================
 void BankEditor::updatePresetButtons()
 {
-    for (int i = 0; i < numPresets; ++i)
+    for (int i = 0; i < numLibraryPresets; ++i)
     {
         if (i == activePreset)
         {
@@ -712,8 +697,8 @@ void BankEditor::buttonClicked(juce::Button* b)
     // VST (кнопка загрузки плагина)
     if (b == &vstButton) { showVSTDialog(); return; }
 
-    // PRESET 1–6
-    for (int i = 0; i < numPresets; ++i)
+    // PRESET 1–numLibraryPresets
+    for (int i = 0; i < numLibraryPresets; ++i)
         if (b == &presetButtons[i])
         {
             isSettingPreset = true;
@@ -794,7 +779,7 @@ void BankEditor::buttonClicked(juce::Button* b)
         auto* fm = new FileManager(bankDir, FileManager::Mode::Load);
         fm->setMinimalUI(false);
         fm->setShowRunButton(false);
-        fm->setWildcardFilter("*.xml");
+        fm->setWildcardFilter(juce::String(BankLibraryIO::fileWildcard) + ";" + SetlistIO::fileWildcard);
 
         // Контекст Bank: Home должен вести в NEXUS/BANK
         fm->setHomeSubfolder("BANK");
@@ -806,19 +791,21 @@ void BankEditor::buttonClicked(juce::Button* b)
                 if (!file.existsAsFile())
                     return;
 
-                // 🔹 Загружаем напрямую
-                loadSettingsFromFile(file);
-
-                // 🔹 Фиксируем рабочий файл
-                currentlyLoadedBankFile = file;
+                // сет-лист: NEXT/PREV дальше идут по его песням
+                if (file.hasFileExtension(SetlistIO::fileExtension))
+                {
+                    loadSetlist(file);
+                    return;
+                }
 
-                // 🔹 Обновляем boot_config.xml
-                writeBootConfig(file);
+                // обычная библиотека — выход из сет-листа
+                setlistEngine.clear();
 
-                bankSnapshot = banks[activeBankIndex];
-                updateUI();
+                // 🔹 Загружаем в фоне: рабочий файл, boot_config.xml и snapshot
+                //    фиксируются в applyLoadedLibrary, когда разбор завершён
+                loadSettingsFromFile(file);
 
-                DBG("[Load] loaded bank file: " << file.getFullPathName());
+                DBG("[Load] requested bank file: " << file.getFullPathName());
             });
 
         juce::DialogWindow::LaunchOptions opts;
@@ -852,8 +839,11 @@ void BankEditor::buttonClicked(juce::Button* b)
             : juce::File("C:\\NEXUS\\BANK");
         bankDir.createDirectory();
 
-        // целевой файл и флаг "новый файл"
-        juce::File targetFile = bankDir.getChildFile(newName + ".xml");
+        // целевой файл и флаг "новый файл" (формат — как у текущего файла)
+        const juce::String extension = BankLibraryIO::wantsBinaryFormat(currentlyLoadedBankFile)
+            ? BankLibraryIO::binaryExtension
+            : BankLibraryIO::xmlExtension;
+        juce::File targetFile = bankDir.getChildFile(newName + extension);
         const bool isNewFile = !targetFile.existsAsFile();
 
         auto doStore = [this, targetFile]()
@@ -871,15 +861,15 @@ void BankEditor::buttonClicked(juce::Button* b)
                 saveSettingsToFile(targetFile);
                 currentlyLoadedBankFile = targetFile;
                 loadedFileName = targetFile.getFileNameWithoutExtension();
-                writeBootConfig(targetFile);
+                sessionStore.setBootTarget(targetFile);
             };
 
         // твоя логика modified — без изменений
         bool modified = false;
         if (bankNameEditor.getText() != bankSnapshot.bankName)
             modified = true;
-        for (int i = 0; i < numPresets && !modified; ++i)
-            if (presetEditors[i].getText() != bankSnapshot.presetNames[i])
+        for (int i = 0; i < numLibraryPresets && !modified; ++i)
+            if (i >= bankSnapshot.getNumPresets() || presetEditors[i].getText() != bankSnapshot.presetNames[(size_t)i])
                 modified = true;
         for (int i = 0; i < numCCParams && !modified; ++i)
             if (ccNameEditors[i].getText() != bankSnapshot.globalCCMappings[i].name)
@@ -930,7 +920,7 @@ void BankEditor::buttonClicked(juce::Button* b)
         auto* fm = new FileManager(saveDir, FileManager::Mode::Save);
         fm->setMinimalUI(false);
         fm->setShowRunButton(false);
-        fm->setWildcardFilter("*.xml");
+        fm->setWildcardFilter(BankLibraryIO::fileWildcard);
         fm->setHomeSubfolder("BANK");
         fm->setRootLocked(true);
 
@@ -998,8 +988,21 @@ void BankEditor::showBankSelectionMenu()
 {
     juce::PopupMenu menu;
     // Заполняем меню пунктами: ID = i+1, текст = имя банка.
-    for (int i = 0; i < numBanks; ++i)
+    for (int i = 0; i < (int)banks.size(); ++i)
         menu.addItem(i + 1, banks[i].bankName, true, (i == activeBankIndex));
+
+    // Размеры библиотеки: ID = capacityMenuBase + банков, presetsMenuBase + пресетов
+    constexpr int capacityMenuBase = 1000, presetsMenuBase = 2000;
+    juce::PopupMenu banksMenu, presetsMenu;
+    for (const int n : { 3, 8, 20, 32, 64, maxBanks })
+        banksMenu.addItem(capacityMenuBase + n, juce::String(n), true, n == (int)banks.size());
+    for (int n = 1; n <= maxPresets; ++n)
+        presetsMenu.addItem(presetsMenuBase + n, juce::String(n), true, n == numLibraryPresets);
+
+    const bool canResize = !isLoadingFromFile && !hasPendingBanks();
+    menu.addSeparator();
+    menu.addSubMenu("BANKS IN LIBRARY", banksMenu, canResize);
+    menu.addSubMenu("SCENES PER BANK", presetsMenu, canResize);
     // Используем статический экземпляр нашего кастомного LookAndFeel.
     static CustomPopupMenuLookAndFeel customPopupLAF;
     customPopupLAF.minimumPopupWidth = selectBankButton.getWidth();
@@ -1009,24 +1012,80 @@ void BankEditor::showBankSelectionMenu()
     menu.showMenuAsync(juce::PopupMenu::Options()
         .withTargetComponent(&selectBankButton)
         .withPreferredPopupDirection(juce::PopupMenu::Options::PopupDirection::downwards),
-        [this](int result)
+        [this, capacityMenuBase, presetsMenuBase](int result)
         {
-            if (result > 0)
+            if (result > presetsMenuBase)
+                setLibraryCapacity((int)banks.size(), result - presetsMenuBase);
+            else if (result > capacityMenuBase)
+                setLibraryCapacity(result - capacityMenuBase, numLibraryPresets);
+            else if (result > 0)
                 setActiveBankIndex(result - 1);
         });
 }
+
+void BankEditor::showBankSearchResults()
+{
+    const auto query = bankSearchEditor.getText().trim();
+    if (query.isEmpty())
+        return;
+
+    const auto hits = bankSearch.search(query, 40);
+
+    juce::PopupMenu menu;
+    if (hits.empty())
+        menu.addItem(1, bankSearch.isReady() ? "NOT FOUND" : "INDEXING...", false, false);
+
+    for (size_t i = 0; i < hits.size(); ++i)
+    {
+        const bool current = hits[i].file == currentlyLoadedBankFile
+                          && hits[i].bank == activeBankIndex
+                          && (hits[i].preset < 0 || hits[i].preset == activePreset);
+        menu.addItem((int)i + 1, hits[i].text, true, current);
+    }
+
+    static CustomPopupMenuLookAndFeel customPopupLAF;
+    customPopupLAF.minimumPopupWidth = bankSearchEditor.getWidth();
+    menu.setLookAndFeel(&customPopupLAF);
+    menu.showMenuAsync(juce::PopupMenu::Options()
+        .withTargetComponent(&bankSearchEditor)
+        .withPreferredPopupDirection(juce::PopupMenu::Options::PopupDirection::upwards),
+        [this, hits](int result)
+        {
+            if (result > 0 && result <= (int)hits.size())
+                openSearchHit(hits[(size_t)result - 1]);
+        });
+}
+
+void BankEditor::openSearchHit(const BankSearchIndex::Hit& hit)
+{
+    // та же библиотека — только переключаем банк/пресет
+    if (hit.file == currentlyLoadedBankFile)
+    {
+        if (hit.bank >= 0)
+            setActiveBankIndex(hit.bank);
+        if (hit.preset >= 0)
+            setActivePreset(hit.preset);
+        return;
+    }
+
+    // другая — грузим, банк/пресет подставит applyLoadedLibrary
+    pendingSearchHit = hit;
+    libraryNameEditor.setText(hit.file.getFileNameWithoutExtension(), juce::dontSendNotification);
+    loadSettingsFromFile(hit.file);
+}
 void BankEditor::propagateInvert(int slot, bool newInvert)
 {
     auto& bank = banks[activeBankIndex];
     bank.globalCCMappings[slot].invert = newInvert;   // чтобы редакторы имени видели
-    for (int p = 0; p < numPresets; ++p)
-        bank.presetCCMappings[p][slot].invert = newInvert;
+    for (int p = 0; p < numLibraryPresets; ++p)
+        if (bank.getPresetCC(p, slot).invert != newInvert)
+            bank.editPresetCC(p, slot).invert = newInvert;
 }
 void BankEditor::editCCParameter(int ccIndex)
 {
     const CCMapping initialMap = combineMapping(
         banks[activeBankIndex].globalCCMappings[ccIndex],
-        banks[activeBankIndex].presetCCMappings[activePreset][ccIndex]);
+        banks[activeBankIndex].getPresetCC(activePreset, ccIndex));
 
     juce::String slotName = "Set CC " + juce::String(ccIndex + 1);
 
@@ -1051,7 +1110,7 @@ void BankEditor::editCCParameter(int ccIndex)
 
 
             // --- 2. Пресетный слой -------------------------------------------
-            auto& preset = banks[activeBankIndex].presetCCMappings[activePreset][ccIndex];
+            auto& preset = banks[activeBankIndex].editPresetCC(activePreset, ccIndex);
             preset.ccValue = newMap.ccValue;
             propagateInvert(ccIndex, newMap.invert);
             preset.enabled = newMap.enabled;
@@ -1075,7 +1134,7 @@ void BankEditor::setActiveBankIndex(int newIdx)
 
     snapshotCurrentBank(); // сохраняем старый банк
 
-    activeBankIndex = juce::jlimit(0, numBanks - 1, newIdx);
+    activeBankIndex = juce::jlimit(0, (int)banks.size() - 1, newIdx);
 
     isSwitchingBank = true; // блокируем проверку dirty
 
@@ -1091,28 +1150,33 @@ void BankEditor::setActiveBankIndex(int newIdx)
     juce::Timer::callAfterDelay(200, [this] {
         bankSnapshot = banks[activeBankIndex];
         isSwitchingBank = false;
+        touchBank(activeBankIndex);
+        enforceMemoryBudget();
         });
 }
 void BankEditor::setActiveBank(int newBank)
 {
-    activeBankIndex = juce::jlimit(0, numBanks - 1, newBank);
+    activeBankIndex = juce::jlimit(0, (int)banks.size() - 1, newBank);
+    sessionStore.setActiveBank(activeBankIndex, activePreset);
     updateUI();
 }
 void BankEditor::setActivePreset(int newPreset)
 {
+    slotStatesChanged = true;
     if (banks.empty() || activeBankIndex < 0 || activeBankIndex >= (int)banks.size())
         return;
-    if (newPreset < 0 || newPreset >= numPresets)
+    if (newPreset < 0 || newPreset >= numLibraryPresets)
         return;
 
     activePreset = newPreset;
+    sessionStore.setActiveBank(activeBankIndex, activePreset);
     updateSelectedPresetLabel();
     updatePresetButtons();
 
     auto& bank = banks[activeBankIndex];
     for (int i = 0; i < numCCParams; ++i)
     {
-        bool state = bank.presetCCMappings[activePreset][i].enabled;
+        bool state = bank.getPresetCC(activePreset, i).enabled;
         ccToggleButtons[i].setToggleState(state, juce::dontSendNotification);
         updateCCParameter(i, state);
     }
@@ -1130,14 +1194,8 @@ void BankEditor::resetCCSlotState(int slot)
     bank.globalCCMappings[slot].paramIndex = -1;
     bank.globalCCMappings[slot].name = "<none>";
     bank.globalCCMappings[slot].invert = false;
-    for (int p = 0; p < numPresets; ++p)
-    {
-        auto& m = bank.presetCCMappings[p][slot];
-        m.enabled = false;
-        m.ccValue = 64;
-        m.invert = false;
-        bank.ccPresetStates[p][slot] = false;
-    }
+    for (auto& row : bank.presetCCMappings)
+        row[(size_t)slot] = PresetCCMapping{};
     ccNameEditors[slot].setText("<none>", juce::dontSendNotification);
     ccToggleButtons[slot].setToggleState(false, juce::dontSendNotification);
 }
@@ -1162,9 +1220,14 @@ void BankEditor::updateUI()
     if (onBankChanged)
         onBankChanged();
 
-    // обновляем имена пресетов
-    for (int i = 0; i < numPresets; ++i)
-        presetEditors[i].setText(bank.presetNames[i], juce::dontSendNotification);
+    // обновляем имена пресетов; кнопки сверх числа пресетов библиотеки скрыты
+    for (int i = 0; i < maxPresets; ++i)
+    {
+        presetButtons[i].setVisible(i < numLibraryPresets);
+        presetEditors[i].setVisible(i < numLibraryPresets);
+        if (i < numLibraryPresets)
+            presetEditors[i].setText(bank.presetNames[(size_t)i], juce::dontSendNotification);
+    }
 
     updateVSTButtonLabel();
 
@@ -1208,7 +1271,7 @@ void BankEditor::updateSelectedPresetLabel()
         return;
 
     auto& bank = banks[activeBankIndex];
-    if (activePreset < 0 || activePreset >= numPresets)
+    if (activePreset < 0 || activePreset >= numLibraryPresets)
         return;
 
     selectedPresetLabel.setText(
@@ -1227,8 +1290,21 @@ void BankEditor::timerCallback()
 //==============================================================================
 void BankEditor::loadSettings()
 {
-    // читаем путь из boot_config.xml
-    juce::File targetFile = readBootConfig();
+    // снимок прошлого запуска — один раз, на старте и только после падения;
+    // повторный loadSettings (CANCEL, загрузка с диска) восстановлением не считается.
+    // Снимки — с этого момента; пока идёт загрузка, они пропускаются
+    if (!std::exchange(recoveryChecked, true))
+    {
+        const bool recovered = recovery.previousRunCrashed() && restoreFromRecovery();
+        recovery.start([this] { return captureRecoverySnapshot(); });
+        if (recovered)
+            return;
+    }
+
+    // состояние прошлого сеанса (boot_config.xml прочитан SessionStore при создании)
+    const auto session = sessionStore.getState();
+    juce::File targetFile = session.bootTarget;
+    setActiveSlot(juce::jlimit(0, numSlots - 1, session.activeSlot));
 
     // 🔹 если включён флаг или файл не существует → грузим дефолт
     if (shouldLoadDefaultOnStartup || !targetFile.existsAsFile())
@@ -1242,16 +1318,261 @@ void BankEditor::loadSettings()
 
         juce::File defFile = bankDir.getChildFile("Default.xml");
 
-        resetAllDefaults();
-        saveSettingsToFile(defFile);
-        writeBootConfig(defFile);
+        resetAllDefaults(); // сам ставит чистый Default.xml в очередь записи и в sessionStore
 
         targetFile = defFile;
     }
+    else
+    {
+        // банк/пресет, на которых закончился прошлый сеанс, — тем же путём, что переход из поиска
+        if (session.activeBank >= 0)
+            pendingSearchHit = { targetFile, session.activeBank, session.activePreset, {} };
+
+        // образ с прошлого выхода: размер и время файла не менялись → без разбора XML;
+        // содержимое досверяется по SHA-256, когда звук уже идёт (startSessionImageCheck)
+        // Отметка снимается до чтения: образ применяется, только если файл между
+        // проверкой в read() и применением не тронули (read сверяет с тем же диском)
+        BankLibrary lib;
+        ImageCheck check;
+        check.file = targetFile;
+        check.stampSize = targetFile.getSize();
+        check.stampTime = targetFile.getLastModificationTime();
+        if (SessionImage::read(SessionImage::getDefaultFile(), targetFile, lib, &check.hash) && check.stampHolds())
+        {
+            DBG("[Boot] restored from session image: " << targetFile.getFullPathName());
+            check.lib = std::make_shared<const BankLibrary>(lib);
+            pendingImageCheck = std::move(check);
+            unverifiedImageFile = targetFile;
+
+            requestedBankFile = targetFile;
+            isLoadingFromFile = true;
+            applyLoadedLibrary(lib, targetFile);
+            return;
+        }
+    }
 
-    // загружаем указанный файл
+    // загружаем указанный файл (в фоне)
     loadSettingsFromFile(targetFile);
-    currentlyLoadedBankFile = targetFile;
+}
+
+bool BankEditor::restoreFromRecovery()
+{
+    // вызывается, только если прошлый запуск упал (RecoverySnapshotter::previousRunCrashed)
+    const auto t0 = juce::Time::getHighResolutionTicks();
+    RecoverySnapshotter::Snapshot snapshot;
+    if (!RecoverySnapshotter::read(RecoverySnapshotter::getDefaultFile(), snapshot))
+        return false;
+
+    DBG("[Recovery] previous run did not exit cleanly, restoring: " << snapshot.libraryFile.getFullPathName());
+
+    requestedBankFile = snapshot.libraryFile;
+    isLoadingFromFile = true;
+    setActiveSlot(juce::jlimit(0, numSlots - 1, snapshot.activeSlot));
+    applyLoadedLibrary(*snapshot.library, snapshot.libraryFile);
+
+    // живые правки плагинов применяются в том же продолжении, что и банк, —
+    // когда плагин уже загружен и state банка на нём (applyRecoveredSlotStates)
+    pendingRecoveryStates = std::move(snapshot.slotStates);
+
+    // восстановленное расходится с файлом на диске: Store горит до сохранения
+    restoredUnsaved = true;
+
+    DBG("[Recovery] restored in " << juce::String(juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - t0) * 1000.0, 1) << " ms");
+    return true;
+}
+
+std::unique_ptr<RecoverySnapshotter::Snapshot> BankEditor::captureRecoverySnapshot()
+{
+    // загрузка в пути — banks ещё не то, что играет
+    if (isLoadingFromFile || hasPendingBanks() || banks.empty())
+        return nullptr;
+
+    auto snapshot = std::make_unique<RecoverySnapshotter::Snapshot>();
+    snapshot->libraryFile = currentlyLoadedBankFile;
+    snapshot->library = std::make_shared<BankLibrary>(makeLibrarySnapshot()); // state'ы — общими ссылками, без копий
+    snapshot->activeSlot = activeSlot;
+
+    // getStateInformation у тяжёлых плагинов дорогой: опрашиваем слоты, только если
+    // параметр/пресет менялся; изредка — всё равно (плагин мог поменяться сам)
+    const bool refresh = slotStatesChanged.exchange(false)
+                      || lastSlotStates.size() != (size_t)numSlots
+                      || ++slotStatesReuses >= maxSlotStatesReuses;
+
+    if (refresh)
+    {
+        slotStatesReuses = 0;
+        lastSlotStates.assign((size_t)numSlots, {});
+
+        if (vstHost != nullptr)
+            for (int slot = 0; slot < numSlots; ++slot)
+                if (auto* inst = vstHost->getPluginInstance(slot))
+                    inst->getStateInformation(lastSlotStates[(size_t)slot]);
+    }
+
+    snapshot->slotStates = lastSlotStates;
+    return snapshot;
+}
+
+void BankEditor::applyRecoveredSlotStates()
+{
+    if (pendingRecoveryStates.empty() || vstHost == nullptr)
+        return;
+
+    const auto states = std::move(pendingRecoveryStates);
+    pendingRecoveryStates.clear();
+
+    for (int slot = 0; slot < (int)states.size(); ++slot)
+    {
+        const auto& state = states[(size_t)slot];
+        auto* inst = vstHost->getPluginInstance(slot);
+        if (inst == nullptr || state.getSize() == 0)
+            continue;
+
+        try { inst->setStateInformation(state.getData(), (int)state.getSize()); }
+        catch (...) { DBG("[Recovery] setStateInformation failed for slot " << slot); }
+    }
+
+    slotStatesChanged = true;
+    DBG("[Recovery] slot states restored");
+}
+
+void BankEditor::writeSessionImage()
+{
+    // образ — это содержимое файла на диске, а не правки в памяти:
+    // берём его из кэша (туда кладут и загрузчик, и запись)
+    const auto file = currentlyLoadedBankFile;
+    auto lib = libraryCache.find(file);
+    if (lib == nullptr)
+    {
+        DBG("[Shutdown] no parsed copy of " << file.getFileName() << ", session image skipped");
+        return;
+    }
+
+    // распакованным кладём state банка, на котором закончился сеанс (его выберет старт),
+    // а не активного в файле
+    if (!SessionImage::write(SessionImage::getDefaultFile(), file, *lib, activeBankIndex))
+        DBG("[Shutdown] failed to write session image");
+}
+
+//==============================================================================
+std::vector<BankEditor::BankMemory> BankEditor::getBankMemory() const
+{
+    std::vector<BankMemory> result(banks.size());
+    for (size_t i = 0; i < banks.size(); ++i)
+    {
+        const auto& b = banks[i];
+        result[i].stateBytes = (juce::int64)b.pluginState.getResidentBytes();
+        result[i].paramBytes = (juce::int64)(b.pluginParamValues.size() * sizeof(float))
+                             + (juce::int64)b.paramDiffs.size() * 32; // узел unordered_map
+    }
+    return result;
+}
+
+juce::int64 BankEditor::getResidentBytes() const
+{
+    std::vector<const PluginStateRef*> states{ &globalPluginState, &bankSnapshot.pluginState };
+    juce::int64 params = (juce::int64)((globalPluginParamValues.size() + bankSnapshot.pluginParamValues.size()) * sizeof(float))
+                       + (juce::int64)bankSnapshot.paramDiffs.size() * 32;
+    for (const auto& [id, values] : pluginParamDefaults)
+        params += (juce::int64)(values.size() * sizeof(float));
+
+    const auto perBank = getBankMemory();
+    for (size_t i = 0; i < banks.size(); ++i)
+    {
+        states.push_back(&banks[i].pluginState);
+        params += perBank[i].paramBytes;
+    }
+
+    return PluginStateRef::getResidentBytes(states) + params;
+}
+
+void BankEditor::setMemoryBudget(juce::int64 bytes)
+{
+    memoryBudget = juce::jmax<juce::int64>(0, bytes);
+    enforceMemoryBudget();
+}
+
+void BankEditor::touchBank(int bankIndex)
+{
+    if (juce::isPositiveAndBelow(bankIndex, (int)bankLastUsed.size()))
+        bankLastUsed[(size_t)bankIndex] = ++bankUseCounter;
+}
+
+void BankEditor::enforceMemoryBudget()
+{
+    if (memoryBudget <= 0)
+        return;
+
+    // сжатие — до подсчёта: живые диапазоны старого spill-файла попадают в память
+    // и ниже при нехватке уходят в новый вместе с остальными
+    rotateStateSpillFile();
+
+    auto resident = getResidentBytes();
+    if (resident <= memoryBudget)
+        return;
+
+    // Глобальный state нужен только при загрузке плагина — он самый холодный;
+    // дальше банки от давно не использованных к недавним, активный не трогаем
+    // (общий с ним блоб уходит на диск вместе с холодным банком и читается обратно по требованию)
+    std::vector<int> order;
+    for (int i = 0; i < (int)banks.size(); ++i)
+        if (i != activeBankIndex)
+            order.push_back(i);
+    std::stable_sort(order.begin(), order.end(), [this](int a, int b) { return bankLastUsed[(size_t)a] < bankLastUsed[(size_t)b]; });
+
+    std::vector<PluginStateRef*> victims{ &globalPluginState };
+    for (int i : order)
+        victims.push_back(&banks[(size_t)i].pluginState);
+
+    const auto before = resident;
+    int evicted = 0;
+    for (auto* state : victims)
+    {
+        if (resident <= memoryBudget)
+            break;
+        if (state->getResidentBytes() == 0)
+            continue;
+
+        if (!state->evict(getStateSpillFile(spillGeneration), BankLibraryIO::getStateCodec()))
+        {
+            // state остался в памяти; причина уже в логе. Диск сбоит — дальше не пробуем
+            juce::Logger::writeToLog("[Memory] eviction stopped, budget exceeded: "
+                                     + juce::String(resident / 1024) + " KB resident");
+            break;
+        }
+
+        ++evicted;
+        resident = getResidentBytes();
+    }
+
+    const auto spill = getStateSpillFile(spillGeneration);
+    DBG("[Memory] budget " << memoryBudget / (1024 * 1024) << " MB: evicted " << evicted << " states, "
+        << before / 1024 << " KB -> " << resident / 1024 << " KB resident; spill "
+        << PluginStateRef::getLiveBytes(spill) / 1024 << " KB live of " << spill.getSize() / 1024 << " KB");
+}
+
+void BankEditor::rotateStateSpillFile()
+{
+    const auto spill = getStateSpillFile(spillGeneration);
+    const auto size = spill.getSize();
+    if (size <= 0)
+        return;
+
+    // живые байты — диапазоны, на которые ссылаются state'ы; остальное — выгрузки,
+    // которые с тех пор заменены (STORE, другая библиотека)
+    const auto live = PluginStateRef::getLiveBytes(spill);
+    if ((double)(size - live) <= (double)size * spillCompactRatio)
+        return;
+
+    // живые диапазоны — в память: с этого момента они честно учитываются в бюджете
+    // и при нехватке выгружаются в следующее поколение; старый файл больше не нужен
+    if (!PluginStateRef::detachFileSources(spill))
+        return;
+
+    spill.deleteFile();
+    ++spillGeneration;
+
+    DBG("[Memory] spill file compacted: " << size / 1024 << " KB, live " << live / 1024 << " KB");
 }
 
 void BankEditor::saveSettings()
@@ -1272,8 +1593,8 @@ void BankEditor::saveSettings()
     // сохраняем текущее состояние в выбранный файл
     saveSettingsToFile(currentlyLoadedBankFile);
 
-    // обновляем boot_config.xml, чтобы он указывал на этот файл
-    writeBootConfig(currentlyLoadedBankFile);
+    // boot_config.xml будет указывать на этот файл (запись — с задержкой, на потоке SessionStore)
+    sessionStore.setBootTarget(currentlyLoadedBankFile);
 
     DBG("[Save] saved bank file: " << currentlyLoadedBankFile.getFullPathName());
 }
@@ -1283,27 +1604,140 @@ void BankEditor::loadSettingsFromFile(const juce::File& file)
     if (!file.existsAsFile())
         return;
 
-    loadedFileName = file.getFileNameWithoutExtension();
+    // Чтение и разбор — на потоке загрузчика (XML или .nxb, по сигнатуре).
+    // Новый запрос отменяет предыдущий, поэтому быстрые NEXT/PREV не копятся.
+    isLoadingFromFile = true;
+    requestedBankFile = file;
+    loadRequestTicks = juce::Time::getHighResolutionTicks();
+
+    // Файл ещё в очереди на запись — на диске устаревшая версия, берём снимок из памяти
+    if (auto pending = bankWriter.getPendingSnapshot(file))
+    {
+        bankLoader.cancelPending();
+        BankLibrary lib(*pending);
+        applyLoadedLibrary(lib, file);
+        return;
+    }
 
-    struct LoadingGuard {
-        bool& flag;
-        explicit LoadingGuard(bool& f) : flag(f) { flag = true; }
-        ~LoadingGuard() { flag = false; }
-    } guard(isLoadingFromFile);
+    // Файл не менялся с прошлой загрузки — разбор не нужен
+    if (auto cached = libraryCache.find(file))
+    {
+        bankLoader.cancelPending();
+        BankLibrary lib(*cached);
+        applyLoadedLibrary(lib, file);
+        return;
+    }
 
-    std::unique_ptr<juce::XmlElement> xml(juce::XmlDocument::parse(file));
-    if (!xml)
+    // Сосед уже разобран в фоне — остаётся только применить
+    if (auto prefetched = bankPrefetcher.take(file))
+    {
+        bankLoader.cancelPending();
+        // take() только что сверил размер и время — они и есть отметка для кэша
+        libraryCache.insert(file, file.getSize(), file.getLastModificationTime(), prefetched);
+        BankLibrary lib(*prefetched);
+        applyLoadedLibrary(lib, file);
         return;
+    }
+
+    // Постепенно: активный банк применяется, как только разобран, остальные дочитываются
+    juce::Component::SafePointer<BankEditor> safeThis(this);
+    bankLoader.requestLoad(file,
+        [safeThis](std::shared_ptr<BankLibrary> lib, const juce::File& loadedFile)
+        {
+            if (safeThis == nullptr)
+                return;
+
+            if (lib == nullptr)
+            {
+                DBG("[Load] failed to read: " << loadedFile.getFullPathName());
+                safeThis->requestedBankFile = safeThis->currentlyLoadedBankFile;
+                safeThis->isLoadingFromFile = false;
+
+                // заготовка уже применена: недочитанные банки остаются заготовками,
+                // а сохранение — заблокированным, чтобы не затереть ими файл
+                if (safeThis->partialLibraryFile == loadedFile)
+                {
+                    DBG("[Load] library applied partially, saving disabled: " << loadedFile.getFullPathName());
+                    safeThis->saveAfterLoad = juce::File();
+                }
+                return;
+            }
+
+            if (safeThis->partialLibraryFile == loadedFile)
+                safeThis->completeProgressiveLoad(*lib);
+            else
+                safeThis->applyLoadedLibrary(*lib, loadedFile);
+        },
+        [safeThis](std::shared_ptr<BankLibrary> lib, std::vector<int> stillLoading, const juce::File& loadedFile)
+        {
+            if (safeThis != nullptr)
+                safeThis->applyLoadedLibrary(*lib, loadedFile, stillLoading);
+        },
+        [safeThis](int bankIndex, const BankLibrary& source)
+        {
+            if (safeThis != nullptr)
+                safeThis->applyLoadedBank(bankIndex, source.banks[(size_t)bankIndex]);
+        });
+
+    // переход из поиска: найденный банк разбирается вместе с активным
+    if (pendingSearchHit.file == file && pendingSearchHit.bank >= 0)
+        bankLoader.prioritiseBank(pendingSearchHit.bank);
+}
+
+void BankEditor::applyLoadedLibrary(BankLibrary& lib, const juce::File& file, const std::vector<int>& stillLoading)
+{
+    jassert(juce::MessageManager::getInstance()->isThisTheMessageThread());
+
+    loadedFileName = file.getFileNameWithoutExtension();
+
+    // новая библиотека заменяет восстановленную после падения (restoreFromRecovery выставит заново)
+    pendingRecoveryStates.clear();
+    restoredUnsaved = false;
+    if (pendingImageCheck.file != file)
+        pendingImageCheck = {}; // образ относился к другому файлу
+    if (unverifiedImageFile != file)
+        unverifiedImageFile = juce::File();
 
-    // --- Чтение глобальных и банковских данных ---
-    activeBankIndex = xml->getIntAttribute("activeBankIndex", 0);
-    activePreset = xml->getIntAttribute("activePreset", 0);
+    // --- Публикация: готовая библиотека подменяет текущую одним шагом ---
+    activeBankIndex = lib.activeBankIndex;
+    activePreset = lib.activePreset;
+    numLibraryPresets = lib.numPresets;
 
-    globalPluginName = xml->getStringAttribute("pluginName");
-    globalPluginId = normalizePluginId(xml->getStringAttribute("pluginId"));
-    globalActiveProgram = xml->getIntAttribute("activeProgram", -1);
+    // переход из поиска: сразу на найденный банк/пресет
+    if (pendingSearchHit.file == file)
+    {
+        if (juce::isPositiveAndBelow(pendingSearchHit.bank, (int)lib.banks.size()))
+        {
+            activeBankIndex = pendingSearchHit.bank;
+            activePreset = juce::isPositiveAndBelow(pendingSearchHit.preset, numLibraryPresets) ? pendingSearchHit.preset : 0;
+        }
+    }
+    pendingSearchHit = {};
+
+    globalPluginName = lib.pluginName;
+    globalPluginId = lib.pluginId;
+    globalActiveProgram = lib.activeProgram;
+    globalPluginParamValues.swap(lib.pluginParamValues);
+    globalPluginState = std::move(lib.pluginState);
+    pluginParamDefaults.swap(lib.pluginDefaults);
+    banks.swap(lib.banks);
+    bankLastUsed.assign(banks.size(), 0u); // новая библиотека — история использования с нуля
+
+    // заготовка: недочитанные слоты не применяются и не сохраняются, пока не придут
+    pendingBanks.clear();
+    if (!stillLoading.empty())
+    {
+        pendingBanks.assign(banks.size(), 0);
+        for (const int i : stillLoading)
+            if (juce::isPositiveAndBelow(i, (int)banks.size()))
+                pendingBanks[(size_t)i] = 1;
+    }
+    partialLibraryFile = stillLoading.empty() ? juce::File() : file;
+    saveAfterLoad = juce::File(); // отложенное сохранение относилось к прежней библиотеке
+    resized(); // ширина строки пресетов — по их числу в библиотеке
 
     // --- Если в конфиге нет плагина, выгружаем старый ---
+    bool pluginLoadRequested = false;
     if (vstHost != nullptr && vstHost->getActivePluginInstance() != nullptr)
     {
         auto* inst = vstHost->getActivePluginInstance();
@@ -1324,6 +1758,7 @@ void BankEditor::loadSettingsFromFile(const juce::File& file)
         {
             DBG("🐶 Bulldog: Same plugin already loaded → apply saved state only");
             applyBankToPlugin(activeBankIndex, true);
+            noteTimeToSound();
         }
         else
         {
@@ -1331,89 +1766,20 @@ void BankEditor::loadSettingsFromFile(const juce::File& file)
                 vstHost->getActiveSlotIndex(),
                 vstHost->getCurrentSampleRate(),
                 vstHost->getCurrentBlockSize());
-
-        }
-    }
-
-
-    globalPluginParamValues.clear();
-    if (auto* paramsEl = xml->getChildByName("PluginParams"))
-        forEachXmlChildElementWithTagName(*paramsEl, pe, "Param")
-        globalPluginParamValues.push_back((float)pe->getDoubleAttribute("value", 0.0));
-
-    globalPluginState.reset();
-    if (auto* stateEl = xml->getChildByName("PluginState"))
-        globalPluginState.fromBase64Encoding(stateEl->getAllSubText().trim());
-
-    banks.assign(numBanks, Bank{});
-    forEachXmlChildElementWithTagName(*xml, bankEl, "Bank")
-    {
-        int idx = bankEl->getIntAttribute("index", -1);
-        if (idx < 0 || idx >= numBanks) continue;
-
-        auto& b = banks[idx];
-        b.bankName = bankEl->getStringAttribute("bankName");
-        b.pluginName = bankEl->getStringAttribute("pluginName");
-        b.pluginId = normalizePluginId(bankEl->getStringAttribute("pluginId"));
-        b.activeProgram = bankEl->getIntAttribute("activeProgram", -1);
-
-        b.pluginParamValues.clear();
-        if (auto* paramsEl = bankEl->getChildByName("PluginParams"))
-            forEachXmlChildElementWithTagName(*paramsEl, pe, "Param")
-            b.pluginParamValues.push_back((float)pe->getDoubleAttribute("value", 0.0));
-
-        b.pluginState.reset();
-        if (auto* stateEl = bankEl->getChildByName("PluginState"))
-            b.pluginState.fromBase64Encoding(stateEl->getAllSubText().trim());
-
-        b.paramDiffs.clear();
-        if (auto* diffsEl = bankEl->getChildByName("ParamDiffs"))
-            forEachXmlChildElementWithTagName(*diffsEl, de, "Diff")
-        {
-            int pIdx = de->getIntAttribute("index", -1);
-            if (pIdx >= 0)
-                b.paramDiffs[pIdx] = (float)de->getDoubleAttribute("value", 0.0);
-        }
-
-        if (auto* presetsEl = bankEl->getChildByName("PresetNames"))
-            forEachXmlChildElementWithTagName(*presetsEl, pe, "Preset")
-        {
-            int pIdx = pe->getIntAttribute("index", -1);
-            if (pIdx >= 0 && pIdx < numPresets)
-                b.presetNames[pIdx] = pe->getStringAttribute("name");
-        }
-
-        if (auto* ccStatesEl = bankEl->getChildByName("CCPresetStates"))
-            forEachXmlChildElementWithTagName(*ccStatesEl, presetEl, "Preset")
-        {
-            int pIdx = presetEl->getIntAttribute("index", -1);
-            if (pIdx >= 0 && pIdx < numPresets)
-            {
-                forEachXmlChildElementWithTagName(*presetEl, ccEl, "CC")
-                {
-                    int cc = ccEl->getIntAttribute("number", -1);
-                    if (cc >= 0 && cc < numCCParams)
-                    {
-                        auto& presetMap = b.presetCCMappings[pIdx][cc];
-                        presetMap.enabled = ccEl->getBoolAttribute("enabled", false);
-                        presetMap.ccValue = (uint8_t)ccEl->getIntAttribute("ccValue", 64);
-                        presetMap.invert = ccEl->getBoolAttribute("invert", false);
-
-                        auto& globalMap = b.globalCCMappings[cc];
-                        globalMap.paramIndex = ccEl->getIntAttribute("paramIndex", -1);
-                        globalMap.name = ccEl->getStringAttribute("paramName");
-                    }
-                }
-            }
+            pluginLoadRequested = true;
         }
     }
 
     // фиксируем путь рабочего файла
     currentlyLoadedBankFile = file;
+    requestedBankFile = file;
 
-    // обновляем boot_config.xml только если это не сам boot_config.xml
-    if (!file.getFileName().equalsIgnoreCase("boot_config.xml"))
-        writeBootConfig(file);
+    // boot_config.xml — в памяти; на диск ляжет одной записью на всю загрузку
+    {
+        SessionStore::Transaction transaction(sessionStore);
+        sessionStore.setBootTarget(file); // сам boot_config.xml не принимается
+        sessionStore.setActiveBank(activeBankIndex, activePreset);
+    }
 
     // метка: имя плагина если доступно, иначе имя файла
     if (auto* inst = vstHost ? vstHost->getActivePluginInstance() : nullptr)
@@ -1423,12 +1789,9 @@ void BankEditor::loadSettingsFromFile(const juce::File& file)
     else
         pluginLabel.setText(file.getFileNameWithoutExtension(), juce::dontSendNotification);
 
-    juce::Timer::callAfterDelay(200, [this] {
-        applyBankToPlugin(activeBankIndex, true);
-        bankSnapshot = banks[activeBankIndex];
-        isLoadingFromFile = false;
-        updateUI();
-        });
+    // state применяется, как только плагин готов, — без паузы наугад: и звук, и замер
+    // time-to-sound одинаковы для старта из образа и обычной загрузки
+    callWhenPluginReady([this] { finishLibraryApply(); }, pluginLoadRequested ? maxPluginReadyPolls : 0);
     // 🔹 Обновляем UI кнопок пресетов
     if (onActivePresetChanged)
         onActivePresetChanged(activePreset);
@@ -1437,134 +1800,333 @@ void BankEditor::loadSettingsFromFile(const juce::File& file)
         onLibraryFileChanged(file);
 }
 
-void BankEditor::saveSettingsToFile(const juce::File& file)
+void BankEditor::finishLibraryApply()
 {
-    DBG("Save: activeBankIndex = " << activeBankIndex);
+    // старт из образа: пока ждали плагин, файл могли изменить — тогда образ не применяем
+    if (pendingImageCheck.file != juce::File() && pendingImageCheck.file == currentlyLoadedBankFile
+        && !pendingImageCheck.stampHolds())
+    {
+        rollBackSessionImage(currentlyLoadedBankFile);
+        return;
+    }
+
+    applyBankToPlugin(activeBankIndex, true);
+    noteTimeToSound();
+    applyRecoveredSlotStates(); // после падения: поверх state банка, плагин уже загружен
+    bankSnapshot = banks[activeBankIndex];
+    if (!bankLoader.isLoading()) // следующая загрузка уже в пути — флаг не снимаем
+    {
+        isLoadingFromFile = false;
+        prefetchNeighbours();
+    }
+    updateUI();
+    touchBank(activeBankIndex);
+    enforceMemoryBudget();
 
-    juce::XmlElement root("BanksConfig");
-    root.setAttribute("version", 1);
-    root.setAttribute("activeBankIndex", activeBankIndex);
-    root.setAttribute("activePreset", activePreset);
+    // старт из образа: звук уже идёт — теперь можно хешировать файл
+    if (pendingImageCheck.file != juce::File() && pendingImageCheck.file == currentlyLoadedBankFile)
+        startSessionImageCheck();
+}
 
-    // --- Глобальные данные о плагине ---
-    root.setAttribute("pluginName", globalPluginName);
-    root.setAttribute("pluginId", normalizePluginId(globalPluginId));
-    root.setAttribute("activeProgram", globalActiveProgram);
+void BankEditor::callWhenPluginReady(std::function<void()> fn, int pollsLeft)
+{
+    juce::Component::SafePointer<BankEditor> safeThis(this);
 
-    // --- Полный state плагина (Base64) ---
-    if (globalPluginState.getSize() > 0)
+    const bool ready = pollsLeft <= 0 || vstHost == nullptr || vstHost->getActivePluginInstance() != nullptr;
+    if (ready)
     {
-        auto stateEl = std::make_unique<juce::XmlElement>("PluginState");
-        stateEl->addTextElement(globalPluginState.toBase64Encoding());
-        root.addChildElement(stateEl.release());
+        juce::MessageManager::callAsync([safeThis, fn] { if (safeThis != nullptr) fn(); });
+        return;
     }
 
-    // --- Данные банков ---
-    for (int i = 0; i < static_cast<int>(banks.size()); ++i)
-    {
-        const auto& b = banks[i];
+    juce::Timer::callAfterDelay(pluginReadyPollMs, [safeThis, fn, pollsLeft]
+        {
+            if (safeThis != nullptr)
+                safeThis->callWhenPluginReady(fn, pollsLeft - 1);
+        });
+}
 
-        auto bankEl = std::make_unique<juce::XmlElement>("Bank");
-        bankEl->setAttribute("index", i);
-        bankEl->setAttribute("bankName", b.bankName);
-        bankEl->setAttribute("activeProgram", b.activeProgram);
+void BankEditor::startSessionImageCheck()
+{
+    auto check = std::move(pendingImageCheck);
+    pendingImageCheck = {};
 
-        // 🔹 сохраняем реальные pluginName и pluginId из банка
-        bankEl->setAttribute("pluginName", b.pluginName);
-        bankEl->setAttribute("pluginId", normalizePluginId(b.pluginId));
+    juce::Component::SafePointer<BankEditor> safeThis(this);
+    const auto file = check.file;
+    const auto stampSize = check.stampSize;
+    const auto stampTime = check.stampTime;
+    auto lib = check.lib;
 
-        // Параметры плагина
+    imageCheck.start(file, check.hash, [safeThis, file, stampSize, stampTime, lib](bool matches)
         {
-            auto paramsEl = std::make_unique<juce::XmlElement>("PluginParams");
-            for (float v : b.pluginParamValues)
+            if (safeThis == nullptr)
+                return;
+
+            if (!matches)
             {
-                auto pe = std::make_unique<juce::XmlElement>("Param");
-                pe->setAttribute("value", v);
-                paramsEl->addChildElement(pe.release());
+                // размер и время совпали, содержимое — нет
+                safeThis->rollBackSessionImage(file);
+                return;
             }
-            bankEl->addChildElement(paramsEl.release());
-        }
 
-        // Полный state плагина для банка
-        if (b.pluginState.getSize() > 0)
-        {
-            auto stateEl = std::make_unique<juce::XmlElement>("PluginState");
-            stateEl->addTextElement(b.pluginState.toBase64Encoding());
-            bankEl->addChildElement(stateEl.release());
-        }
+            // в кэш — чтобы при следующем выходе образ было из чего записать
+            safeThis->libraryCache.insert(file, stampSize, stampTime, lib);
 
-        // Отличающиеся параметры
-        if (!b.paramDiffs.empty())
-        {
-            auto diffsEl = std::make_unique<juce::XmlElement>("ParamDiffs");
-            for (auto& [paramIndex, value] : b.paramDiffs)
+            // образ подтверждён: отложенное на время сверки сохранение можно писать
+            if (safeThis->unverifiedImageFile == file)
             {
-                auto diffEl = std::make_unique<juce::XmlElement>("Diff");
-                diffEl->setAttribute("index", paramIndex);
-                diffEl->setAttribute("value", value);
-                diffsEl->addChildElement(diffEl.release());
+                safeThis->unverifiedImageFile = juce::File();
+                if (safeThis->saveAfterLoad == file && !safeThis->hasPendingBanks())
+                {
+                    safeThis->saveAfterLoad = juce::File();
+                    safeThis->saveSettingsToFile(file);
+                }
             }
-            bankEl->addChildElement(diffsEl.release());
-        }
+        });
+}
 
-        // Preset names
-        {
-            auto presetsEl = std::make_unique<juce::XmlElement>("PresetNames");
-            for (int p = 0; p < numPresets; ++p)
-            {
-                auto pe = std::make_unique<juce::XmlElement>("Preset");
-                pe->setAttribute("index", p);
-                pe->setAttribute("name", b.presetNames[p]);
-                presetsEl->addChildElement(pe.release());
-            }
-            bankEl->addChildElement(presetsEl.release());
-        }
+void BankEditor::rollBackSessionImage(const juce::File& file)
+{
+    juce::Logger::writeToLog("[Boot] session image does not match " + file.getFullPathName() + ", reloading");
 
-        // CC состояния и назначения
-        {
-            auto ccStatesEl = std::make_unique<juce::XmlElement>("CCPresetStates");
-            for (int p = 0; p < numPresets; ++p)
-            {
-                auto presetEl = std::make_unique<juce::XmlElement>("Preset");
-                presetEl->setAttribute("index", p);
+    imageCheck.cancel();
+    pendingImageCheck = {};
+    PluginStateRef::detachFileSources(SessionImage::getDefaultFile());
+    SessionImage::getDefaultFile().deleteFile();
 
-                for (int cc = 0; cc < numCCParams; ++cc)
-                {
-                    const auto& presetMap = b.presetCCMappings[p][cc];
-                    const auto& globalMap = b.globalCCMappings[cc];
-
-                    auto ccEl = std::make_unique<juce::XmlElement>("CC");
-                    ccEl->setAttribute("number", cc);
-                    ccEl->setAttribute("ccValue", (int)presetMap.ccValue);
-                    ccEl->setAttribute("invert", presetMap.invert);
-                    ccEl->setAttribute("enabled", presetMap.enabled);
-                    ccEl->setAttribute("paramIndex", globalMap.paramIndex);
-                    ccEl->setAttribute("paramName", globalMap.name);
-
-                    presetEl->addChildElement(ccEl.release());
-                }
+    if (unverifiedImageFile != file)
+        return;
+    unverifiedImageFile = juce::File();
 
-                ccStatesEl->addChildElement(presetEl.release());
-            }
-            bankEl->addChildElement(ccStatesEl.release());
-        }
+    if (currentlyLoadedBankFile != file)
+        return;
+
+    // всё, что пришло из образа (банки, state на плагине, правки поверх них), заменяется
+    // свежим разбором файла; выбранные банк и пресет остаются
+    saveAfterLoad = juce::File();
+    pendingSearchHit = { file, activeBankIndex, activePreset, {} };
+    loadSettingsFromFile(file);
+}
+
+void BankEditor::applyLoadedBank(int bankIndex, const Bank& bank)
+{
+    if (!isBankPending(bankIndex))
+        return;
+
+    banks[(size_t)bankIndex] = bank;
+    pendingBanks[(size_t)bankIndex] = 0;
 
-        root.addChildElement(bankEl.release());
+    if (bankIndex != activeBankIndex)
+        return;
+
+    // банк выбрали, пока он разбирался — применяем сейчас
+    applyBankToPlugin(bankIndex, true);
+    noteTimeToSound();
+    bankSnapshot = banks[(size_t)bankIndex];
+    updateUI();
+    setActivePreset(activePreset);
+}
+
+void BankEditor::completeProgressiveLoad(BankLibrary& lib)
+{
+    const bool activeUnchanged = juce::isPositiveAndBelow(activeBankIndex, (int)banks.size())
+                              && bankSnapshot == banks[(size_t)activeBankIndex];
+
+    // умолчания полной библиотеки могли появиться только сейчас (файл старой раскладки)
+    // или разойтись с заведёнными STORE во время загрузки: уже пришедшие банки
+    // переводятся на них через полную раскладку
+    for (auto& [id, defaults] : lib.pluginDefaults)
+    {
+        auto it = pluginParamDefaults.find(id);
+        if (it != pluginParamDefaults.end() && it->second != defaults)
+            for (auto& b : banks)
+                if (b.pluginParamValues.empty() && normalizePluginId(b.pluginId) == id)
+                    BankLibraryIO::expandParamValues(b, it->second);
+
+        pluginParamDefaults[id] = defaults;
     }
 
+    // банки, чьи колбэки не успели прийти (или пришли до заготовки), — из полной библиотеки
+    for (int i = 0; i < (int)lib.banks.size() && hasPendingBanks(); ++i)
+        applyLoadedBank(i, lib.banks[(size_t)i]);
+
+    BankLibraryIO::compactParamValues(banks, pluginParamDefaults);
+    if (activeUnchanged)
+        bankSnapshot = banks[(size_t)activeBankIndex]; // другая раскладка — не правка
+
+    pendingBanks.clear();
+    partialLibraryFile = juce::File();
+
+    if (!bankLoader.isLoading())
+    {
+        isLoadingFromFile = false;
+        prefetchNeighbours();
+    }
+
+    if (saveAfterLoad != juce::File())
+    {
+        const auto target = saveAfterLoad;
+        saveAfterLoad = juce::File();
+        saveSettingsToFile(target);
+    }
+}
+
+bool BankEditor::isBankPending(int bankIndex) const noexcept
+{
+    return juce::isPositiveAndBelow(bankIndex, (int)pendingBanks.size()) && pendingBanks[(size_t)bankIndex] != 0;
+}
+
+bool BankEditor::hasPendingBanks() const noexcept
+{
+    return std::find(pendingBanks.begin(), pendingBanks.end(), 1) != pendingBanks.end();
+}
+
+void BankEditor::noteTimeToSound()
+{
+    if (isBankPending(activeBankIndex))
+        return;
+
+    const auto now = juce::Time::getHighResolutionTicks();
+
+    if (setlistStepTicks != 0)
+    {
+        setlistEngine.recordSwitch(juce::Time::highResolutionTicksToSeconds(now - setlistStepTicks) * 1000.0, setlistStepStaged);
+        setlistStepTicks = 0;
+    }
+
+    if (loadRequestTicks == 0)
+        return;
+
+    const double ms = juce::Time::highResolutionTicksToSeconds(now - loadRequestTicks) * 1000.0;
+    loadRequestTicks = 0;
+
+    ++loadStats.loads;
+    loadStats.lastTimeToSoundMs = ms;
+    loadStats.averageTimeToSoundMs += (ms - loadStats.averageTimeToSoundMs) / loadStats.loads;
+    loadStats.maxTimeToSoundMs = juce::jmax(loadStats.maxTimeToSoundMs, ms);
+
+    DBG("[Load] time to sound: " << juce::String(ms, 1) << " ms (avg " << juce::String(loadStats.averageTimeToSoundMs, 1)
+        << " ms, max " << juce::String(loadStats.maxTimeToSoundMs, 1) << " ms, " << loadStats.loads << " loads)");
+}
+
+void BankEditor::saveSettingsToFile(const juce::File& file)
+{
+    // банки ещё разбираются — в снимок попали бы пустые заготовки; пишем, когда дочитаются
+    if (hasPendingBanks())
+    {
+        DBG("[SaveSettings] deferred until load completes: " << file.getFullPathName());
+        saveAfterLoad = file;
+        return;
+    }
+
+    // применён образ, а содержимое файла ещё не сверено: запись поверх него ждёт сверки
+    // (при расхождении правки уйдут вместе с образом)
+    if (unverifiedImageFile != juce::File() && unverifiedImageFile == file)
+    {
+        DBG("[SaveSettings] deferred until session image is verified: " << file.getFullPathName());
+        saveAfterLoad = file;
+        return;
+    }
+
+    DBG("Save: activeBankIndex = " << activeBankIndex);
+
+    // 🔹 Отдаём снимок I/O-потоку (.nxb → бинарный формат, иначе XML);
+    //    серия сохранений подряд схлопывается в одну запись
+    bankWriter.enqueue(file, std::make_shared<const BankLibrary>(makeLibrarySnapshot()));
+
     // --- Снимок текущего банка ---
     bankSnapshot = banks[activeBankIndex];
-
-    // 🔹 Перезаписываем переданный файл
-    file.replaceWithText(root.toString());
+    restoredUnsaved = false; // восстановленное после падения теперь на диске
 
     // 🔹 Обновляем ссылку на рабочий файл
     currentlyLoadedBankFile = file;
-
-   
+    requestedBankFile = file;
 
     DBG("[SaveSettings] saved file: " << file.getFullPathName());
 }
+
+BankLibrary BankEditor::makeLibrarySnapshot() const
+{
+    BankLibrary lib;
+    lib.numPresets = numLibraryPresets;
+    lib.activeBankIndex = activeBankIndex;
+    lib.activePreset = activePreset;
+    lib.pluginName = globalPluginName;
+    lib.pluginId = globalPluginId;
+    lib.activeProgram = globalActiveProgram;
+    lib.pluginParamValues = globalPluginParamValues;
+    lib.pluginState = globalPluginState;
+    lib.banks = banks;
+
+    // в файл — только умолчания плагинов, которые есть в банках
+    for (const auto& b : banks)
+    {
+        const auto id = normalizePluginId(b.pluginId);
+        auto it = pluginParamDefaults.find(id);
+        if (it != pluginParamDefaults.end())
+            lib.pluginDefaults.emplace(id, it->second);
+    }
+    return lib;
+}
+
+void BankEditor::setLibraryCapacity(int newNumBanks, int newNumPresets)
+{
+    newNumBanks = juce::jlimit(1, maxBanks, newNumBanks);
+    newNumPresets = juce::jlimit(1, maxPresets, newNumPresets);
+    if (newNumBanks == (int)banks.size() && newNumPresets == numLibraryPresets)
+        return;
+
+    // недочитанные банки придут по старым индексам — размеры меняем после загрузки
+    if (isLoadingFromFile || hasPendingBanks())
+    {
+        DBG("[Capacity] library is still loading, resize skipped");
+        return;
+    }
+
+    // правки активного банка — в banks, пока его индекс ещё в границах
+    snapshotCurrentBank();
+
+    const int newActive = juce::jmin(activeBankIndex, newNumBanks - 1);
+    const bool activeChanged = newActive != activeBankIndex;
+    activeBankIndex = newActive;
+
+    numLibraryPresets = newNumPresets;
+
+    // все векторы «по банку» — в одном шаге с banks
+    if ((int)banks.size() > newNumBanks)
+        banks.erase(banks.begin() + newNumBanks, banks.end());
+    for (int i = (int)banks.size(); i < newNumBanks; ++i)
+    {
+        banks.emplace_back(numLibraryPresets);
+        banks.back().bankName = "BANK" + juce::String(i + 1);
+    }
+    for (auto& b : banks)
+        b.setNumPresets(numLibraryPresets);
+    bankLastUsed.resize(banks.size(), 0u);
+    pendingBanks.clear();
+
+    if (activePreset >= numLibraryPresets)
+        activePreset = numLibraryPresets - 1;
+
+    if (activeChanged)
+    {
+        // активный банк отрезан — играет последний оставшийся
+        applyBankToPlugin(activeBankIndex, false);
+        bankSnapshot = banks[(size_t)activeBankIndex];
+        touchBank(activeBankIndex);
+        if (onBankChanged)
+            onBankChanged();
+    }
+
+    sessionStore.setActiveBank(activeBankIndex, activePreset);
+    setActivePreset(activePreset);
+
+    resized();
+    updateUI();
+    updatePresetButtons();
+    checkForChanges(); // снимок банка — старых размеров, Store подсветится
+    sendChange();
+}
 void BankEditor::resetAllDefaults()
 {
     DBG("[Default] Resetting to clean factory state");
@@ -1575,30 +2137,28 @@ void BankEditor::resetAllDefaults()
         : juce::File("C:\\NEXUS\\BANK");
     bankDir.createDirectory();
 
-    // 2) Пересоздаём чистый Default.xml
+    // 2) Пересоздаём чистый Default.xml (через очередь записи — чтобы не
+    //    перетереть его более старым отложенным снимком)
     juce::File defFile = bankDir.getChildFile("Default.xml");
-    juce::XmlElement root("Banks");
-    root.setAttribute("Name", "Default Bank");
-    defFile.replaceWithText(root.toString());
+    {
+        auto defaults = std::make_shared<BankLibrary>();
+        defaults->setCapacity(defaultNumBanks, defaultNumPresets);
+        bankWriter.enqueue(defFile, std::move(defaults));
+    }
 
-    // 3) Обновляем boot_config.xml
-    writeBootConfig(defFile);
+    // 3) Обновляем boot_config.xml (в памяти; запись — с задержкой)
+    sessionStore.setBootTarget(defFile);
 
     // 🔹 4) Выгружаем плагин именно из выбранного слота
     if (vstHost != nullptr)
         vstHost->unloadPlugin(activeSlot);
 
-    // 5) Загружаем дефолт через стандартный механизм
+    // 5) Загружаем дефолт через стандартный механизм (snapshot фиксируется по готовности)
     loadSettingsFromFile(defFile);
-    currentlyLoadedBankFile = defFile;
 
     // 6) Обновляем UI
     libraryNameEditor.setText("Default", juce::dontSendNotification);
 
-    // 7) Фиксируем snapshot и кнопки
-    bankSnapshot = banks[activeBankIndex];
-    checkForChanges();
-
     DBG("[Default] Clean Default.xml recreated, plugin unloaded, and loaded");
 }
 
@@ -1611,7 +2171,7 @@ void BankEditor::storeToBank()
 
     // Имена из UI
     b.bankName = bankNameEditor.getText();
-    for (int i = 0; i < numPresets; ++i)
+    for (int i = 0; i < numLibraryPresets; ++i)
         b.presetNames[i] = presetEditors[i].getText();
 
     // 🔹 сохраняем пользовательские имена CC
@@ -1646,28 +2206,11 @@ void BankEditor::storeToBank()
             b.activeProgram = inst->getCurrentProgram();
             globalActiveProgram = b.activeProgram;
 
-            b.pluginState.reset();
-            inst->getStateInformation(b.pluginState);
+            juce::MemoryBlock state;
+            inst->getStateInformation(state);
+            b.pluginState = std::move(state);
 
-            const auto& params = inst->getParameters();
-            const int N = (int)params.size();
-            if ((int)b.pluginParamValues.size() != N)
-                b.pluginParamValues.assign(N, 0.0f);
-
-            static constexpr float eps = 1.0e-4f;
-            std::unordered_map<int, float> newDiffs;
-
-            for (int i = 0; i < N; ++i)
-            {
-                const float v = params[i]->getValue();
-                const float oldBaseline = b.pluginParamValues[i];
-
-                if (std::abs(v - oldBaseline) > eps)
-                    newDiffs[i] = v;
-
-                b.pluginParamValues[i] = v;
-            }
-            b.paramDiffs = std::move(newDiffs);
+            captureParams(b, *inst);
         }
     }
 
@@ -1798,7 +2341,7 @@ void BankEditor::showVSTDialog()
 //===== PUBLIC API IMPLEMENTATION =============================================
 void BankEditor::setActivePresetIndex(int newPresetIndex)
 {
-    if (newPresetIndex >= 0 && newPresetIndex < numPresets)
+    if (newPresetIndex >= 0 && newPresetIndex < numLibraryPresets)
     {
         activePreset = newPresetIndex;
         updateSelectedPresetLabel();
@@ -1813,8 +2356,8 @@ juce::StringArray BankEditor::getPresetNames(int bankIndex) const noexcept
     juce::StringArray names;
     if (bankIndex >= 0 && bankIndex < (int)banks.size())
     {
-        for (int i = 0; i < numPresets; ++i)
-            names.add(banks[bankIndex].presetNames[i]);
+        for (const auto& name : banks[bankIndex].presetNames)
+            names.add(name);
     }
     return names;
 }
@@ -1822,16 +2365,17 @@ std::vector<CCMapping> BankEditor::getCCMappings(int bankIndex, int presetIndex)
 {
     std::vector<CCMapping> mappings;
     if (bankIndex >= 0 && bankIndex < static_cast<int>(banks.size()) &&
-        presetIndex >= 0 && presetIndex < numPresets)
+        presetIndex >= 0 && presetIndex < banks[bankIndex].getNumPresets())
     {
         const auto& bank = banks[bankIndex];
+        mappings.reserve(numCCParams);
         for (int cc = 0; cc < numCCParams; ++cc)
         {
             CCMapping combined;
             // Берем глобальные данные, назначенные для данной CC-кнопки:
             const auto& global = bank.globalCCMappings[cc];
             // Берем пресетные данные (уровень, состояние включения) из текущего пресета:
-            const auto& preset = bank.presetCCMappings[presetIndex][cc];
+            const auto& preset = bank.getPresetCC(presetIndex, cc);
             combined.paramIndex = global.paramIndex;
             combined.invert = global.invert;
             combined.name = global.name;
@@ -1849,16 +2393,16 @@ void BankEditor::updateCCParameter(int index, bool state)
     if (banks.empty() || activeBankIndex < 0 || activeBankIndex >= (int)banks.size())
         return;
     auto& bank = banks[activeBankIndex];
-    if (activePreset < 0 || activePreset >= numPresets)
+    if (activePreset < 0 || activePreset >= numLibraryPresets)
         return;
     if (index < 0 || index >= numCCParams)
         return;
 
     auto& globalMapping = bank.globalCCMappings[index];
-    auto& presetMapping = bank.presetCCMappings[activePreset][index];
-
-    bank.ccPresetStates[activePreset][index] = state;
-    presetMapping.enabled = state;
+    // строка пресета выделяется, только если состояние действительно меняется
+    if (bank.getPresetCC(activePreset, index).enabled != state)
+        bank.editPresetCC(activePreset, index).enabled = state;
+    const auto& presetMapping = bank.getPresetCC(activePreset, index);
 
     uint8_t effective = (!presetMapping.invert)
         ? (state ? presetMapping.ccValue : 0)
@@ -1872,6 +2416,8 @@ void BankEditor::updateCCParameter(int index, bool state)
 }
 void BankEditor::onPluginParameterChanged(int paramIdx, float normalised)
 {
+    slotStatesChanged = true; // следующий снимок восстановления опросит плагины
+
     /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
       1.  РЕЖИМ LEARN
     ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
@@ -1908,25 +2454,39 @@ void BankEditor::onPluginParameterChanged(int paramIdx, float normalised)
 
     if (slot < 0) return;
 
-    auto& preset = banks[activeBankIndex]
-        .presetCCMappings[activePreset][slot];
+    // только чтение фиксированного массива (Bank::presetCCMappings): запись — в message thread
+    const int bankIndex = activeBankIndex;
+    const int presetIndex = activePreset;
+    if (!juce::isPositiveAndBelow(presetIndex, maxPresets))
+        return;
+    const auto& preset = banks[bankIndex].getPresetCC(presetIndex, slot);
 
     const bool invert = preset.invert;
     const bool shouldBeEnabled = invert ? (v127 == 0) : (v127 > 0);
     const int  newCCValue = invert ? (127 - v127) : v127;
 
-    // записываем результаты в модель (это ПОКА что не GUI)
-    preset.enabled = shouldBeEnabled;
-    if (shouldBeEnabled)
-        preset.ccValue = newCCValue;
-
-    banks[activeBankIndex].ccPresetStates[activePreset][slot] = shouldBeEnabled;
+    // значение не изменилось — строку не трогаем
+    if (preset.enabled == shouldBeEnabled && (!shouldBeEnabled || preset.ccValue == newCCValue))
+        return;
 
     /*~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
-      3.  ПЕРЕДАЁМ ОБНОВЛЕНИЕ GUI В MessageThread
+      3.  ЗАПИСЬ В МОДЕЛЬ И ОБНОВЛЕНИЕ GUI — В MessageThread
     ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
-    juce::MessageManager::callAsync([this, slot, shouldBeEnabled]
+    juce::MessageManager::callAsync([this, bankIndex, presetIndex, slot, shouldBeEnabled, newCCValue]
         {
+            // пока сообщение шло, банк могли сменить или урезать библиотеку
+            if (!juce::isPositiveAndBelow(bankIndex, (int)banks.size())
+                || !juce::isPositiveAndBelow(presetIndex, banks[(size_t)bankIndex].getNumPresets()))
+                return;
+
+            auto& preset = banks[(size_t)bankIndex].editPresetCC(presetIndex, slot);
+            preset.enabled = shouldBeEnabled;
+            if (shouldBeEnabled)
+                preset.ccValue = (uint8_t)newCCValue;
+
+            if (bankIndex != activeBankIndex || presetIndex != activePreset)
+                return;
+
             ccToggleButtons[slot].setToggleState(shouldBeEnabled,
                 juce::dontSendNotification);
             updatePresetButtons();
@@ -1986,7 +2546,7 @@ void BankEditor::toggleLearnFromHost(int cc, bool on)
 void BankEditor::toggleCC(int ccIndex, bool state)
 {
     if (activeBankIndex < 0 || activeBankIndex >= (int)banks.size()) return;
-    if (activePreset < 0 || activePreset >= numPresets) return;
+    if (activePreset < 0 || activePreset >= numLibraryPresets) return;
     if (ccIndex < 0 || ccIndex >= numCCParams) return;
 
     // 1. Обновляем модель для конкретного слота
@@ -2031,201 +2591,25 @@ void BankEditor::loadDefaultConfig()
 }
 juce::XmlElement* BankEditor::serializeBank(const Bank& b, int index) const
 {
-    auto* bankEl = new juce::XmlElement("Bank");
-    bankEl->setAttribute("index", index);
-    bankEl->setAttribute("bankName", b.bankName);
-
-    // --- Нормализация pluginId ---
-    juce::String id = b.pluginId;
-    juce::File f(id);
-
-    if (f.getFileExtension() == ".so")
-    {
-        auto archDir = f.getParentDirectory();        // x86_64-linux
-        auto contents = archDir.getParentDirectory();  // Contents
-        auto vst3dir = contents.getParentDirectory(); // *.vst3
-
-        if (vst3dir.hasFileExtension("vst3"))
-            id = vst3dir.getFullPathName();
-    }
-
-    bankEl->setAttribute("pluginName", b.pluginName);
-    bankEl->setAttribute("pluginId", id);
-    bankEl->setAttribute("activeProgram", b.activeProgram);
-
-    // Preset names
-    {
-        auto* presetsEl = new juce::XmlElement("PresetNames");
-        for (int p = 0; p < numPresets; ++p)
-        {
-            auto* pe = new juce::XmlElement("Preset");
-            pe->setAttribute("index", p);
-            pe->setAttribute("name", b.presetNames[p]);
-            presetsEl->addChildElement(pe);
-        }
-        bankEl->addChildElement(presetsEl);
-    }
-
-    // CC состояния и назначения
-    {
-        auto* ccStatesEl = new juce::XmlElement("CCPresetStates");
-        for (int p = 0; p < numPresets; ++p)
-        {
-            auto* presetEl = new juce::XmlElement("Preset");
-            presetEl->setAttribute("index", p);
-
-            for (int cc = 0; cc < numCCParams; ++cc)
-            {
-                const auto& presetMap = b.presetCCMappings[p][cc];
-                const auto& globalMap = b.globalCCMappings[cc];
-
-                auto* ccEl = new juce::XmlElement("CC");
-                ccEl->setAttribute("number", cc);
-                ccEl->setAttribute("ccValue", (int)presetMap.ccValue);
-                ccEl->setAttribute("invert", presetMap.invert);
-                ccEl->setAttribute("enabled", presetMap.enabled);
-                ccEl->setAttribute("paramIndex", globalMap.paramIndex);
-                ccEl->setAttribute("paramName", globalMap.name);
-
-                presetEl->addChildElement(ccEl);
-            }
-            ccStatesEl->addChildElement(presetEl);
-        }
-        bankEl->addChildElement(ccStatesEl);
-    }
-
-    // Полный state плагина
-    if (b.pluginState.getSize() > 0)
-    {
-        auto* stateEl = new juce::XmlElement("PluginState");
-        stateEl->addTextElement(b.pluginState.toBase64Encoding());
-        bankEl->addChildElement(stateEl);
-    }
-
-    // Baseline параметров
-    {
-        auto* paramsEl = new juce::XmlElement("PluginParams");
-        for (float v : b.pluginParamValues)
-        {
-            auto* pe = new juce::XmlElement("Param");
-            pe->setAttribute("value", v);
-            paramsEl->addChildElement(pe);
-        }
-        bankEl->addChildElement(paramsEl);
-    }
-
-    // Diff’ы параметров
-    if (!b.paramDiffs.empty())
-    {
-        auto* diffsEl = new juce::XmlElement("ParamDiffs");
-        for (const auto& [idx, val] : b.paramDiffs)
-        {
-            auto* de = new juce::XmlElement("Diff");
-            de->setAttribute("index", idx);
-            de->setAttribute("value", val);
-            diffsEl->addChildElement(de);
-        }
-        bankEl->addChildElement(diffsEl);
-    }
-
-    return bankEl;
+    return BankLibraryIO::serializeBank(b, index);
 }
 
 void BankEditor::deserializeBank(Bank& b, const juce::XmlElement& bankEl)
 {
-    b.bankName = bankEl.getStringAttribute("bankName");
-    b.pluginName = bankEl.getStringAttribute("pluginName");
-
-    // --- Нормализация pluginId ---
-    {
-        juce::String rawId = bankEl.getStringAttribute("pluginId");
-        juce::File f(rawId);
-
-        if (f.getFileExtension() == ".so")
-        {
-            auto archDir = f.getParentDirectory();        // x86_64-linux
-            auto contents = archDir.getParentDirectory();  // Contents
-            auto vst3dir = contents.getParentDirectory(); // *.vst3
-
-            if (vst3dir.hasFileExtension("vst3"))
-                rawId = vst3dir.getFullPathName();
-        }
-
-        b.pluginId = rawId; // теперь всегда .vst3
-    }
-
-    b.activeProgram = bankEl.getIntAttribute("activeProgram", -1);
-
-    // Preset names
-    if (auto* presetsEl = bankEl.getChildByName("PresetNames"))
-    {
-        forEachXmlChildElementWithTagName(*presetsEl, pe, "Preset")
-        {
-            int pIdx = pe->getIntAttribute("index", -1);
-            if (pIdx >= 0 && pIdx < numPresets)
-                b.presetNames[pIdx] = pe->getStringAttribute("name");
-        }
-    }
-
-    // CC состояния и назначения
-    if (auto* ccStatesEl = bankEl.getChildByName("CCPresetStates"))
-    {
-        forEachXmlChildElementWithTagName(*ccStatesEl, presetEl, "Preset")
-        {
-            int pIdx = presetEl->getIntAttribute("index", -1);
-            if (pIdx >= 0 && pIdx < numPresets)
-            {
-                forEachXmlChildElementWithTagName(*presetEl, ccEl, "CC")
-                {
-                    int cc = ccEl->getIntAttribute("number", -1);
-                    if (cc >= 0 && cc < numCCParams)
-                    {
-                        auto& presetMap = b.presetCCMappings[pIdx][cc];
-                        presetMap.enabled = ccEl->getBoolAttribute("enabled", false);
-                        presetMap.ccValue = (uint8_t)ccEl->getIntAttribute("ccValue", 64);
-                        presetMap.invert = ccEl->getBoolAttribute("invert", false);
-
-                        // 🔹 фикс: сразу синхронизируем ccPresetStates
-                        b.ccPresetStates[pIdx][cc] = presetMap.enabled;
-
-                        auto& globalMap = b.globalCCMappings[cc];
-                        globalMap.paramIndex = ccEl->getIntAttribute("paramIndex", -1);
-                        globalMap.name = ccEl->getStringAttribute("paramName");
-                    }
-                }
-            }
-        }
-    }
-
-    // Полный state плагина
-    b.pluginState.reset();
-    if (auto* stateEl = bankEl.getChildByName("PluginState"))
-        b.pluginState.fromBase64Encoding(stateEl->getAllSubText().trim());
-
-    // Baseline параметров
-    b.pluginParamValues.clear();
-    if (auto* paramsEl = bankEl.getChildByName("PluginParams"))
-    {
-        forEachXmlChildElementWithTagName(*paramsEl, pe, "Param")
-            b.pluginParamValues.push_back((float)pe->getDoubleAttribute("value", 0.0));
-    }
-
-    // Diff’ы параметров
-    b.paramDiffs.clear();
-    if (auto* diffsEl = bankEl.getChildByName("ParamDiffs"))
-    {
-        forEachXmlChildElementWithTagName(*diffsEl, de, "Diff")
-        {
-            int idx = de->getIntAttribute("index", -1);
-            if (idx >= 0)
-                b.paramDiffs[idx] = (float)de->getDoubleAttribute("value", 0.0);
-        }
-    }
+    BankLibraryIO::deserializeBank(b, bankEl);
 }
 void BankEditor::applyBankToPlugin(int bankIndex, bool synchronous /* = false */)
 {
+    slotStatesChanged = true;
     if (bankIndex < 0 || bankIndex >= (int)banks.size())
         return;
+
+    // банк ещё разбирается — поднимаем его в очереди загрузчика, применится по приходу
+    if (isBankPending(bankIndex))
+    {
+        bankLoader.prioritiseBank(bankIndex);
+        return;
+    }
     if (!vstHost)
         return;
 
@@ -2267,9 +2651,16 @@ void BankEditor::applyBankToPlugin(int bankIndex, bool synchronous /* = false */
         return;
 
     // --- Если есть полный state
-    if (b.pluginState.getSize() > 0)
+    if (!b.pluginState.isEmpty())
     {
-        auto stateCopy = b.pluginState;
+        auto stateCopy = b.pluginState.getDecoded(); // первое обращение — декодирование
+        if (b.pluginState.isFailed())
+        {
+            // файл библиотеки подменён в обход программы: пустышку в плагин не шлём
+            // (и умолчаниями его не затираем), сохранение такого банка тоже откажет
+            reportUnavailableState(bankIndex);
+            return;
+        }
         auto targetId = lastLoadedPluginId;
         bool justLoaded = needLoad;
 
@@ -2281,14 +2672,14 @@ void BankEditor::applyBankToPlugin(int bankIndex, bool synchronous /* = false */
                 auto* instCheck = vstHost->getPluginInstance(activeSlot);
                 if (!instCheck) return;
 
-                const int sz = (int)stateCopy.getSize();
-                if (sz <= 0 || stateCopy.getData() == nullptr) return;
+                const int sz = (int)stateCopy->getSize();
+                if (sz <= 0 || stateCopy->getData() == nullptr) return;
 
                 bool wasOpen = vstHost->isPluginEditorOpen();
                 if (wasOpen) vstHost->closePluginEditorIfOpen();
 
                 DBG("Applying full plugin state (" << sz << " bytes)");
-                try { instCheck->setStateInformation(stateCopy.getData(), sz); }
+                try { instCheck->setStateInformation(stateCopy->getData(), sz); }
                 catch (...) { DBG("Exception in setStateInformation — skipped"); }
 
                 if (wasOpen)
@@ -2321,22 +2712,67 @@ void BankEditor::applyBankToPlugin(int bankIndex, bool synchronous /* = false */
         return;
     }
 
-    // --- Если state пуст — baseline + diffs
+    // --- Если state пуст — умолчания плагина + отличия банка
     if (b.activeProgram >= 0)
         instNow->setCurrentProgram(b.activeProgram);
 
-    auto params = instNow->getParameters();
-    const int n = std::min((int)params.size(), (int)b.pluginParamValues.size());
-    for (int i = 0; i < n; ++i)
-        params[i]->setValueNotifyingHost(b.pluginParamValues[i]);
+    const int writes = applyParams(b, *instNow);
+    DBG("[ApplyBank] " << writes << " of " << instNow->getParameters().size() << " params written");
+}
+
+void BankEditor::reportUnavailableState(int bankIndex)
+{
+    juce::Logger::writeToLog("[ApplyBank] state of bank " + juce::String(bankIndex + 1)
+                             + " is unavailable, not applied: " + currentlyLoadedBankFile.getFullPathName());
+
+    juce::AlertWindow::showMessageBoxAsync(
+        juce::AlertWindow::WarningIcon,
+        "Bank state unavailable",
+        "The plugin state of bank " + juce::String(bankIndex + 1) + " could not be read: "
+        + currentlyLoadedBankFile.getFileName() + " was changed outside the application.\n"
+        "The state was not applied and the library will not be saved until the bank is stored again.");
+}
 
-    for (const auto& kv : b.paramDiffs)
+int BankEditor::applyParams(const Bank& b, juce::AudioProcessor& processor) const
+{
+    const auto& params = processor.getParameters();
+    int writes = 0;
+
+    // параметр уже на месте — хост и слушатели не дёргаются
+    auto set = [&](int i, float v)
+        {
+            if (params[i]->getValue() != v)
+            {
+                params[i]->setValueNotifyingHost(v);
+                ++writes;
+            }
+        };
+
+    if (!b.pluginParamValues.empty())
+    {
+        // банк заготовки в старой полной раскладке — как раньше: весь вектор, затем diff'ы
+        const int n = std::min((int)params.size(), (int)b.pluginParamValues.size());
+        for (int i = 0; i < n; ++i)
+            set(i, b.pluginParamValues[(size_t)i]);
+    }
+    else
     {
-        int idx = kv.first;
-        float val = kv.second;
-        if (idx >= 0 && idx < (int)params.size())
-            params[idx]->setValueNotifyingHost(val);
+        auto it = pluginParamDefaults.find(normalizePluginId(b.pluginId));
+        if (it != pluginParamDefaults.end())
+        {
+            const auto& defaults = it->second;
+            const int n = std::min((int)params.size(), (int)defaults.size());
+            for (int i = 0; i < n; ++i)
+                if (b.paramDiffs.find(i) == b.paramDiffs.end())
+                    set(i, defaults[(size_t)i]);
+        }
     }
+
+    for (const auto& [idx, val] : b.paramDiffs)
+        if (juce::isPositiveAndBelow(idx, (int)params.size()))
+            set(idx, val);
+
+    return writes;
 }
 
 
@@ -2350,30 +2786,31 @@ void BankEditor::snapshotCurrentBank()
         return;
 
     auto& b = banks[activeBankIndex];
-    const auto& params = inst->getParameters();
-    const int N = (int)params.size();
+    captureParams(b, *inst);
+    b.activeProgram = inst->getCurrentProgram();
+}
 
-    // Инициализация/переразмер базовой копии параметров банка
-    if ((int)b.pluginParamValues.size() != N)
-        b.pluginParamValues.assign(N, 0.0f);
+void BankEditor::captureParams(Bank& b, juce::AudioProcessor& processor)
+{
+    const auto& params = processor.getParameters();
+    const int N = (int)params.size();
 
-    static constexpr float eps = 1.0e-4f;
-    std::unordered_map<int, float> newDiffs;
-    newDiffs.reserve((size_t)N / 4); // эвристика, чтобы меньше реаллокаций
+    // вектор по умолчанию заводится при первом снимке плагина и только дописывается:
+    // на уже записанные значения ссылаются paramDiffs других банков
+    auto& defaults = pluginParamDefaults[normalizePluginId(b.pluginId)];
+    for (int i = (int)defaults.size(); i < N; ++i)
+        defaults.push_back(params[i]->getDefaultValue());
 
+    std::unordered_map<int, float> diffs;
     for (int i = 0; i < N; ++i)
     {
         const float v = params[i]->getValue();       // текущее значение в плагине [0..1]
-        const float old = b.pluginParamValues[i];    // сохранённый baseline банка
-
-        if (std::abs(v - old) > eps)
-            newDiffs[i] = v;                         // зафиксировать как отличающееся
-
-        b.pluginParamValues[i] = v;                  // обновить baseline банка
+        if (v != defaults[(size_t)i])
+            diffs[i] = v;                            // хранится только отличие от умолчания
     }
 
-    b.paramDiffs = std::move(newDiffs);
-    b.activeProgram = inst->getCurrentProgram();
+    b.paramDiffs = std::move(diffs);
+    std::vector<float>().swap(b.pluginParamValues); // банк заготовки — сразу в разреженную раскладку
 }
 
 void BankEditor::unloadPluginEverywhere()
@@ -2383,9 +2820,9 @@ void BankEditor::unloadPluginEverywhere()
         vstHost->unloadPlugin(activeSlot);
 
     // 2. Сбрасываем все банки в дефолт
-    for (int i = 0; i < numBanks; ++i)
+    for (int i = 0; i < (int)banks.size(); ++i)
     {
-        banks[i] = Bank(); // пересоздаём структуру
+        banks[i] = Bank(numLibraryPresets); // пересоздаём структуру
         banks[i].bankName = "BANK" + juce::String(i + 1);
     }
 
@@ -2394,6 +2831,7 @@ void BankEditor::unloadPluginEverywhere()
     globalPluginId.clear();
     globalPluginState.reset();
     globalPluginParamValues.clear();
+    pluginParamDefaults.clear();
     globalActiveProgram = -1;
 
     // 4. Сбрасываем активные индексы
@@ -2446,10 +2884,10 @@ void BankEditor::applyPedalValue(int slot, float norm)
     }
 
     // 3. Обновление модели (если нужно)
-    if (activePreset >= 0 && activePreset < (int)bank.ccPresetStates.size())
+    if (activePreset >= 0 && activePreset < bank.getNumPresets()
+        && bank.getPresetCC(activePreset, slot).enabled != (norm > 0.0f))
     {
-        bank.ccPresetStates[activePreset][slot] = (norm > 0.0f);
-        bank.presetCCMappings[activePreset][slot].enabled = (norm > 0.0f);
+        bank.editPresetCC(activePreset, slot).enabled = (norm > 0.0f);
     }
 
     sendChange();
@@ -2484,8 +2922,8 @@ void BankEditor::checkForChanges()
         modified = true;
     }
 
-    for (int i = 0; i < numPresets && !modified; ++i) {
-        if (presetEditors[i].getText() != bankSnapshot.presetNames[i]) {
+    for (int i = 0; i < numLibraryPresets && !modified; ++i) {
+        if (i >= bankSnapshot.getNumPresets() || presetEditors[i].getText() != bankSnapshot.presetNames[(size_t)i]) {
             DBG("[CheckChanges] presetName[" << i << "] changed");
             modified = true;
         }
@@ -2524,7 +2962,7 @@ void BankEditor::checkForChanges()
         DBG("[CheckChanges] paramDiffs changed");
         modified = true;
     }
-    if (!modified && current.pluginState.toBase64Encoding() != snap.pluginState.toBase64Encoding()) {
+    if (!modified && current.pluginState != snap.pluginState) {
         DBG("[CheckChanges] pluginState changed");
         modified = true;
     }
@@ -2535,6 +2973,10 @@ void BankEditor::checkForChanges()
         modified = true;
     }
 
+    // --- восстановлено после падения и ещё не сохранено ---
+    if (!modified && restoredUnsaved)
+        modified = true;
+
     // --- мигание кнопки Store ---
     if (modified) {
         bool blink = (juce::Time::getMillisecondCounter() / 500) % 2;
@@ -2578,93 +3020,157 @@ juce::File BankEditor::getBankDir() const
 // Извлекаем начальный числовой префикс из имени (без расширения)
 int BankEditor::getNumericPrefix(const juce::String& name) const
 {
-    int i = 0;
-    while (i < name.length() && juce::CharacterFunctions::isDigit(name[i]))
-        ++i;
-    if (i == 0) return -1;
-    return name.substring(0, i).getIntValue();
+    return BankFileIndex::getNumericPrefix(name);
+}
+
+// Файлы BANK с префиксом, отсортированные — из индекса, без сканирования
+juce::Array<juce::File> BankEditor::scanNumericBankFiles() const
+{
+    return bankFiles.getFiles();
 }
+void BankEditor::loadBankFile(const juce::File& sourceFile)
+{
+    if (!sourceFile.existsAsFile())
+        return;
 
-// Компаратор для сортировки
-struct FileComparator
+    // рабочий файл, boot_config.xml и loadedFileName обновятся по готовности
+    loadSettingsFromFile(sourceFile);
+}
+// Навигация вперёд/назад
+void BankEditor::navigateBank(bool forward)
 {
-    const BankEditor* editor;
-    int compareElements(const juce::File& a, const juce::File& b) const
+    // открыт сет-лист — шагаем по песням, а не по числовым префиксам файлов
+    if (setlistEngine.isActive())
     {
-        int ap = editor->getNumericPrefix(a.getFileNameWithoutExtension());
-        int bp = editor->getNumericPrefix(b.getFileNameWithoutExtension());
-
-        if (ap != bp)
-            return (ap < bp) ? -1 : 1;
-
-        return a.getFileNameWithoutExtension()
-            .compare(b.getFileNameWithoutExtension());
+        stepSetlist(forward ? 1 : -1);
+        return;
     }
-};
 
-// Сканируем BANK и сортируем по префиксу
-juce::Array<juce::File> BankEditor::scanNumericBankFiles() const
+    auto target = getNavigationTarget(forward);
+    if (target != juce::File())
+        loadBankFile(target);
+}
+
+juce::File BankEditor::getNavigationTarget(bool forward) const
 {
-    auto bankDir = getBankDir();
-    juce::Array<juce::File> result;
+    // отсчёт от последнего запрошенного файла: пока идёт загрузка,
+    // повторные NEXT/PREV шагают дальше, а не повторяют тот же файл
+    auto currentBase = requestedBankFile.getFileNameWithoutExtension();
+
+    // Если текущий файл без префикса → крайний; иначе сосед по индексу (O(1))
+    return getNumericPrefix(currentBase) < 0 ? bankFiles.getEdge(forward)
+                                             : bankFiles.getNeighbour(currentBase, forward);
+}
 
-    auto files = bankDir.findChildFiles(juce::File::findFiles, false, "*.xml");
-    for (auto& f : files)
+bool BankEditor::loadSetlist(const juce::File& file)
+{
+    Setlist setlist;
+    if (!SetlistIO::read(file, setlist) || setlist.isEmpty())
     {
-        if (getNumericPrefix(f.getFileNameWithoutExtension()) >= 0)
-            result.add(f);
+        DBG("[Setlist] cannot open: " << file.getFullPathName());
+        return false;
     }
 
-    FileComparator comp{ this };
-    result.sort(comp, true);
-    return result;
+    DBG("[Setlist] " << setlist.name << ": " << (int)setlist.entries.size() << " songs");
+    setlistEngine.setSetlist(std::move(setlist));
+    applySetlistStep(setlistEngine.moveTo(0));
+    return true;
 }
-void BankEditor::loadBankFile(const juce::File& sourceFile)
+
+bool BankEditor::importLibraries(const juce::Array<juce::File>& sources,
+                                 BankLibraryImporter::ProgressCallback onProgress)
 {
-    if (!sourceFile.existsAsFile())
-        return;
+    auto progress = [onProgress = std::move(onProgress)](const BankLibraryImporter::Progress& p)
+        {
+            DBG("[Import] " << p.parsed << "/" << p.total << " parsed, " << p.queued << " queued, "
+                << p.duplicates << " duplicates, " << p.failed << " failed");
+            if (onProgress)
+                onProgress(p);
+        };
 
-    loadSettingsFromFile(sourceFile);
-    currentlyLoadedBankFile = sourceFile;
+    auto finished = [this](const BankLibraryImporter::Result& result)
+        {
+            lastImport = result;
+            for (const auto& item : result.items)
+                if (item.status == BankLibraryImporter::Item::Status::failed)
+                    DBG("[Import] " << item.source.getFullPathName() << ": " << item.message);
 
-    writeBootConfig(sourceFile);
+            DBG("[Import] done: " << result.imported << " imported, " << result.duplicates << " duplicates, "
+                << result.failed << " failed" << (result.cancelled ? " (cancelled)" : "") << ", "
+                << juce::String(result.ms, 1) << " ms");
 
-    loadedFileName = sourceFile.getFileNameWithoutExtension();
+            // новые файлы индекс NEXT/PREV подхватит сам (наблюдатель папки), поиск — сверяем сейчас
+            bankSearch.refresh();
+        };
 
+    return importer.start(sources, getBankDir(), {}, std::move(progress), std::move(finished));
 }
-// Навигация вперёд/назад
-void BankEditor::navigateBank(bool forward)
+
+void BankEditor::stepSetlist(int delta)
 {
-    auto files = scanNumericBankFiles();
-    if (files.isEmpty())
+    applySetlistStep(setlistEngine.step(delta));
+}
+
+void BankEditor::applySetlistStep(const SetlistEngine::Step& step)
+{
+    if (step.entry == nullptr)
+        return; // край сет-листа
+
+    const auto& entry = *step.entry;
+    DBG("[Setlist] -> " << SetlistIO::describe(entry));
+
+    if (!entry.library.existsAsFile())
+    {
+        DBG("[Setlist] library not found: " << entry.library.getFullPathName());
         return;
+    }
 
-    auto currentBase = currentlyLoadedBankFile.getFileNameWithoutExtension();
-    int currentPrefix = getNumericPrefix(currentBase);
+    setlistStepTicks = juce::Time::getHighResolutionTicks();
 
-    // Если текущий файл без префикса → крайний
-    if (currentPrefix < 0)
+    // песня из уже открытой библиотеки — только банк и пресет
+    if (entry.library == currentlyLoadedBankFile && !isLoadingFromFile
+        && juce::isPositiveAndBelow(entry.bank, (int)banks.size()))
     {
-        loadBankFile(forward ? files.getFirst() : files.getLast());
+        const auto& state = banks[(size_t)entry.bank].pluginState;
+        setlistStepStaged = state.isEmpty() || state.isDecoded();
+        setActiveBankIndex(entry.bank);
+        setActivePreset(juce::jlimit(0, numLibraryPresets - 1, entry.preset));
+        noteTimeToSound();
         return;
     }
 
-    int currentIndex = -1;
-    for (int i = 0; i < files.size(); ++i)
+    // applyLoadedLibrary перейдёт на банк/пресет песни
+    pendingSearchHit = { entry.library, entry.bank, entry.preset, {} };
+
+    // библиотека в окне сет-листа — применяем из памяти, как соседа по NEXT/PREV
+    if (step.lib != nullptr)
     {
-        if (files[i].getFileNameWithoutExtension() == currentBase)
-        {
-            currentIndex = i;
-            break;
-        }
+        setlistStepStaged = step.staged;
+        bankLoader.cancelPending();
+        isLoadingFromFile = true;
+        requestedBankFile = entry.library;
+        libraryCache.insert(entry.library, entry.library.getSize(), entry.library.getLastModificationTime(), step.lib);
+        BankLibrary lib(*step.lib);
+        applyLoadedLibrary(lib, entry.library);
+        return;
     }
-    if (currentIndex == -1) return;
 
-    int targetIndex = forward
-        ? (currentIndex < files.size() - 1 ? currentIndex + 1 : 0)
-        : (currentIndex > 0 ? currentIndex - 1 : files.size() - 1);
+    setlistStepStaged = false;
+    loadSettingsFromFile(entry.library);
+}
+
+void BankEditor::prefetchNeighbours()
+{
+    // NEXT — чаще, поэтому первым (при нехватке бюджета уходит PREV)
+    juce::Array<juce::File> neighbours;
+    for (bool forward : { true, false })
+    {
+        auto f = getNavigationTarget(forward);
+        if (f != juce::File() && f != currentlyLoadedBankFile && !libraryCache.contains(f))
+            neighbours.add(f);
+    }
 
-    loadBankFile(files[targetIndex]);
+    bankPrefetcher.prefetch(neighbours);
 }
 
 
@@ -4,15 +4,31 @@
 #include <vector>
 #include <functional>
 #include <array>
+#include <map>
 #include <unordered_map>
+#include <atomic>
 #include "SetCCDialog.h"    
 #include "vst_host.h"
 #include "LearnController.h" 
 #include "FileManager.h" 
+#include "bank_library_loader.h"
+#include "bank_file_writer.h"
+#include "bank_file_index.h"
+#include "bank_library_prefetcher.h"
+#include "bank_library_cache.h"
+#include "bank_search_index.h"
+#include "session_store.h"
+#include "setlist_engine.h"
+#include "recovery_snapshot.h"
+#include "bank_library_importer.h"
+#include "plugin_state_ref.h"
+#include "session_image.h"
+#include "bank_model.h"
 #include <windows.h>
 
 
 class PluginManager; // ✅ добавлено: вперёд объявление
+struct BankLibrary;
 // LookAndFeel для крупных значков на кнопках
 struct BigIconLookAndFeel : public juce::LookAndFeel_V4
 {
@@ -28,12 +44,6 @@ struct BigIconLookAndFeel : public juce::LookAndFeel_V4
             1);
     }
 };
-struct PresetCCMapping
-{
-    uint8_t ccValue = 64;
-    bool enabled = false;
-    bool invert = false; // добавляем поле invert
-};
 
 //==============================================================================
 // BankEditor — основной компонент для управления банками и CC-мэппингом.
@@ -44,93 +54,37 @@ class BankEditor : public juce::Component,
     private juce::Timer
 {
 public:
-    static constexpr int numPresets = 6;
-    static constexpr int numCCParams = 14;
-
-    struct Bank
-    {
-        // --- Пользовательские данные ---
-        juce::String  bankName{ "PRESET" };
-        juce::String  pluginName{ "None" };
-        juce::String  presetNames[numPresets];
-        int           activeProgram = -1;
-
-        std::vector<std::vector<bool>> ccPresetStates;
-        std::vector<float>             presetVolumes;
-        std::array<CCMapping, numCCParams> globalCCMappings;
-        std::vector<std::array<PresetCCMapping, numCCParams>> presetCCMappings;
-        std::vector<float> pluginParamValues;
-
-        // --- Технические данные ---
-        juce::String  pluginId;
-        juce::MemoryBlock pluginState;
-        std::unordered_map<int, float> paramDiffs;
-
-        // --- Конструктор ---
-        Bank()
-        {
-            for (int i = 0; i < numPresets; ++i)
-                presetNames[i] = "Scene " + juce::String(i + 1);
-
-            ccPresetStates.assign(numPresets, std::vector<bool>(numCCParams, false));
-            presetVolumes.assign(numPresets, 1.0f);
-
-            for (int i = 0; i < numCCParams; ++i)
-                globalCCMappings[i].name = "<none>";
-
-            presetCCMappings.resize(numPresets);
-            for (auto& ccArray : presetCCMappings)
-                for (int i = 0; i < numCCParams; ++i)
-                    ccArray[i] = PresetCCMapping{};
-        }
-
-        // --- Сравнение для мигания Store ---
-        bool operator==(const Bank& other) const
-        {
-            if (bankName.trim().toLowerCase() != other.bankName.trim().toLowerCase())
-                return false;
-
-            if (pluginName != other.pluginName) return false;
-            if (pluginId != other.pluginId) return false;
-       
-            for (int i = 0; i < numPresets; ++i)
-                if (presetNames[i] != other.presetNames[i])
-                    return false;
-
-           // if (ccPresetStates != other.ccPresetStates) return false;
-            if (presetVolumes != other.presetVolumes) return false;
-
-            for (int i = 0; i < numCCParams; ++i)
-            {
-                if (globalCCMappings[i].name != other.globalCCMappings[i].name) return false;
-                if (globalCCMappings[i].paramIndex != other.globalCCMappings[i].paramIndex) return false;
-            }
-
-            if (presetCCMappings.size() != other.presetCCMappings.size()) return false;
-            for (size_t p = 0; p < presetCCMappings.size(); ++p)
-            {
-                for (int i = 0; i < numCCParams; ++i)
-                {
-                    if (presetCCMappings[p][i].ccValue != other.presetCCMappings[p][i].ccValue) return false;
-                    if (presetCCMappings[p][i].invert != other.presetCCMappings[p][i].invert) return false;
-                    if (presetCCMappings[p][i].enabled != other.presetCCMappings[p][i].enabled) return false;
-                }
-            }
-
-            if (pluginParamValues != other.pluginParamValues) return false;
-
-            return true;
-        }
-
-        bool operator!=(const Bank& other) const
-        {
-            return !(*this == other);
-        }
-    };
+    // Пределы размеров библиотеки — в bank_model.h (общие с BankLibrary и bank_tool)
+    static constexpr int defaultNumPresets = BankModel::defaultNumPresets;
+    static constexpr int defaultNumBanks = BankModel::defaultNumBanks;
+    static constexpr int maxPresets = BankModel::maxPresets;
+    static constexpr int maxBanks = BankModel::maxBanks;
+    static constexpr int numCCParams = BankModel::numCCParams;
+    // Прежняя константа раскладки (было 6): теперь — верхняя граница для массивов
+    // на maxPresets (Bank::presetCCMappings, кнопки). Число пресетов библиотеки —
+    // getNumPresets(); presetNames/presetVolumes — через Bank::getPresetName/getPresetVolume.
+    static constexpr int numPresets = maxPresets;
+    static constexpr int maxDecodedBankStates = 4; // кэш декодированных PluginState (0 — без ограничения)
+    static constexpr int pluginReadyPollMs = 10;     // загрузка библиотеки: опрос загрузки плагина
+    static constexpr int maxPluginReadyPolls = 100;  // дольше — применяем как есть
+    static constexpr int maxSlotStatesReuses = 10; // снимков восстановления без опроса плагинов подряд (~30 с)
+    static constexpr double spillCompactRatio = 0.5; // доля мёртвых байт, после которой spill-файл сжимается
+
+    using PresetCCRow = BankModel::PresetCCRow;
+    using ParamDefaults = BankModel::ParamDefaults;
+    using Bank = BankModel::Bank;
 
     /** Возвращает индекс текущего (активного) пресета. */
     int getActivePresetIndex() const noexcept { return activePreset; }
 
+    /** Размеры текущей библиотеки. */
+    int getNumBanks() const noexcept { return (int)banks.size(); }
+    int getNumPresets() const noexcept { return numLibraryPresets; }
+
+    /** Меняет число банков (1..maxBanks) и пресетов (1..maxPresets) текущей библиотеки;
+        лишние банки и пресеты отбрасываются, новые создаются пустыми. */
+    void setLibraryCapacity(int newNumBanks, int newNumPresets);
+
     /** Прокинуть сюда midiOut из Main.cpp */
     void setMidiOutput(juce::MidiOutput* m) noexcept { midiOutput = m; }
 
@@ -187,6 +141,60 @@ public:
     void updateVSTButtonLabel();
     // Навигация по файлам: true → вперёд, false → назад
     void navigateBank(bool forward);
+    /** Файл, на который перейдёт NEXT/PREV; {} — переходить некуда. */
+    juce::File getNavigationTarget(bool forward) const;
+    /** Ставит соседей текущего файла в фоновый разбор. */
+    void prefetchNeighbours();
+    BankLibraryPrefetcher::Stats getPrefetchStats() const { return bankPrefetcher.getStats(); }
+    BankLibraryCache::Stats getLibraryCacheStats() const { return libraryCache.getStats(); }
+    /** Поиск по всем библиотекам папки BANK (имена библиотек, банков, пресетов, плагинов, CC). */
+    std::vector<BankSearchIndex::Hit> searchBanks(const juce::String& query, int maxHits = 50) const { return bankSearch.search(query, maxHits); }
+    BankSearchIndex::Stats getSearchStats() const { return bankSearch.getStats(); }
+
+    // --- Время до звука: от выбора файла до применения активного банка к плагину ---
+    struct LoadStats
+    {
+        int loads = 0;
+        double lastTimeToSoundMs = 0.0;
+        double averageTimeToSoundMs = 0.0;
+        double maxTimeToSoundMs = 0.0;
+    };
+    LoadStats getLoadStats() const noexcept { return loadStats; }
+
+    // --- Сет-лист: NEXT/PREV идут по песням, соседние держатся готовыми ---
+    /** Открывает сет-лист и переходит к первой песне; false — файл не прочитан или пуст. */
+    bool loadSetlist(const juce::File& file);
+    void stepSetlist(int delta);
+    void closeSetlist() { setlistEngine.clear(); }
+    const Setlist& getSetlist() const noexcept { return setlistEngine.getSetlist(); }
+    int getSetlistPosition() const noexcept { return setlistEngine.getPosition(); }
+    SetlistEngine::Stats getSetlistStats() const noexcept { return setlistEngine.getStats(); }
+    RecoverySnapshotter::Stats getRecoveryStats() const { return recovery.getStats(); }
+
+    // --- Импорт: чужие библиотеки — в BANK, с продолжением нумерации ---
+    /** Файлы и папки (рекурсивно) разбираются в фоне; false — предыдущий импорт ещё идёт. */
+    bool importLibraries(const juce::Array<juce::File>& sources,
+                         BankLibraryImporter::ProgressCallback onProgress = {});
+    void cancelImport() { importer.cancel(); }
+    bool isImporting() const { return importer.isImporting(); }
+    const BankLibraryImporter::Result& getLastImportResult() const noexcept { return lastImport; }
+
+    // --- Бюджет памяти: state'ы холодных банков выгружаются на диск ---
+    struct BankMemory
+    {
+        juce::int64 stateBytes = 0;  // state в памяти (0 — только на диске)
+        juce::int64 paramBytes = 0;  // pluginParamValues + paramDiffs
+    };
+
+    /** Занятое в памяти по банкам (общий state нескольких банков — у каждого). */
+    std::vector<BankMemory> getBankMemory() const;
+
+    /** Всего: банки, снимок активного банка и глобальный плагин; общие state'ы — один раз. */
+    juce::int64 getResidentBytes() const;
+
+    /** Предел памяти под данные банков (0 — без ограничения); сразу применяется. */
+    void setMemoryBudget(juce::int64 bytes);
+    juce::int64 getMemoryBudget() const noexcept { return memoryBudget; }
     int getNumericPrefix(const juce::String& name) const;
     //проверка 
     juce::String loadedFileName;
@@ -203,7 +211,8 @@ public:
     static constexpr int numSlots = 4; // количество слотов VST
 
 
-    void setActiveSlot(int slotIndex) { activeSlot = slotIndex; updateVSTButtonLabel(); }
+    void setActiveSlot(int slotIndex) { activeSlot = slotIndex; sessionStore.setActiveSlot(slotIndex); updateVSTButtonLabel(); }
+    SessionStore::Stats getSessionStats() const { return sessionStore.getStats(); }
    
 private:
     bool isSettingPreset = false;
@@ -215,7 +224,26 @@ private:
 
     // Файловые операции
     void saveSettingsToFile(const juce::File& configFile);
-    void loadSettingsFromFile(const juce::File& configFile);
+    void loadSettingsFromFile(const juce::File& configFile);   // асинхронно, через bankLoader
+    // stillLoading — банки заготовки, которые ещё разбираются (постепенная загрузка)
+    void applyLoadedLibrary(BankLibrary& lib, const juce::File& file, const std::vector<int>& stillLoading = {});
+    void applyLoadedBank(int bankIndex, const Bank& bank);     // банк заготовки дочитан
+    void completeProgressiveLoad(BankLibrary& lib);            // библиотека дочитана целиком
+    bool isBankPending(int bankIndex) const noexcept;
+    bool hasPendingBanks() const noexcept;
+    void noteTimeToSound();                                    // активный банк звучит — замер окончен
+    void applySetlistStep(const SetlistEngine::Step& step);
+    void writeSessionImage();                                  // при выходе: образ для быстрого старта
+    void startSessionImageCheck();                             // старт из образа: сверка содержимого файла в фоне
+    void rollBackSessionImage(const juce::File& file);         // образ разошёлся с файлом: свежий разбор вместо него
+    void finishLibraryApply();                                 // продолжение applyLoadedLibrary: банк на плагин
+    void callWhenPluginReady(std::function<void()> fn, int pollsLeft); // в message thread, когда плагин загружен
+    bool restoreFromRecovery();                                // после падения: снимок recovery.nxr
+    std::unique_ptr<RecoverySnapshotter::Snapshot> captureRecoverySnapshot();
+    void applyRecoveredSlotStates();                           // живые правки плагинов поверх применённого банка
+    void touchBank(int bankIndex);                             // отметка «банк использовался»
+    void enforceMemoryBudget();                                // выгрузка самых давних банков сверх бюджета
+    void rotateStateSpillFile();                               // сжатие spill-файла, если мёртвые байты — больше spillCompactRatio
 
     // Сброс и подсветка
     void resetAllDefaults();
@@ -224,6 +252,8 @@ private:
     void updatePresetButtons();
     // Диалоги и всплывающие меню
     void showBankSelectionMenu();
+    void showBankSearchResults();                    // по тексту bankSearchEditor
+    void openSearchHit(const BankSearchIndex::Hit& hit);
     void showVSTDialog();
     void editCCParameter(int ccIndex);
     // Смена активных индексов
@@ -239,8 +269,8 @@ private:
     void clearCCMappingsForActiveBank();
     void resetCCSlotState(int slot);
 
-    static constexpr int numBanks = 20;
     std::vector<Bank> banks;
+    int               numLibraryPresets = defaultNumPresets;   // пресетов в каждом банке библиотеки
     int               activeBankIndex = 0;
     int               activePreset = 0;
     juce::MidiOutput* midiOutput = nullptr;  // новый указатель на MIDI-выход
@@ -253,8 +283,8 @@ private:
 
     VSTHostComponent* vstHost = nullptr;
     juce::Label       bankIndexLabel, pluginLabel, selectedPresetLabel;
-    juce::TextButton  selectBankButton, presetButtons[numPresets], vstButton;
-    juce::TextEditor  bankNameEditor, presetEditors[numPresets];
+    juce::TextButton  selectBankButton, presetButtons[maxPresets], vstButton;
+    juce::TextEditor  bankNameEditor, presetEditors[maxPresets];   // видны первые numLibraryPresets
     juce::TextButton  setCCButtons[numCCParams];
     juce::TextEditor  ccNameEditors[numCCParams];
     juce::TextButton  ccToggleButtons[numCCParams];
@@ -287,11 +317,16 @@ private:
     juce::String globalPluginId;
     int globalActiveProgram = -1;
     std::vector<float> globalPluginParamValues;
-    juce::MemoryBlock globalPluginState;
+    PluginStateRef globalPluginState;   // обычно тот же блоб, что и у банков
+    ParamDefaults pluginParamDefaults;  // относительно них хранятся paramDiffs банков
     juce::XmlElement* serializeBank(const Bank& b, int index) const;
     void deserializeBank(Bank& b, const juce::XmlElement& bankEl);
+    BankLibrary makeLibrarySnapshot() const; // копия banks[] + глобальных данных для записи
     void applyBankToPlugin(int bankIndex);
     void snapshotCurrentBank();       // Сохраняет изменения текущего банка///раб
+    void captureParams(Bank& b, juce::AudioProcessor& processor); // paramDiffs банка из плагина
+    int applyParams(const Bank& b, juce::AudioProcessor& processor) const; // возвращает число записей
+    void reportUnavailableState(int bankIndex); // state банка не прочитать — лог и предупреждение
 
     std::unique_ptr<juce::FileChooser> fileChooser;
 
@@ -308,6 +343,53 @@ private:
     juce::TextButton nextButton;
     // Текущий загруженный файл
     juce::File currentlyLoadedBankFile;
+    juce::File requestedBankFile;        // последний запрошенный (может ещё грузиться)
+    SessionStore      sessionStore;      // boot_config.xml: файл для старта, банк/пресет, слот; пишется с задержкой
+    BankLibraryCache  libraryCache;      // разобранные библиотеки: путь + размер + mtime
+    BankLibraryLoader bankLoader;        // наполняет libraryCache
+    BankFileWriter    bankWriter;        // write-behind: temp → fsync → rename на I/O-потоке; наполняет libraryCache
+    BankFileIndex     bankFiles;         // отсортированные файлы BANK, обновляются наблюдателем
+    BankLibraryPrefetcher bankPrefetcher; // соседи по NEXT/PREV, разобранные заранее
+    BankSearchIndex   bankSearch;        // полнотекстовый индекс всех библиотек BANK
+    BankLibraryImporter importer;        // массовый импорт в BANK; пишет через bankWriter
+    BankLibraryImporter::Result lastImport;
+    juce::TextEditor  bankSearchEditor;
+    BankSearchIndex::Hit pendingSearchHit; // банк/пресет, которые выбрать после загрузки файла
+    std::vector<char> pendingBanks;      // по размеру banks: 1 — слот ещё пустая заготовка
+    juce::File partialLibraryFile;       // библиотека, применённая заготовкой и ещё не дочитанная
+    juce::File saveAfterLoad;            // сохранение, отложенное до конца загрузки
+    juce::int64 loadRequestTicks = 0;    // выбор файла (0 — замер не идёт)
+    LoadStats loadStats;
+    SetlistEngine setlistEngine;
+    juce::int64 setlistStepTicks = 0;    // шаг сет-листа (0 — замер не идёт)
+    bool setlistStepStaged = false;
+    RecoverySnapshotter recovery;        // снимки несохранённого состояния на случай падения
+
+    // Старт из образа сеанса: содержимое файла сверяется уже после старта звука
+    struct ImageCheck
+    {
+        juce::File file;                        // пусто — сверять нечего
+        juce::int64 stampSize = 0;
+        juce::Time stampTime;
+        juce::MemoryBlock hash;                 // SHA-256 из образа
+        std::shared_ptr<const BankLibrary> lib; // в кэш после успешной сверки
+
+        /** Размер и время файла те же, что при чтении образа. */
+        bool stampHolds() const { return file.getSize() == stampSize && file.getLastModificationTime() == stampTime; }
+    };
+    ImageCheck pendingImageCheck;
+    SessionImage::ContentCheck imageCheck;
+    juce::File unverifiedImageFile;      // применён образ, содержимое файла ещё не сверено — сохранение ждёт
+    std::vector<juce::MemoryBlock> pendingRecoveryStates; // state'ы слотов из снимка — ждут применения банка
+    bool restoredUnsaved = false;        // библиотека восстановлена после падения и ещё не сохранена
+    bool recoveryChecked = false;        // снимок прошлого запуска проверяется один раз — на старте
+    std::atomic<bool> slotStatesChanged { true }; // параметр/пресет менялся с прошлого снимка (пишет и аудио-поток)
+    std::vector<juce::MemoryBlock> lastSlotStates; // state'ы слотов из прошлого снимка
+    int slotStatesReuses = 0;            // сколько снимков подряд взяли state'ы слотов без опроса плагинов
+    juce::int64 memoryBudget = 0;        // 0 — без ограничения (boot_config: MemoryBudgetMB)
+    int spillGeneration = 0;             // номер текущего state_spill_N.bin
+    std::vector<juce::uint32> bankLastUsed;   // по размеру banks
+    juce::uint32 bankUseCounter = 0;
     // Вспомогательные функции
     juce::File getBankDir() const;
   
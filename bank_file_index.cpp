@@ -0,0 +1,337 @@
+#include "bank_file_index.h"
+#include "bank_library.h"
+#include <algorithm>
+
+#if JUCE_WINDOWS
+ #include <windows.h>
+#elif JUCE_LINUX
+ #include <sys/inotify.h>
+ #include <poll.h>
+ #include <unistd.h>
+#endif
+
+BankFileIndex::BankFileIndex()
+    : juce::Thread("BankFileIndex")
+{
+}
+
+BankFileIndex::~BankFileIndex()
+{
+    stopThread(4 * pollIntervalMs);
+}
+
+void BankFileIndex::setDirectory(const juce::File& dir)
+{
+    stopThread(4 * pollIntervalMs);
+
+    {
+        const juce::ScopedLock sl(lock);
+        directory = dir;
+        files.clear();
+        positionByName.clear();
+        scanned = false;
+    }
+
+    startThread();
+}
+
+//==============================================================================
+int BankFileIndex::getNumericPrefix(const juce::String& name)
+{
+    int i = 0;
+    while (i < name.length() && juce::CharacterFunctions::isDigit(name[i]))
+        ++i;
+    if (i == 0) return -1;
+    return name.substring(0, i).getIntValue();
+}
+
+bool BankFileIndex::isBankFile(const juce::File& f)
+{
+    return f.hasFileExtension(juce::String(BankLibraryIO::xmlExtension) + ";" + BankLibraryIO::binaryExtension)
+        && getNumericPrefix(f.getFileNameWithoutExtension()) >= 0;
+}
+
+// По числовому префиксу, затем по имени без расширения (как раньше при сканировании)
+bool BankFileIndex::comesBefore(const juce::File& a, const juce::File& b)
+{
+    const auto an = a.getFileNameWithoutExtension();
+    const auto bn = b.getFileNameWithoutExtension();
+
+    const int ap = getNumericPrefix(an);
+    const int bp = getNumericPrefix(bn);
+    if (ap != bp)
+        return ap < bp;
+
+    if (const int c = an.compare(bn))
+        return c < 0;
+
+    return a.getFileName() < b.getFileName(); // "1.xml" и "1.nxb" — стабильный порядок
+}
+
+//==============================================================================
+juce::Array<juce::File> BankFileIndex::getFiles() const
+{
+    const juce::ScopedLock sl(lock);
+    ensureScannedLocked();
+
+    juce::Array<juce::File> result;
+    result.ensureStorageAllocated((int)files.size());
+    for (const auto& f : files)
+        result.add(f);
+    return result;
+}
+
+juce::File BankFileIndex::getNeighbour(const juce::String& baseName, bool forward) const
+{
+    const juce::ScopedLock sl(lock);
+    ensureScannedLocked();
+
+    auto it = positionByName.find(baseName);
+    if (it == positionByName.end())
+        return {};
+
+    const int count = (int)files.size();
+    const int target = forward ? (it->second + 1) % count
+                               : (it->second + count - 1) % count;
+    return files[(size_t)target];
+}
+
+juce::File BankFileIndex::getEdge(bool forward) const
+{
+    const juce::ScopedLock sl(lock);
+    ensureScannedLocked();
+
+    if (files.empty())
+        return {};
+    return forward ? files.front() : files.back();
+}
+
+//==============================================================================
+void BankFileIndex::ensureScannedLocked() const
+{
+    if (scanned)
+        return;
+
+    // первый запрос раньше, чем поток успел проиндексировать папку
+    files.clear();
+    for (const auto& f : directory.findChildFiles(juce::File::findFiles, false, BankLibraryIO::fileWildcard))
+        if (isBankFile(f))
+            files.push_back(f);
+
+    std::sort(files.begin(), files.end(), comesBefore);
+    rebuildPositionsLocked();
+    scanned = true;
+}
+
+void BankFileIndex::rebuildPositionsLocked() const
+{
+    positionByName.clear();
+    positionByName.reserve(files.size());
+    for (int i = 0; i < (int)files.size(); ++i)
+        positionByName.emplace(files[(size_t)i].getFileNameWithoutExtension(), i); // первое вхождение
+}
+
+void BankFileIndex::rescan()
+{
+    const juce::ScopedLock sl(lock);
+    scanned = false;
+    ensureScannedLocked();
+}
+
+void BankFileIndex::fileAdded(const juce::File& f)
+{
+    if (!isBankFile(f))
+        return;
+
+    const juce::ScopedLock sl(lock);
+    if (!scanned)
+        return; // появится при первом сканировании
+
+    auto it = std::lower_bound(files.begin(), files.end(), f, comesBefore);
+    if (it != files.end() && *it == f)
+        return; // rename поверх существующего (атомарная запись)
+
+    files.insert(it, f);
+    rebuildPositionsLocked();
+}
+
+void BankFileIndex::fileRemoved(const juce::File& f)
+{
+    const juce::ScopedLock sl(lock);
+
+    auto it = std::lower_bound(files.begin(), files.end(), f, comesBefore);
+    if (it == files.end() || *it != f)
+        return;
+
+    files.erase(it);
+    rebuildPositionsLocked();
+}
+
+//==============================================================================
+void BankFileIndex::run()
+{
+    juce::File dir;
+    {
+        const juce::ScopedLock sl(lock);
+        dir = directory;
+    }
+
+    while (!threadShouldExit())
+    {
+        // наблюдение включается до сканирования: ничего не теряется между ними
+        if (!watchDirectory(dir))
+        {
+            // папки ещё нет или наблюдатель недоступен — периодический пересчёт
+            rescan();
+            wait(10 * pollIntervalMs);
+        }
+    }
+}
+
+#if JUCE_WINDOWS
+bool BankFileIndex::watchDirectory(const juce::File& dir)
+{
+    HANDLE dirHandle = CreateFileW(dir.getFullPathName().toWideCharPointer(), FILE_LIST_DIRECTORY,
+                                   FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                                   OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+    if (dirHandle == INVALID_HANDLE_VALUE)
+        return false;
+
+    OVERLAPPED overlapped {};
+    overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+
+    alignas(DWORD) char buffer[32 * 1024];
+    bool ok = overlapped.hEvent != nullptr;
+    bool first = true;
+
+    while (ok && !threadShouldExit())
+    {
+        ResetEvent(overlapped.hEvent);
+        if (!ReadDirectoryChangesW(dirHandle, buffer, sizeof(buffer), FALSE, FILE_NOTIFY_CHANGE_FILE_NAME,
+                                   nullptr, &overlapped, nullptr))
+        {
+            ok = false;
+            break;
+        }
+
+        if (first)
+        {
+            rescan();
+            first = false;
+        }
+
+        while (!threadShouldExit() && WaitForSingleObject(overlapped.hEvent, pollIntervalMs) == WAIT_TIMEOUT) {}
+
+        DWORD bytes = 0;
+        if (threadShouldExit())
+        {
+            CancelIo(dirHandle);
+            GetOverlappedResult(dirHandle, &overlapped, &bytes, TRUE);
+            break;
+        }
+
+        if (!GetOverlappedResult(dirHandle, &overlapped, &bytes, FALSE))
+        {
+            ok = false;
+            break;
+        }
+
+        if (bytes == 0)
+        {
+            rescan(); // буфер переполнен — событий слишком много, проще пересчитать
+            continue;
+        }
+
+        for (auto* p = buffer;;)
+        {
+            const auto* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(p);
+            const auto name = juce::String(info->FileName, (size_t)(info->FileNameLength / sizeof(WCHAR)));
+            const auto file = dir.getChildFile(name);
+
+            switch (info->Action)
+            {
+                case FILE_ACTION_ADDED:
+                case FILE_ACTION_RENAMED_NEW_NAME:  fileAdded(file);   break;
+                case FILE_ACTION_REMOVED:
+                case FILE_ACTION_RENAMED_OLD_NAME:  fileRemoved(file); break;
+                default: break;
+            }
+
+            if (info->NextEntryOffset == 0)
+                break;
+            p += info->NextEntryOffset;
+        }
+    }
+
+    if (overlapped.hEvent != nullptr)
+        CloseHandle(overlapped.hEvent);
+    CloseHandle(dirHandle);
+    return ok || threadShouldExit();
+}
+#elif JUCE_LINUX
+bool BankFileIndex::watchDirectory(const juce::File& dir)
+{
+    const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    const int wd = inotify_add_watch(fd, dir.getFullPathName().toRawUTF8(),
+                                     IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+                                   | IN_DELETE_SELF | IN_MOVE_SELF);
+    if (wd < 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    rescan();
+
+    alignas(inotify_event) char buffer[32 * 1024];
+    bool ok = true;
+
+    while (ok && !threadShouldExit())
+    {
+        pollfd pfd { fd, POLLIN, 0 };
+        const int ready = poll(&pfd, 1, pollIntervalMs);
+        if (ready <= 0)
+            continue;
+
+        const auto bytes = read(fd, buffer, sizeof(buffer));
+        if (bytes <= 0)
+            continue;
+
+        for (auto* p = buffer; p < buffer + bytes;)
+        {
+            const auto* ev = reinterpret_cast<const inotify_event*>(p);
+            p += sizeof(inotify_event) + ev->len;
+
+            if ((ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) != 0)
+            {
+                ok = false; // папку удалили/переместили — наблюдение заново
+                break;
+            }
+
+            if ((ev->mask & IN_Q_OVERFLOW) != 0)
+            {
+                rescan();
+                continue;
+            }
+
+            if (ev->len == 0 || (ev->mask & IN_ISDIR) != 0)
+                continue;
+
+            const auto file = dir.getChildFile(juce::String::fromUTF8(ev->name));
+            if ((ev->mask & (IN_CREATE | IN_MOVED_TO)) != 0)        fileAdded(file);
+            else if ((ev->mask & (IN_DELETE | IN_MOVED_FROM)) != 0) fileRemoved(file);
+        }
+    }
+
+    close(fd);
+    return ok || threadShouldExit();
+}
+#else
+bool BankFileIndex::watchDirectory(const juce::File&)
+{
+    return false;
+}
+#endif
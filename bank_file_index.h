@@ -0,0 +1,62 @@
+#pragma once
+#include <JuceHeader.h>
+#include <unordered_map>
+#include <vector>
+
+//==============================================================================
+// BankFileIndex — отсортированный список файлов библиотек в папке BANK
+// (только с числовым префиксом: "12 Strings.nxb"). Строится один раз и живёт
+// всё время работы редактора; изменения папки (в том числе сделанные снаружи)
+// приходят от системного наблюдателя — ReadDirectoryChangesW на Windows,
+// inotify на Linux — и применяются точечно, без повторного сканирования.
+// NEXT/PREV — O(1): позиция файла ищется по имени в хеш-таблице.
+//==============================================================================
+class BankFileIndex : private juce::Thread
+{
+public:
+    BankFileIndex();
+    ~BankFileIndex() override;
+
+    /** Папка для индексации; наблюдение перезапускается. */
+    void setDirectory(const juce::File& dir);
+
+    /** Копия индекса в порядке сортировки. */
+    juce::Array<juce::File> getFiles() const;
+
+    /** Соседний по кругу файл для имени без расширения; {} — имени нет в индексе. */
+    juce::File getNeighbour(const juce::String& baseName, bool forward) const;
+
+    /** Первый (forward) или последний файл; {} — индекс пуст. */
+    juce::File getEdge(bool forward) const;
+
+    /** Начальный числовой префикс имени (без расширения); -1 — префикса нет. */
+    static int getNumericPrefix(const juce::String& name);
+
+    /** Интервал проверки флага остановки, пока поток ждёт событий папки. */
+    static constexpr int pollIntervalMs = 200;
+
+private:
+    void run() override;
+
+    /** Блокирует до ошибки или остановки; false — наблюдение недоступно. */
+    bool watchDirectory(const juce::File& dir);
+
+    void rescan();
+    void fileAdded(const juce::File& f);
+    void fileRemoved(const juce::File& f);
+
+    // вызываются под lock
+    void ensureScannedLocked() const;
+    void rebuildPositionsLocked() const;
+
+    static bool isBankFile(const juce::File& f);
+    static bool comesBefore(const juce::File& a, const juce::File& b);
+
+    juce::CriticalSection lock;
+    juce::File directory;
+    mutable std::vector<juce::File> files;                        // отсортированы comesBefore
+    mutable std::unordered_map<juce::String, int> positionByName; // имя без расширения → первая позиция
+    mutable bool scanned = false;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(BankFileIndex)
+};
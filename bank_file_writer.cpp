@@ -0,0 +1,127 @@
+#include "bank_file_writer.h"
+#include "bank_library.h"
+#include "bank_library_cache.h"
+#include <algorithm>
+
+BankFileWriter::BankFileWriter(BankLibraryCache* cacheToFill)
+    : juce::Thread("BankFileWriter"),
+      queueDrained(true), // manual reset
+      cache(cacheToFill)
+{
+    queueDrained.signal();
+    startThread();
+}
+
+BankFileWriter::~BankFileWriter()
+{
+    flush();
+    signalThreadShouldExit();
+    wakeUp.signal();
+    stopThread(10000);
+}
+
+void BankFileWriter::enqueue(const juce::File& file, std::shared_ptr<const BankLibrary> snapshot)
+{
+    if (snapshot == nullptr)
+        return;
+
+    {
+        const juce::ScopedLock sl(lock);
+
+        auto it = std::find_if(queue.begin(), queue.end(),
+            [&file](const Job& j) { return j.file == file; });
+
+        if (it != queue.end())
+            it->snapshot = std::move(snapshot); // схлопываем серию сохранений
+        else
+            queue.push_back({ file, std::move(snapshot) });
+
+        queueDrained.reset();
+    }
+
+    wakeUp.signal();
+}
+
+std::shared_ptr<const BankLibrary> BankFileWriter::getPendingSnapshot(const juce::File& file) const
+{
+    const juce::ScopedLock sl(lock);
+
+    // очередь новее того, что пишется прямо сейчас
+    for (auto* jobs : { &queue, &inFlight })
+        for (const auto& j : *jobs)
+            if (j.file == file)
+                return j.snapshot;
+
+    return nullptr;
+}
+
+void BankFileWriter::flush()
+{
+    {
+        const juce::ScopedLock sl(lock);
+        if (queue.empty() && inFlight.empty())
+            return;
+        flushRequested = true;
+    }
+
+    wakeUp.signal();
+    queueDrained.wait(-1);
+}
+
+void BankFileWriter::run()
+{
+    while (!threadShouldExit())
+    {
+        wakeUp.wait(-1);
+
+        // даём серии запросов (LEARN, STORE подряд) собраться в одну запись;
+        // новые enqueue() окно не продлевают, flush() — прерывает
+        const auto deadline = juce::Time::getMillisecondCounter() + (juce::uint32)coalesceDelayMs;
+        for (;;)
+        {
+            {
+                const juce::ScopedLock sl(lock);
+                if (flushRequested)
+                    break;
+            }
+
+            const auto now = juce::Time::getMillisecondCounter();
+            if (now >= deadline || threadShouldExit())
+                break;
+
+            wakeUp.wait((int)(deadline - now));
+        }
+
+        for (;;)
+        {
+            {
+                const juce::ScopedLock sl(lock);
+                if (queue.empty())
+                {
+                    flushRequested = false;
+                    queueDrained.signal();
+                    break;
+                }
+                inFlight.swap(queue);
+            }
+
+            for (const auto& job : inFlight)
+                if (!writeJob(job))
+                    juce::Logger::writeToLog("[BankFileWriter] failed to write " + job.file.getFullPathName());
+
+            const juce::ScopedLock sl(lock);
+            inFlight.clear();
+        }
+    }
+}
+
+bool BankFileWriter::writeJob(const Job& job)
+{
+    // .nxb дописывается инкрементально, XML — атомарная перезапись целиком
+    if (!BankLibraryIO::write(job.file, *job.snapshot))
+        return false;
+
+    if (cache != nullptr)
+        cache->insert(job.file, job.file.getSize(), job.file.getLastModificationTime(), job.snapshot);
+    return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <JuceHeader.h>
+#include <memory>
+#include <vector>
+
+struct BankLibrary;
+class BankLibraryCache;
+
+//==============================================================================
+// BankFileWriter — отложенная (write-behind) запись библиотек банков.
+// Message thread только отдаёт неизменяемый снимок; сериализация и запись
+// (temp-файл → fsync → rename) выполняются на отдельном I/O-потоке.
+// Серия запросов для одного файла схлопывается в одну запись.
+// Записанный снимок — это и есть содержимое файла: он кладётся в
+// BankLibraryCache (если задан), и повторная загрузка обходится без разбора.
+//==============================================================================
+class BankFileWriter : private juce::Thread
+{
+public:
+    explicit BankFileWriter(BankLibraryCache* cache = nullptr);
+    ~BankFileWriter() override; // дописывает очередь перед выходом
+
+    /** Ставит снимок в очередь. Более старый ожидающий снимок того же файла отбрасывается. */
+    void enqueue(const juce::File& file, std::shared_ptr<const BankLibrary> snapshot);
+
+    /** Снимок, который ещё не лёг на диск (или nullptr) — чтобы не читать устаревший файл. */
+    std::shared_ptr<const BankLibrary> getPendingSnapshot(const juce::File& file) const;
+
+    /** Блокирует до записи всего, что стоит в очереди (выход из приложения). */
+    void flush();
+
+    /** Задержка перед записью, за которую успевают собраться повторные запросы. */
+    static constexpr int coalesceDelayMs = 300;
+
+private:
+    struct Job
+    {
+        juce::File file;
+        std::shared_ptr<const BankLibrary> snapshot;
+    };
+
+    void run() override;
+    bool writeJob(const Job& job);
+
+    juce::CriticalSection lock;
+    std::vector<Job> queue;       // не больше одного задания на файл
+    std::vector<Job> inFlight;    // забраны потоком, ещё пишутся
+    bool flushRequested = false;
+
+    juce::WaitableEvent wakeUp;
+    juce::WaitableEvent queueDrained;
+    BankLibraryCache* const cache;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(BankFileWriter)
+};
@@ -0,0 +1,1969 @@
+#include "bank_library.h"
+#include "bank_xml_stream.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <set>
+
+#if JUCE_LINUX || JUCE_MAC
+ #include <fcntl.h>
+ #include <unistd.h>
+#endif
+
+namespace
+{
+    constexpr char kBinaryMagic[4] = { 'N', 'X', 'B', 'L' };
+    constexpr uint32_t kHeaderSize = 48;     // фиксированная часть заголовка
+
+    constexpr int numCCParams = BankModel::numCCParams;
+    using PresetCCRow = BankModel::PresetCCRow;
+
+    std::atomic<int> stateCodec{ (int)PluginStateRef::Codec::zlib };
+    std::atomic<int> decodeThreads{ 0 };
+
+    // Общий пул разбора банков; вызывающий поток работает наравне с ним
+    juce::ThreadPool& decodePool()
+    {
+        static juce::ThreadPool pool(juce::jmax(1, juce::SystemStats::getNumCpus() - 1));
+        return pool;
+    }
+
+    int base64Value(char c) noexcept
+    {
+        if (c >= 'A' && c <= 'Z') return c - 'A';
+        if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+        if (c >= '0' && c <= '9') return c - '0' + 52;
+        if (c == '+') return 62;
+        if (c == '/') return 63;
+        return -1;
+    }
+
+    // Прямо в dest, без промежуточных строк; пробелы/переводы строк пропускаются
+    bool decodeBase64(const char* text, size_t length, uint8_t* dest, size_t destSize) noexcept
+    {
+        size_t out = 0;
+        uint32_t acc = 0;
+        int bits = 0;
+
+        for (size_t i = 0; i < length; ++i)
+        {
+            const char c = text[i];
+            if (c == '=')
+                break;
+            if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+                continue;
+
+            const int v = base64Value(c);
+            if (v < 0)
+                return false;
+
+            acc = (acc << 6) | (uint32_t)v;
+            bits += 6;
+            if (bits >= 8)
+            {
+                bits -= 8;
+                if (out == destSize)
+                    return false;
+                dest[out++] = (uint8_t)(acc >> bits);
+            }
+        }
+
+        return out == destSize;
+    }
+
+    // <PluginParams>: упакованный (encoding) или по <Param> на значение (version 1)
+    void readParamsElement(const juce::XmlElement& paramsEl, std::vector<float>& dest)
+    {
+        if (paramsEl.getStringAttribute("encoding") == BankLibraryIO::floatArrayEncoding)
+        {
+            const auto text = paramsEl.getAllSubText();
+            BankLibraryIO::decodeFloatArray(text.toRawUTF8(), text.getNumBytesAsUTF8(),
+                                            (size_t)paramsEl.getStringAttribute("count").getLargeIntValue(), dest);
+            return;
+        }
+
+        forEachXmlChildElementWithTagName(paramsEl, pe, "Param")
+            dest.push_back((float)pe->getDoubleAttribute("value", 0.0));
+    }
+
+    juce::XmlElement* makeParamsElement(const std::vector<float>& values, const char* tag = "PluginParams")
+    {
+        auto* paramsEl = new juce::XmlElement(tag);
+        paramsEl->setAttribute("encoding", BankLibraryIO::floatArrayEncoding);
+        paramsEl->setAttribute("count", (int)values.size());
+        paramsEl->addTextElement(BankLibraryIO::encodeFloatArray(values));
+        return paramsEl;
+    }
+
+    // Вектор по умолчанию для банков старой раскладки: по каждому параметру —
+    // значение, которое чаще всего встречается у этих банков (их diff'ы уже влиты)
+    std::vector<float> mostCommonValues(const std::vector<BankLibrary::Bank*>& group)
+    {
+        size_t n = 0;
+        for (const auto* b : group)
+            n = std::max(n, b->pluginParamValues.size());
+
+        std::vector<float> result(n, 0.0f), column;
+        for (size_t i = 0; i < n; ++i)
+        {
+            column.clear();
+            for (const auto* b : group)
+                if (i < b->pluginParamValues.size() && std::isfinite(b->pluginParamValues[i]))
+                    column.push_back(b->pluginParamValues[i]);
+
+            std::sort(column.begin(), column.end());
+
+            size_t bestRun = 0;
+            for (size_t j = 0; j < column.size();)
+            {
+                size_t k = j;
+                while (k < column.size() && column[k] == column[j])
+                    ++k;
+                if (k - j > bestRun)
+                {
+                    bestRun = k - j;
+                    result[i] = column[j];
+                }
+                j = k;
+            }
+        }
+
+        return result;
+    }
+
+    // Индексы записей, сгруппированные по слоту банка (порядок внутри слота сохраняется)
+    template <typename Entry, typename GetIndex>
+    std::vector<std::vector<Entry>> groupByBank(const std::vector<Entry>& entries, int numBanks, GetIndex getIndex)
+    {
+        std::vector<std::vector<Entry>> groups((size_t)numBanks);
+        for (const auto& e : entries)
+        {
+            const int idx = getIndex(e);
+            if (idx >= 0 && idx < numBanks)
+                groups[(size_t)idx].push_back(e);
+        }
+        return groups;
+    }
+
+    // Библиотека заданных размеров из пустых банков (перед чтением секций)
+    void resetBanks(BankLibrary& lib, int numBanks, int numPresets)
+    {
+        lib.banks.clear();
+        lib.setCapacity(numBanks, numPresets);
+    }
+
+    //==========================================================================
+    // Запись бинарного формата (little-endian)
+    //==========================================================================
+    void padTo(juce::MemoryOutputStream& mo, int alignment)
+    {
+        while (mo.getPosition() % alignment != 0)
+            mo.writeByte(0);
+    }
+
+    void writeString(juce::MemoryOutputStream& mo, const juce::String& s)
+    {
+        const auto numBytes = s.getNumBytesAsUTF8();
+        mo.writeInt((int)numBytes);
+        mo.write(s.toRawUTF8(), numBytes);
+    }
+
+    void writeFloatArray(juce::MemoryOutputStream& mo, const std::vector<float>& values)
+    {
+        mo.writeInt((int)values.size());
+        padTo(mo, 4);
+       #if JUCE_LITTLE_ENDIAN
+        mo.write(values.data(), values.size() * sizeof(float));
+       #else
+        for (float v : values)
+            mo.writeFloat(v);
+       #endif
+    }
+
+    // u32 число плагинов, затем { string pluginId; float-массив } по возрастанию pluginId
+    void writeParamDefaults(juce::MemoryOutputStream& mo, const BankModel::ParamDefaults& defaults)
+    {
+        mo.writeInt((int)defaults.size());
+        for (const auto& [id, values] : defaults)
+        {
+            writeString(mo, id);
+            writeFloatArray(mo, values);
+        }
+    }
+
+    // Таблица уникальных state'ов библиотеки: хеш → индекс в порядке первого появления
+    struct StateBlobIndex
+    {
+        std::vector<PluginStateRef> blobs;
+        std::map<juce::String, int> byHash;
+
+        int add(const PluginStateRef& state)
+        {
+            if (state.isEmpty())
+                return -1;
+
+            const auto hash = state.getContentHash();
+            auto it = byHash.find(hash);
+            if (it != byHash.end())
+                return it->second;
+
+            blobs.push_back(state);
+            return byHash[hash] = (int)blobs.size() - 1;
+        }
+    };
+
+    // state, который уже не прочитать (файл-источник подменён в обход программы),
+    // в файл не пишется: вместо него на место данных пользователя легла бы пустышка
+    bool statesReadable(const BankLibrary& lib)
+    {
+        auto check = [](const PluginStateRef& state, const juce::String& name)
+            {
+                if (state.isAvailable())
+                    return true;
+
+                juce::Logger::writeToLog("[BankLibraryIO] " + name + " state is unavailable, library is not written");
+                return false;
+            };
+
+        bool ok = check(lib.pluginState, "global");
+        for (size_t i = 0; i < lib.banks.size(); ++i)
+            ok = check(lib.banks[i].pluginState, "bank " + juce::String((int)i + 1)) && ok;
+        return ok;
+    }
+
+    void writeBankSection(juce::MemoryOutputStream& mo, const BankLibrary::Bank& b,
+                          const std::map<juce::String, int>& blobByHash)
+    {
+        writeString(mo, b.bankName);
+        writeString(mo, b.pluginName);
+        writeString(mo, BankLibraryIO::normalizePluginId(b.pluginId));
+        mo.writeInt(b.activeProgram);
+
+        mo.writeInt(b.getNumPresets());
+        for (const auto& name : b.presetNames)
+            writeString(mo, name);
+
+        mo.writeInt(numCCParams);
+        for (int cc = 0; cc < numCCParams; ++cc)
+        {
+            mo.writeInt(b.globalCCMappings[cc].paramIndex);
+            writeString(mo, b.globalCCMappings[cc].name);
+        }
+
+        // Строки тронутых пресетов: u32 число, затем { u32 пресет; [ccValue, flags] на каждый CC };
+        // flags: bit0 enabled, bit1 invert
+        int numRows = 0;
+        for (int p = 0; p < b.getNumPresets(); ++p)
+            numRows += b.hasPresetRow(p) ? 1 : 0;
+
+        mo.writeInt(numRows);
+        for (int p = 0; p < b.getNumPresets(); ++p)
+        {
+            if (!b.hasPresetRow(p))
+                continue;
+
+            mo.writeInt(p);
+            for (const auto& m : b.presetCCMappings[(size_t)p])
+            {
+                mo.writeByte((char)m.ccValue);
+                mo.writeByte((char)((m.enabled ? 1 : 0) | (m.invert ? 2 : 0)));
+            }
+        }
+
+        writeFloatArray(mo, b.pluginParamValues);
+
+        // Diff'ы — отсортированы по индексу, чтобы файл был детерминированным
+        std::vector<std::pair<int, float>> diffs(b.paramDiffs.begin(), b.paramDiffs.end());
+        std::sort(diffs.begin(), diffs.end());
+        mo.writeInt((int)diffs.size());
+        for (const auto& [idx, val] : diffs)
+        {
+            mo.writeInt(idx);
+            mo.writeFloat(val);
+        }
+
+        int blob = -1;
+        if (!b.pluginState.isEmpty())
+        {
+            auto it = blobByHash.find(b.pluginState.getContentHash());
+            if (it != blobByHash.end())
+                blob = it->second;
+        }
+        mo.writeInt(blob);
+    }
+
+    //==========================================================================
+    // Чтение бинарного формата прямо из отображённой памяти
+    //==========================================================================
+    class BinaryCursor
+    {
+    public:
+        BinaryCursor(const char* d, size_t n) noexcept : data(d), size(n) {}
+
+        bool ok() const noexcept { return !failed; }
+        size_t position() const noexcept { return pos; }
+        const char* base() const noexcept { return data; }
+        size_t length() const noexcept { return size; }
+
+        void seek(juce::uint64 newPos) noexcept
+        {
+            if (newPos > size) failed = true;
+            else pos = (size_t)newPos;
+        }
+
+        void align(size_t alignment) noexcept
+        {
+            seek((pos + alignment - 1) / alignment * alignment);
+        }
+
+        const char* take(juce::uint64 numBytes) noexcept
+        {
+            if (failed || numBytes > size - pos) { failed = true; return nullptr; }
+            auto* p = data + pos;
+            pos += (size_t)numBytes;
+            return p;
+        }
+
+        uint32_t u32() noexcept
+        {
+            auto* p = take(4);
+            return p != nullptr ? juce::ByteOrder::littleEndianInt(p) : 0;
+        }
+
+        int32_t i32() noexcept { return (int32_t)u32(); }
+
+        juce::uint64 u64() noexcept
+        {
+            auto* p = take(8);
+            return p != nullptr ? juce::ByteOrder::littleEndianInt64(p) : 0;
+        }
+
+        uint8_t u8() noexcept
+        {
+            auto* p = take(1);
+            return p != nullptr ? (uint8_t)*p : 0;
+        }
+
+        float f32() noexcept
+        {
+            const uint32_t bits = u32();
+            float v;
+            std::memcpy(&v, &bits, sizeof(v));
+            return v;
+        }
+
+        juce::String string() noexcept
+        {
+            const uint32_t len = u32();
+            auto* p = take(len);
+            return p != nullptr ? juce::String::fromUTF8(p, (int)len) : juce::String();
+        }
+
+        void floatArray(std::vector<float>& dest) noexcept
+        {
+            const uint32_t count = u32();
+            align(4);
+            auto* p = take((juce::uint64)count * sizeof(float));
+            if (p == nullptr) { dest.clear(); return; }
+
+            dest.resize(count);
+           #if JUCE_LITTLE_ENDIAN
+            std::memcpy(dest.data(), p, (size_t)count * sizeof(float));
+           #else
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                const uint32_t bits = juce::ByteOrder::littleEndianInt(p + i * 4);
+                std::memcpy(&dest[i], &bits, sizeof(float));
+            }
+           #endif
+        }
+
+    private:
+        const char* data;
+        size_t size;
+        size_t pos = 0;
+        bool failed = false;
+    };
+
+    bool readBankSection(BinaryCursor& in, BankLibrary::Bank& b, const std::vector<PluginStateRef>& blobs)
+    {
+        b.bankName = in.string();
+        b.pluginName = in.string();
+        b.pluginId = BankLibraryIO::normalizePluginId(in.string());
+        b.activeProgram = in.i32();
+
+        const int storedPresets = (int)in.u32();
+        for (int p = 0; p < storedPresets && in.ok(); ++p)
+        {
+            auto name = in.string();
+            if (p < b.getNumPresets())
+                b.presetNames[(size_t)p] = name;
+        }
+
+        const int storedCC = (int)in.u32();
+        for (int cc = 0; cc < storedCC && in.ok(); ++cc)
+        {
+            const int paramIndex = in.i32();
+            auto name = in.string();
+            if (cc < numCCParams)
+            {
+                b.globalCCMappings[cc].paramIndex = paramIndex;
+                b.globalCCMappings[cc].name = name;
+            }
+        }
+
+        // матрица — только тронутые строки
+        const uint32_t storedRows = in.u32();
+        for (uint32_t r = 0; r < storedRows && in.ok(); ++r)
+        {
+            const int p = (int)in.u32();
+
+            PresetCCRow row;
+            for (int cc = 0; cc < storedCC && in.ok(); ++cc)
+            {
+                const uint8_t value = in.u8();
+                const uint8_t flags = in.u8();
+                if (cc < numCCParams)
+                {
+                    auto& m = row[(size_t)cc];
+                    m.ccValue = value;
+                    m.enabled = (flags & 1) != 0;
+                    m.invert = (flags & 2) != 0;
+                }
+            }
+
+            if (juce::isPositiveAndBelow(p, b.getNumPresets()))
+                b.presetCCMappings[(size_t)p] = row;
+        }
+
+        in.floatArray(b.pluginParamValues);
+
+        b.paramDiffs.clear();
+        const uint32_t numDiffs = in.u32();
+        for (uint32_t i = 0; i < numDiffs && in.ok(); ++i)
+        {
+            const int idx = in.i32();
+            const float val = in.f32();
+            if (idx >= 0)
+                b.paramDiffs[idx] = val;
+        }
+
+        const int blob = in.i32();
+        if (blob >= 0 && blob < (int)blobs.size()) b.pluginState = blobs[(size_t)blob];
+        else                                       b.pluginState.reset();
+
+        return in.ok();
+    }
+
+    //==========================================================================
+    // .nxb: индекс журнала, раскладка с дозаписью
+    //==========================================================================
+    constexpr juce::int64 kCompactionRatio = 2;          // на диске в N раз больше живых данных → сжатие
+    constexpr juce::int64 kCompactionMinBytes = 1 << 20; // файлы меньше этого не сжимаем
+
+    struct BlobEntry
+    {
+        juce::String hash;
+        uint32_t codec = 0;
+        juce::int64 offset = 0, size = 0, rawSize = 0;
+    };
+
+    struct SectionEntry
+    {
+        juce::int64 offset = 0, size = 0;
+        juce::MemoryBlock sha; // SHA-256 байтов секции — по нему видно, изменилась ли она
+    };
+
+    struct BinaryIndex
+    {
+        int numBanks = BankModel::defaultNumBanks, numPresets = BankModel::defaultNumPresets;
+        int activeBankIndex = 0, activePreset = 0;
+        juce::int64 liveBytes = 0;
+        SectionEntry global;
+        std::vector<BlobEntry> blobs;
+        std::vector<std::pair<int, SectionEntry>> banks;
+    };
+
+    bool readBlobEntry(BinaryCursor& in, BlobEntry& e)
+    {
+        e.hash = in.string();
+        e.codec = in.u32();
+        in.align(8);
+        e.offset = (juce::int64)in.u64();
+        e.size = (juce::int64)in.u64();
+        e.rawSize = (juce::int64)in.u64();
+        return in.ok() && e.codec <= (uint32_t)PluginStateRef::Codec::zlib;
+    }
+
+    void writeBlobEntry(juce::MemoryOutputStream& mo, const BlobEntry& e)
+    {
+        writeString(mo, e.hash);
+        mo.writeInt((int)e.codec);
+        padTo(mo, 8);
+        mo.writeInt64(e.offset);
+        mo.writeInt64(e.size);
+        mo.writeInt64(e.rawSize);
+    }
+
+    bool readSectionEntry(BinaryCursor& in, SectionEntry& s)
+    {
+        s.offset = (juce::int64)in.u64();
+        s.size = (juce::int64)in.u64();
+        if (auto* p = in.take(32))
+            s.sha.replaceAll(p, 32);
+        return in.ok();
+    }
+
+    void writeSectionEntry(juce::MemoryOutputStream& mo, const SectionEntry& s)
+    {
+        mo.writeInt64(s.offset);
+        mo.writeInt64(s.size);
+
+        char sha[32] = {};
+        if (s.sha.getSize() == sizeof(sha))
+            std::memcpy(sha, s.sha.getData(), sizeof(sha));
+        mo.write(sha, sizeof(sha));
+    }
+
+    void writeIndex(juce::MemoryOutputStream& mo, const BinaryIndex& idx)
+    {
+        mo.writeInt((int)idx.banks.size());
+        mo.writeInt(idx.activeBankIndex);
+        mo.writeInt(idx.activePreset);
+        mo.writeInt(idx.numPresets);
+        mo.writeInt64(idx.liveBytes);
+        mo.writeInt(idx.numBanks);
+        mo.writeInt(0);
+        writeSectionEntry(mo, idx.global);
+
+        mo.writeInt((int)idx.blobs.size());
+        for (const auto& e : idx.blobs)
+            writeBlobEntry(mo, e);
+
+        for (const auto& [index, s] : idx.banks)
+        {
+            writeSectionEntry(mo, s);
+            mo.writeInt(index);
+            mo.writeInt(0);
+        }
+    }
+
+    bool readIndex(BinaryCursor& in, BinaryIndex& idx)
+    {
+        const uint32_t bankCount = in.u32();
+        idx.activeBankIndex = in.i32();
+        idx.activePreset = in.i32();
+        idx.numPresets = in.i32();
+        idx.liveBytes = (juce::int64)in.u64();
+        idx.numBanks = in.i32();
+        in.u32();
+
+        if (!readSectionEntry(in, idx.global))
+            return false;
+
+        const uint32_t blobCount = in.u32();
+        for (uint32_t i = 0; i < blobCount && in.ok(); ++i)
+        {
+            BlobEntry e;
+            if (!readBlobEntry(in, e))
+                return false;
+            idx.blobs.push_back(std::move(e));
+        }
+
+        for (uint32_t i = 0; i < bankCount && in.ok(); ++i)
+        {
+            SectionEntry s;
+            if (!readSectionEntry(in, s))
+                return false;
+            const int index = in.i32();
+            in.u32();
+            idx.banks.emplace_back(index, std::move(s));
+        }
+
+        return in.ok();
+    }
+
+    /** Заголовок и индекс существующего файла — без чтения остального. */
+    bool readIndexFromFile(const juce::File& file, juce::int64 fileSize, BinaryIndex& idx)
+    {
+        // хвост после сбоя может быть невыровнен — такой файл проще переписать
+        if (fileSize < (juce::int64)kHeaderSize || fileSize % 8 != 0)
+            return false;
+
+        juce::FileInputStream in(file);
+        if (!in.openedOk())
+            return false;
+
+        char header[kHeaderSize];
+        if (in.read(header, (int)kHeaderSize) != (int)kHeaderSize
+            || std::memcmp(header, kBinaryMagic, 4) != 0
+            || juce::ByteOrder::littleEndianInt(header + 4) != BankLibraryIO::binaryVersion)
+            return false;
+
+        const auto indexOffset = (juce::int64)juce::ByteOrder::littleEndianInt64(header + 32);
+        const auto indexSize = (juce::int64)juce::ByteOrder::littleEndianInt64(header + 40);
+        if (indexOffset < (juce::int64)kHeaderSize || indexSize <= 0 || indexOffset > fileSize - indexSize)
+            return false;
+
+        juce::MemoryBlock block((size_t)indexSize);
+        if (!in.setPosition(indexOffset) || in.read(block.getData(), (int)indexSize) != (int)indexSize)
+            return false;
+
+        BinaryCursor cursor(static_cast<const char*>(block.getData()), block.getSize());
+        return readIndex(cursor, idx);
+    }
+
+    bool makeBlobRef(const BlobEntry& e, const BinaryCursor& file,
+                     const std::shared_ptr<PluginStateRef::FileSource>& source, std::vector<PluginStateRef>& blobs)
+    {
+        if (e.offset < 0 || e.size < 0 || (juce::uint64)e.offset > file.length()
+            || (juce::uint64)e.size > file.length() - (juce::uint64)e.offset)
+            return false;
+
+        const auto codec = (PluginStateRef::Codec)e.codec;
+
+        if (source != nullptr)
+        {
+            blobs.push_back(PluginStateRef::fromFileRange(source, e.offset, (size_t)e.size, e.hash, codec, (size_t)e.rawSize));
+            return true;
+        }
+
+        juce::MemoryBlock raw;
+        if (!PluginStateRef::decompress(file.base() + e.offset, (size_t)e.size, codec, (size_t)e.rawSize, raw))
+            return false;
+
+        blobs.push_back(PluginStateRef(std::move(raw)));
+        return true;
+    }
+
+    // Раскладывает lib в поток mo, первый байт которого окажется в файле по
+    // смещению base (кратно 8). Блобы и секции, которые уже есть в prev с тем же
+    // SHA-256, повторно не пишутся — новый индекс ссылается на старые байты.
+    // statesOk = false — какой-то state не прочитался; такую раскладку писать нельзя.
+    BinaryIndex layoutBinary(const BankLibrary& lib, const BinaryIndex& prev, juce::int64 base,
+                             juce::MemoryOutputStream& mo, juce::int64& indexOffset, juce::int64& indexSize,
+                             bool& statesOk)
+    {
+        auto position = [&] { return base + (juce::int64)mo.getPosition(); };
+
+        BinaryIndex idx;
+        idx.numBanks = (int)lib.banks.size();
+        idx.numPresets = lib.numPresets;
+        idx.activeBankIndex = lib.activeBankIndex;
+        idx.activePreset = lib.activePreset;
+        idx.blobs = prev.blobs; // таблица только растёт
+
+        // --- Блобы: дописываются только новые ---
+        std::map<juce::String, int> blobByHash;
+        for (int i = 0; i < (int)idx.blobs.size(); ++i)
+            blobByHash.emplace(idx.blobs[(size_t)i].hash, i);
+
+        std::set<int> liveBlobs;
+        auto addBlob = [&](const PluginStateRef& state)
+            {
+                if (state.isEmpty())
+                    return -1;
+
+                const auto hash = state.getContentHash();
+                auto it = blobByHash.find(hash);
+                const int i = it != blobByHash.end() ? it->second : (int)idx.blobs.size();
+
+                if (it == blobByHash.end())
+                {
+                    auto codec = BankLibraryIO::getStateCodec();
+                    const auto data = state.encodeForStorage(codec);
+                    if (data.isEmpty())
+                    {
+                        statesOk = false;
+                        return -1;
+                    }
+
+                    padTo(mo, 8);
+                    BlobEntry e;
+                    e.hash = hash;
+                    e.codec = (uint32_t)codec;
+                    e.offset = position();
+                    e.size = (juce::int64)data.getSize();
+                    e.rawSize = (juce::int64)state.getSize();
+                    mo.write(data.getData(), data.getSize());
+
+                    idx.blobs.push_back(std::move(e));
+                    blobByHash.emplace(hash, i);
+                }
+
+                liveBlobs.insert(i);
+                return i;
+            };
+
+        const int globalBlob = addBlob(lib.pluginState);
+        for (const auto& b : lib.banks)
+            addBlob(b.pluginState);
+
+        // --- Секции: пишутся, только если их байты изменились ---
+        auto placeSection = [&](const juce::MemoryOutputStream& section, const SectionEntry* old)
+            {
+                SectionEntry s;
+                s.sha = juce::SHA256(section.getData(), section.getDataSize()).getRawData();
+
+                if (old != nullptr && old->size == (juce::int64)section.getDataSize() && old->sha == s.sha)
+                {
+                    s.offset = old->offset;
+                    s.size = old->size;
+                    return s;
+                }
+
+                padTo(mo, 8);
+                s.offset = position();
+                s.size = (juce::int64)section.getDataSize();
+                mo.write(section.getData(), section.getDataSize());
+                return s;
+            };
+
+        {
+            juce::MemoryOutputStream g;
+            writeString(g, lib.pluginName);
+            writeString(g, BankLibraryIO::normalizePluginId(lib.pluginId));
+            g.writeInt(lib.activeProgram);
+            writeFloatArray(g, lib.pluginParamValues);
+            g.writeInt(globalBlob);
+            writeParamDefaults(g, lib.pluginDefaults);
+            idx.global = placeSection(g, prev.global.size > 0 ? &prev.global : nullptr);
+        }
+
+        // пустой банк в индекс не попадает — читатель создаст его сам
+        std::map<int, const SectionEntry*> oldSections;
+        for (const auto& [index, s] : prev.banks)
+            oldSections[index] = &s;
+
+        for (int i = 0; i < (int)lib.banks.size(); ++i)
+        {
+            if (lib.banks[(size_t)i].isEmpty())
+                continue;
+
+            juce::MemoryOutputStream section;
+            writeBankSection(section, lib.banks[(size_t)i], blobByHash);
+
+            auto old = oldSections.find(i);
+            idx.banks.emplace_back(i, placeSection(section, old != oldSections.end() ? old->second : nullptr));
+        }
+
+        // --- Живой объём: всё, на что ссылается новый индекс ---
+        idx.liveBytes = (juce::int64)kHeaderSize + idx.global.size;
+        for (const auto& bank : idx.banks)
+            idx.liveBytes += bank.second.size;
+        for (int i : liveBlobs)
+            idx.liveBytes += idx.blobs[(size_t)i].size;
+
+        padTo(mo, 8);
+        indexOffset = position();
+        writeIndex(mo, idx);
+        indexSize = position() - indexOffset;
+        padTo(mo, 8); // следующая дозапись начнётся с выровненного смещения
+
+        return idx;
+    }
+
+    bool readBinaryLog(const BinaryCursor& file, juce::uint64 indexOffset, juce::uint64 indexSize,
+                       BankLibrary& out, const BankLibraryIO::AbortCheck& shouldAbort,
+                       const std::shared_ptr<PluginStateRef::FileSource>& source,
+                       BankLibraryIO::BankReadOrder* order)
+    {
+        BinaryCursor in(file);
+        in.seek(indexOffset);
+
+        BinaryIndex idx;
+        if (!readIndex(in, idx) || in.position() > indexOffset + indexSize)
+            return false;
+
+        out.activeBankIndex = idx.activeBankIndex;
+        out.activePreset = idx.activePreset;
+
+        std::vector<PluginStateRef> blobs;
+        for (const auto& e : idx.blobs)
+            if (!makeBlobRef(e, file, source, blobs))
+                return false;
+
+        BinaryCursor g(file);
+        g.seek((juce::uint64)idx.global.offset);
+        out.pluginName = g.string();
+        out.pluginId = BankLibraryIO::normalizePluginId(g.string());
+        out.activeProgram = g.i32();
+        g.floatArray(out.pluginParamValues);
+        const int globalBlob = g.i32();
+
+        // умолчания нужны банкам заготовки — читаются до них
+        out.pluginDefaults.clear();
+        const uint32_t numDefaults = g.u32();
+        for (uint32_t i = 0; i < numDefaults && g.ok(); ++i)
+        {
+            const auto id = BankLibraryIO::normalizePluginId(g.string());
+            g.floatArray(out.pluginDefaults[id]);
+        }
+
+        if (!g.ok())
+            return false;
+
+        if (globalBlob >= 0 && globalBlob < (int)blobs.size()) out.pluginState = blobs[(size_t)globalBlob];
+        else                                                   out.pluginState.reset();
+
+        resetBanks(out, idx.numBanks, idx.numPresets);
+        const int numBanks = (int)out.banks.size();
+
+        const auto groups = groupByBank(idx.banks, numBanks, [](const std::pair<int, SectionEntry>& e) { return e.first; });
+        std::vector<char> sectionOk((size_t)numBanks, 1);
+        BankLibraryIO::parallelFor(order != nullptr ? order->start(out) : numBanks, [&](int task)
+            {
+                const int index = order != nullptr ? order->take() : task;
+                if (index < 0)
+                    return;
+
+                for (const auto& entry : groups[(size_t)index])
+                {
+                    if (shouldAbort && shouldAbort())
+                    {
+                        sectionOk[(size_t)index] = 0;
+                        return;
+                    }
+
+                    BinaryCursor section(file);
+                    section.seek((juce::uint64)entry.second.offset);
+                    if (!readBankSection(section, out.banks[(size_t)index], blobs))
+                    {
+                        DBG("[BankLibraryIO] corrupt bank section " << index);
+                        sectionOk[(size_t)index] = 0;
+                        return;
+                    }
+                }
+
+                if (order != nullptr)
+                    order->finished(index, out.banks[(size_t)index]);
+            });
+
+        if (std::find(sectionOk.begin(), sectionOk.end(), 0) != sectionOk.end())
+            return false;
+
+        if (order == nullptr) // отданные банки читают другие потоки — приводит вызывающий
+            BankLibraryIO::compactParamValues(out);
+        return true;
+    }
+}
+
+//==============================================================================
+void BankLibrary::setCapacity(int numBanks, int newNumPresets)
+{
+    numBanks = juce::jlimit(1, BankModel::maxBanks, numBanks);
+    numPresets = juce::jlimit(1, BankModel::maxPresets, newNumPresets);
+
+    banks.resize((size_t)numBanks, Bank(numPresets));
+    for (auto& b : banks)
+        b.setNumPresets(numPresets);
+
+    activeBankIndex = juce::jlimit(0, numBanks - 1, activeBankIndex);
+    activePreset = juce::jlimit(0, numPresets - 1, activePreset);
+}
+
+//==============================================================================
+namespace BankLibraryIO
+{
+    juce::String normalizePluginId(const juce::String& rawId)
+    {
+        juce::File f(rawId);
+
+        if (f.getFileExtension() == ".so")
+        {
+            auto archDir = f.getParentDirectory();        // x86_64-linux
+            auto contents = archDir.getParentDirectory();  // Contents
+            auto vst3dir = contents.getParentDirectory(); // *.vst3
+
+            if (vst3dir.hasFileExtension("vst3"))
+                return vst3dir.getFullPathName();
+        }
+
+        return rawId;
+    }
+
+    void setStateCodec(PluginStateRef::Codec codec)
+    {
+        stateCodec = (int)codec;
+    }
+
+    void setDecodeThreads(int numThreads)
+    {
+        decodeThreads = juce::jmax(0, numThreads);
+    }
+
+    int getDecodeThreads()
+    {
+        return decodeThreads.load();
+    }
+
+    void parallelFor(int count, const std::function<void(int)>& task)
+    {
+        const int configured = getDecodeThreads();
+        const int workers = juce::jmin(count, configured > 0 ? configured : juce::SystemStats::getNumCpus());
+        if (workers <= 1)
+        {
+            for (int i = 0; i < count; ++i)
+                task(i);
+            return;
+        }
+
+        // задачи разбирают по счётчику; поздно стартовавшее задание пула
+        // застанет счётчик исчерпанным и к task не обратится
+        struct State
+        {
+            std::function<void(int)> task;
+            int count = 0;
+            std::atomic<int> next{ 0 }, finished{ 0 };
+            juce::WaitableEvent done;
+        };
+
+        auto state = std::make_shared<State>();
+        state->task = task;
+        state->count = count;
+
+        auto work = [state]
+            {
+                for (int i; (i = state->next.fetch_add(1)) < state->count;)
+                {
+                    state->task(i);
+                    if (state->finished.fetch_add(1) + 1 == state->count)
+                        state->done.signal();
+                }
+            };
+
+        for (int w = 1; w < workers; ++w)
+            decodePool().addJob([work] { work(); return juce::ThreadPoolJob::jobHasFinished; });
+
+        work();
+        state->done.wait(-1);
+    }
+
+    void BankReadOrder::bump(int bankIndex)
+    {
+        const juce::ScopedLock sl(lock);
+        bumped.push_back(bankIndex);
+    }
+
+    int BankReadOrder::start(const BankLibrary& header)
+    {
+        const juce::ScopedLock sl(lock);
+        taken.assign(header.banks.size(), 0);
+        activeBank = header.activeBankIndex;
+        cursor = 0;
+        return (int)header.banks.size();
+    }
+
+    int BankReadOrder::take()
+    {
+        const juce::ScopedLock sl(lock);
+
+        auto claim = [this](int bank)
+            {
+                if (!juce::isPositiveAndBelow(bank, (int)taken.size()) || taken[(size_t)bank] != 0)
+                    return false;
+                taken[(size_t)bank] = 1;
+                return true;
+            };
+
+        while (!bumped.empty())
+        {
+            const int bank = bumped.back();
+            bumped.pop_back();
+            if (claim(bank))
+                return bank;
+        }
+
+        if (claim(activeBank))
+            return activeBank;
+
+        for (; cursor < (int)taken.size(); ++cursor)
+            if (claim(cursor))
+                return cursor;
+
+        return -1;
+    }
+
+    PluginStateRef::Codec getStateCodec()
+    {
+        return (PluginStateRef::Codec)stateCodec.load();
+    }
+
+    bool isBinaryLibrary(const juce::File& file)
+    {
+        juce::FileInputStream in(file);
+        if (!in.openedOk())
+            return false;
+
+        char magic[4] = {};
+        return in.read(magic, 4) == 4 && std::memcmp(magic, kBinaryMagic, 4) == 0;
+    }
+
+    bool wantsBinaryFormat(const juce::File& file)
+    {
+        return file.hasFileExtension(binaryExtension);
+    }
+
+    bool read(const juce::File& file, BankLibrary& out, const AbortCheck& shouldAbort, BankReadOrder* order)
+    {
+        if (!file.existsAsFile())
+            return false;
+
+        return isBinaryLibrary(file) ? readBinary(file, out, shouldAbort, order)
+                                     : readXml(file, out, shouldAbort, order);
+    }
+
+    bool write(const juce::File& file, const BankLibrary& lib)
+    {
+        if (!statesReadable(lib))
+            return false;
+
+        if (!wantsBinaryFormat(file))
+            return writeXml(file, lib);
+
+        // .nxb: сначала пробуем дописать только изменившееся, иначе — полная запись
+        return appendBinary(file, lib) || writeBinary(file, lib);
+    }
+
+    bool writeTo(juce::OutputStream& out, const BankLibrary& lib, bool binary)
+    {
+        if (binary)
+            return writeBinary(out, lib);
+
+        auto xml = toXml(lib);
+        if (xml == nullptr)
+            return false;
+
+        xml->writeTo(out);
+        return true;
+    }
+
+    bool replaceFileAtomically(const juce::File& target, const void* data, size_t size)
+    {
+        target.getParentDirectory().createDirectory();
+
+        // state'ы, ещё не прочитанные из старой версии файла, забираем в память;
+        // не вышло — файл не трогаем, иначе они пропадут
+        if (!PluginStateRef::detachFileSources(target))
+            return false;
+
+        juce::TemporaryFile temp(target, juce::TemporaryFile::useHiddenFile);
+        {
+            juce::FileOutputStream out(temp.getFile());
+            if (!out.openedOk())
+                return false;
+
+            out.write(data, size);
+            out.flush(); // flushInternal → fsync / FlushFileBuffers
+
+            if (out.getStatus().failed())
+                return false;
+        }
+
+        // rename поверх старого файла: при сбое остаётся либо старая, либо новая версия
+        if (!temp.overwriteTargetFileWithTemporary())
+            return false;
+
+       #if JUCE_LINUX || JUCE_MAC
+        // сам rename переживает сбой питания только после fsync каталога
+        const int dirFd = ::open(target.getParentDirectory().getFullPathName().toRawUTF8(), O_RDONLY);
+        if (dirFd >= 0)
+        {
+            ::fsync(dirFd);
+            ::close(dirFd);
+        }
+       #endif
+
+        return true;
+    }
+
+    //==========================================================================
+    bool readXml(const juce::File& file, BankLibrary& out, const AbortCheck& shouldAbort, BankReadOrder* order)
+    {
+        if (BankXmlStreamReader::read(file, out, shouldAbort, order))
+            return true;
+
+        if (shouldAbort && shouldAbort())
+            return false;
+
+        // отданные в BankReady банки читаются из out другими потоками — DOM-разбор
+        // перезаписал бы их; без order (или до первого банка) откат безопасен
+        if (order != nullptr && order->hasDelivered())
+            return false;
+
+        DBG("[BankLibraryIO] stream reader failed, falling back to DOM: " << file.getFullPathName());
+        return readXmlDom(file, out);
+    }
+
+    bool readXmlDom(const juce::File& file, BankLibrary& out)
+    {
+        std::unique_ptr<juce::XmlElement> xml(juce::XmlDocument::parse(file));
+        if (!xml)
+            return false;
+
+        return fromXml(*xml, out);
+    }
+
+    bool writeXml(const juce::File& file, const BankLibrary& lib)
+    {
+        juce::MemoryOutputStream mo;
+        if (!writeTo(mo, lib, false))
+            return false;
+        return replaceFileAtomically(file, mo.getData(), mo.getDataSize());
+    }
+
+    bool isSupportedXmlVersion(int version)
+    {
+        return version == 1 || version == xmlVersion;
+    }
+
+    bool fromXml(const juce::XmlElement& root, BankLibrary& out, BankReadOrder* order)
+    {
+        const int version = root.getIntAttribute("version", 1);
+        if (!isSupportedXmlVersion(version))
+        {
+            DBG("[BankLibraryIO] unsupported XML version " << version);
+            return false;
+        }
+
+        out.activeBankIndex = root.getIntAttribute("activeBankIndex", 0);
+        out.activePreset = root.getIntAttribute("activePreset", 0);
+        resetBanks(out, root.getIntAttribute("banks", BankModel::defaultNumBanks),
+                   root.getIntAttribute("presets", BankModel::defaultNumPresets));
+
+        out.pluginName = root.getStringAttribute("pluginName");
+        out.pluginId = normalizePluginId(root.getStringAttribute("pluginId"));
+        out.activeProgram = root.getIntAttribute("activeProgram", -1);
+
+        out.pluginParamValues.clear();
+        if (auto* paramsEl = root.getChildByName("PluginParams"))
+            readParamsElement(*paramsEl, out.pluginParamValues);
+
+        out.pluginDefaults.clear();
+        if (auto* defaultsEl = root.getChildByName("PluginDefaults"))
+            forEachXmlChildElementWithTagName(*defaultsEl, el, "Defaults")
+                readParamsElement(*el, out.pluginDefaults[normalizePluginId(el->getStringAttribute("pluginId"))]);
+
+        const auto blobs = readStateBlobs(root);
+
+        out.pluginState.reset();
+        if (auto* stateEl = root.getChildByName("PluginState"))
+            out.pluginState = readPluginState(*stateEl, &blobs);
+
+        const int numBanks = (int)out.banks.size();
+
+        std::vector<const juce::XmlElement*> bankEls;
+        forEachXmlChildElementWithTagName(root, bankEl, "Bank")
+            bankEls.push_back(bankEl);
+
+        // каждый слот — своя задача; элементы одного индекса — по порядку
+        const auto groups = groupByBank(bankEls, numBanks, [](const juce::XmlElement* el) { return el->getIntAttribute("index", -1); });
+        parallelFor(order != nullptr ? order->start(out) : numBanks, [&](int task)
+            {
+                const int idx = order != nullptr ? order->take() : task;
+                if (idx < 0)
+                    return;
+
+                for (auto* bankEl : groups[(size_t)idx])
+                    deserializeBank(out.banks[(size_t)idx], *bankEl, &blobs);
+
+                if (order != nullptr)
+                    order->finished(idx, out.banks[(size_t)idx]);
+            });
+
+        if (order == nullptr)
+            compactParamValues(out);
+        return true;
+    }
+
+    std::unique_ptr<juce::XmlElement> toXml(const BankLibrary& lib)
+    {
+        if (!statesReadable(lib))
+            return nullptr;
+
+        auto root = std::make_unique<juce::XmlElement>("BanksConfig");
+        root->setAttribute("version", xmlVersion);
+        root->setAttribute("banks", (int)lib.banks.size());
+        root->setAttribute("presets", lib.numPresets);
+        root->setAttribute("activeBankIndex", lib.activeBankIndex);
+        root->setAttribute("activePreset", lib.activePreset);
+
+        // --- Глобальные данные о плагине ---
+        root->setAttribute("pluginName", lib.pluginName);
+        root->setAttribute("pluginId", normalizePluginId(lib.pluginId));
+        root->setAttribute("activeProgram", lib.activeProgram);
+
+        // Глобальные параметры плагина (раньше в XML не попадали)
+        if (!lib.pluginParamValues.empty())
+            root->addChildElement(makeParamsElement(lib.pluginParamValues));
+
+        // --- Значения по умолчанию по плагинам: банки ниже хранят только отличия ---
+        if (!lib.pluginDefaults.empty())
+        {
+            auto* defaultsEl = new juce::XmlElement("PluginDefaults");
+            for (const auto& [id, values] : lib.pluginDefaults)
+            {
+                auto* el = makeParamsElement(values, "Defaults");
+                el->setAttribute("pluginId", id);
+                defaultsEl->addChildElement(el);
+            }
+            root->addChildElement(defaultsEl);
+        }
+
+        // --- Хранилище state'ов: каждый уникальный state один раз (Base64) ---
+        StateBlobIndex blobs;
+        blobs.add(lib.pluginState);
+        for (const auto& b : lib.banks)
+            blobs.add(b.pluginState);
+
+        if (!blobs.blobs.empty())
+        {
+            auto* blobsEl = root->createNewChildElement("StateBlobs");
+            for (const auto& state : blobs.blobs)
+            {
+                auto codec = getStateCodec();
+                const auto text = state.toBase64Encoding(codec);
+                if (state.isFailed())
+                    return nullptr; // файл-источник подменили между проверкой и чтением
+
+                auto* blobEl = new juce::XmlElement("Blob");
+                blobEl->setAttribute("id", state.getContentHash());
+                if (codec != PluginStateRef::Codec::none)
+                {
+                    blobEl->setAttribute("codec", PluginStateRef::getCodecName(codec));
+                    blobEl->setAttribute("size", juce::String((juce::int64)state.getSize()));
+                }
+                blobEl->addTextElement(text);
+                blobsEl->addChildElement(blobEl);
+            }
+        }
+
+        // --- Полный state плагина — ссылкой на блоб ---
+        if (!lib.pluginState.isEmpty())
+        {
+            auto stateEl = std::make_unique<juce::XmlElement>("PluginState");
+            stateEl->setAttribute("ref", lib.pluginState.getContentHash());
+            root->addChildElement(stateEl.release());
+        }
+
+        // --- Данные банков (пустые читатель создаст сам) ---
+        for (int i = 0; i < (int)lib.banks.size(); ++i)
+            if (!lib.banks[(size_t)i].isEmpty())
+                root->addChildElement(serializeBank(lib.banks[(size_t)i], i, true));
+
+        return root;
+    }
+
+    //==========================================================================
+    // Бинарный формат .nxb (little-endian) — журнал с дозаписью:
+    //
+    //   0  char[4]  "NXBL"
+    //   4  u32      version
+    //   8  u32      numBanks   — на момент полной записи; читатель
+    //  12  u32      numPresets   берёт размеры из индекса
+    //  16  u32      numCCParams
+    //  20  i32      activeBankIndex
+    //  24  i32      activePreset
+    //  28  u32      reserved
+    //  32  u64      смещение индекса
+    //  40  u64      размер индекса
+    //
+    // Строки: u32 длина + UTF-8. Float-массивы: u32 count, выравнивание 4, float32[].
+    //
+    // Всё после заголовка адресуется только через индекс:
+    //   u32 число записей банков; i32 activeBankIndex; i32 activePreset; u32 numPresets;
+    //   u64 liveBytes                — объём данных, на которые ссылается индекс;
+    //   u32 numBanks; u32 reserved;
+    //   секция { u64 offset; u64 size; u8[32] sha256 } — глобальная;
+    //   u32 blobCount, затем { string hash; u32 codec; выравнивание 8;
+    //     u64 offset; u64 size (в файле); u64 исходный размер } — codec: 0 none, 1 zlib;
+    //   { секция; i32 index; u32 reserved } × число записей банков.
+    // Пустые банки (Bank::isEmpty) в индекс не попадают. Таблица блобов только
+    // растёт — индексы в старых секциях остаются верными; каждый блоб — один
+    // уникальный state (по SHA-256), выровнен на 8.
+    //
+    // Глобальная секция: pluginName, pluginId, activeProgram, float-массив,
+    // i32 индекс глобального блоба (-1 — нет state'а), затем векторы параметров
+    // по умолчанию: u32 число плагинов, { string pluginId; float-массив }.
+    // Секция банка: bankName, pluginName, pluginId, activeProgram; u32 число пресетов
+    // и их имена; u32 число CC и { i32 paramIndex; string name }; матрица — только
+    // тронутые пресеты: u32 число строк, { u32 пресет; [ccValue, flags] × numCCParams };
+    // float-массив (пишется, только если банк ещё в полной раскладке); u32 число
+    // diff'ов и { i32 индекс; f32 значение } — отличия от вектора его плагина;
+    // i32 индекс блоба state'а.
+    //
+    // STORE дописывает в конец изменившиеся секции, новые блобы и новый индекс,
+    // затем (после fsync) переключает на него 16 байт заголовка. Сбой до
+    // переключения оставляет файл со старым индексом. Когда мёртвых данных
+    // становится больше живых, файл переписывается целиком (сжатие).
+    //==========================================================================
+    bool writeBinary(juce::OutputStream& out, const BankLibrary& lib)
+    {
+        if (!statesReadable(lib))
+            return false;
+
+        juce::MemoryOutputStream mo;
+
+        mo.write(kBinaryMagic, 4);
+        mo.writeInt((int)binaryVersion);
+        mo.writeInt((int)lib.banks.size());
+        mo.writeInt(lib.numPresets);
+        mo.writeInt(numCCParams);
+        mo.writeInt(lib.activeBankIndex);
+        mo.writeInt(lib.activePreset);
+        mo.writeInt(0);
+        mo.writeInt64(0); // indexOffset — заполняется ниже
+        mo.writeInt64(0); // indexSize
+
+        juce::int64 indexOffset = 0, indexSize = 0;
+        bool statesOk = true;
+        layoutBinary(lib, BinaryIndex{}, 0, mo, indexOffset, indexSize, statesOk);
+        if (!statesOk)
+            return false;
+        const auto endPos = mo.getPosition();
+
+        mo.setPosition(32);
+        mo.writeInt64(indexOffset);
+        mo.writeInt64(indexSize);
+        mo.setPosition(endPos);
+
+        return out.write(mo.getData(), mo.getDataSize());
+    }
+
+    bool writeBinary(const juce::File& file, const BankLibrary& lib)
+    {
+        juce::MemoryOutputStream mo;
+        if (!writeBinary(mo, lib))
+            return false;
+        return replaceFileAtomically(file, mo.getData(), mo.getDataSize());
+    }
+
+    bool appendBinary(const juce::File& file, const BankLibrary& lib)
+    {
+        const auto fileSize = file.getSize();
+
+        BinaryIndex prev;
+        if (!statesReadable(lib) || !readIndexFromFile(file, fileSize, prev))
+            return false;
+
+        // хвост пишется с выравниванием относительно конца файла
+        juce::MemoryOutputStream tail;
+        juce::int64 indexOffset = 0, indexSize = 0;
+        bool statesOk = true;
+        const auto next = layoutBinary(lib, prev, fileSize, tail, indexOffset, indexSize, statesOk);
+        if (!statesOk)
+            return false;
+
+        const auto newSize = fileSize + (juce::int64)tail.getDataSize();
+        if (newSize > kCompactionMinBytes && newSize > next.liveBytes * kCompactionRatio)
+        {
+            DBG("[BankLibraryIO] compacting " << file.getFileName() << ": "
+                << newSize << " bytes on disk, " << next.liveBytes << " live");
+            return false;
+        }
+
+        return PluginStateRef::appendToFile(file, [&]
+            {
+                juce::FileOutputStream out(file); // открывается в конце файла
+                if (!out.openedOk() || out.getPosition() != fileSize)
+                    return false;
+
+                out.write(tail.getData(), tail.getDataSize());
+                out.flush(); // fsync: данные на диске раньше, чем на них укажет заголовок
+                if (out.getStatus().failed())
+                    return false;
+
+                // коммит — 16 байт в первом секторе файла
+                if (!out.setPosition(32))
+                    return false;
+                out.writeInt64(indexOffset);
+                out.writeInt64(indexSize);
+                out.flush();
+                return !out.getStatus().failed();
+            });
+    }
+
+    bool readBinary(const void* data, size_t size, BankLibrary& out, const AbortCheck& shouldAbort,
+                    const std::shared_ptr<PluginStateRef::FileSource>& stateSource, BankReadOrder* order)
+    {
+        if (data == nullptr || size < kHeaderSize)
+            return false;
+
+        BinaryCursor in(static_cast<const char*>(data), size);
+
+        auto* magic = in.take(4);
+        if (magic == nullptr || std::memcmp(magic, kBinaryMagic, 4) != 0)
+            return false;
+
+        const uint32_t version = in.u32();
+        if (version != binaryVersion)
+        {
+            DBG("[BankLibraryIO] unsupported .nxb version " << (int)version);
+            return false;
+        }
+
+        in.u32(); // numBanks   — размеры берутся из индекса
+        in.u32(); // numPresets
+        in.u32(); // numCCParams
+        out.activeBankIndex = in.i32();
+        out.activePreset = in.i32();
+        in.u32();
+        const auto indexOffset = in.u64();
+        const auto indexSize = in.u64();
+
+        if (!in.ok())
+            return false;
+
+        return readBinaryLog(in, indexOffset, indexSize, out, shouldAbort, stateSource, order);
+    }
+
+    bool readBinary(const juce::File& file, BankLibrary& out, const AbortCheck& shouldAbort, BankReadOrder* order)
+    {
+        // источник берётся до отображения: его отметка времени не новее прочитанного
+        auto stateSource = PluginStateRef::openFileSource(file);
+        juce::MemoryMappedFile mapped(file, juce::MemoryMappedFile::readOnly);
+        return readBinary(mapped.getData(), mapped.getSize(), out, shouldAbort, stateSource, order);
+    }
+
+    juce::int64 estimateMemoryBytes(const BankLibrary& lib)
+    {
+        auto stateBytes = [](const PluginStateRef& s) { return s.isDecoded() ? (juce::int64)s.getSize() : 0; };
+
+        juce::int64 total = (juce::int64)sizeof(BankLibrary)
+                          + (juce::int64)(lib.pluginParamValues.size() * sizeof(float))
+                          + stateBytes(lib.pluginState);
+
+        for (const auto& [id, values] : lib.pluginDefaults)
+            total += (juce::int64)(values.size() * sizeof(float)) + 64; // узел map + ключ
+
+        for (const auto& b : lib.banks)
+        {
+            total += (juce::int64)sizeof(b)
+                   + (juce::int64)(b.pluginParamValues.size() * sizeof(float))
+                   + (juce::int64)b.paramDiffs.size() * 32 // узел unordered_map
+                   + stateBytes(b.pluginState);
+        }
+
+        return total;
+    }
+
+    void expandParamValues(Bank& b, const std::vector<float>& defaults)
+    {
+        if (b.pluginParamValues.empty())
+            b.pluginParamValues = defaults;
+
+        // diff'ы в пределах вектора вливаются, за его пределами остаются как есть
+        for (auto it = b.paramDiffs.begin(); it != b.paramDiffs.end();)
+        {
+            if (juce::isPositiveAndBelow(it->first, (int)b.pluginParamValues.size()))
+            {
+                b.pluginParamValues[(size_t)it->first] = it->second;
+                it = b.paramDiffs.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    void compactParamValues(std::vector<Bank>& banks, BankModel::ParamDefaults& defaults)
+    {
+        std::map<juce::String, std::vector<Bank*>> legacy;
+        for (auto& b : banks)
+            if (!b.pluginParamValues.empty())
+                legacy[normalizePluginId(b.pluginId)].push_back(&b);
+
+        for (auto& [id, group] : legacy)
+        {
+            // старые diff'ы значат «поверх полного вектора» — сначала вливаем
+            for (auto* b : group)
+                expandParamValues(*b, {});
+
+            auto& values = defaults[id];
+            if (values.empty())
+                values = mostCommonValues(group);
+
+            for (auto* b : group)
+            {
+                for (size_t i = 0; i < b->pluginParamValues.size(); ++i)
+                {
+                    const float v = b->pluginParamValues[i];
+                    if (i >= values.size() || v != values[i])
+                        b->paramDiffs[(int)i] = v;
+                }
+
+                std::vector<float>().swap(b->pluginParamValues);
+            }
+        }
+    }
+
+    void compactParamValues(BankLibrary& lib)
+    {
+        compactParamValues(lib.banks, lib.pluginDefaults);
+    }
+
+    juce::StringArray validate(const BankLibrary& lib)
+    {
+        juce::StringArray errors;
+
+        auto allFinite = [](const std::vector<float>& values)
+            {
+                return std::all_of(values.begin(), values.end(), [](float v) { return std::isfinite(v); });
+            };
+
+        if (lib.banks.empty() || (int)lib.banks.size() > BankModel::maxBanks)
+            errors.add(juce::String((int)lib.banks.size()) + " banks (allowed 1.." + juce::String(BankModel::maxBanks) + ")");
+
+        if (!allFinite(lib.pluginParamValues))
+            errors.add("global params contain NaN/Inf");
+
+        for (const auto& [id, values] : lib.pluginDefaults)
+            if (!allFinite(values))
+                errors.add("defaults of " + (id.isNotEmpty() ? id : juce::String("<no plugin>")) + " contain NaN/Inf");
+
+        for (size_t i = 0; i < lib.banks.size(); ++i)
+        {
+            const auto& b = lib.banks[i];
+            const auto name = "bank " + juce::String((int)i + 1);
+
+            if (!allFinite(b.pluginParamValues) || !allFinite(b.presetVolumes))
+                errors.add(name + ": params or volumes contain NaN/Inf");
+
+            if (b.getNumPresets() != lib.numPresets)
+                errors.add(name + ": " + juce::String(b.getNumPresets()) + " presets instead of " + juce::String(lib.numPresets));
+
+            for (const auto& [idx, val] : b.paramDiffs)
+            {
+                if (!std::isfinite(val) || (!b.pluginParamValues.empty() && idx >= (int)b.pluginParamValues.size()))
+                {
+                    errors.add(name + ": bad diff for param " + juce::String(idx));
+                    break;
+                }
+            }
+        }
+
+        // state'ы: распаковка и совпадение с хешем, записанным в файле
+        auto checkState = [&errors](const PluginStateRef& s, const juce::String& name)
+            {
+                if (s.isEmpty())
+                    return;
+
+                const auto block = s.copyDecoded();
+                if (block.getSize() != s.getSize())
+                    errors.add(name + ": cannot decode");
+                else if (juce::SHA256(block).toHexString() != s.getContentHash())
+                    errors.add(name + ": SHA-256 mismatch");
+            };
+
+        checkState(lib.pluginState, "global state");
+        for (size_t i = 0; i < lib.banks.size(); ++i)
+            checkState(lib.banks[i].pluginState, "bank " + juce::String((int)i + 1) + " state");
+
+        return errors;
+    }
+
+    bool identical(const BankLibrary& a, const BankLibrary& b)
+    {
+        if (a.numPresets != b.numPresets
+            || a.activeBankIndex != b.activeBankIndex || a.activePreset != b.activePreset
+            || a.pluginName != b.pluginName || a.pluginId != b.pluginId
+            || a.activeProgram != b.activeProgram
+            || a.pluginParamValues != b.pluginParamValues
+            || a.pluginDefaults != b.pluginDefaults
+            || a.pluginState != b.pluginState
+            || a.banks.size() != b.banks.size())
+            return false;
+
+        for (size_t i = 0; i < a.banks.size(); ++i)
+        {
+            const auto& x = a.banks[i];
+            const auto& y = b.banks[i];
+
+            // operator== у Bank намеренно «мягкий» (для мигания Store) — здесь нужна точность
+            if (x.bankName != y.bankName || x.pluginName != y.pluginName || x.pluginId != y.pluginId
+                || x.activeProgram != y.activeProgram
+                || x.pluginParamValues != y.pluginParamValues
+                || x.paramDiffs != y.paramDiffs
+                || x.pluginState != y.pluginState
+                || x.presetVolumes != y.presetVolumes
+                || x.presetNames != y.presetNames)
+                return false;
+
+            for (int cc = 0; cc < numCCParams; ++cc)
+            {
+                const auto& gx = x.globalCCMappings[cc];
+                const auto& gy = y.globalCCMappings[cc];
+                if (gx.paramIndex != gy.paramIndex || gx.name != gy.name || gx.invert != gy.invert)
+                    return false;
+
+                // выделенная строка по умолчанию равна отсутствующей — в файл они пишутся по-разному,
+                // но читаются одинаково
+                for (int p = 0; p < x.getNumPresets(); ++p)
+                    if (x.getPresetCC(p, cc) != y.getPresetCC(p, cc))
+                        return false;
+            }
+        }
+
+        return true;
+    }
+
+    //==========================================================================
+    juce::XmlElement* serializeBank(const Bank& b, int index, bool stateByRef)
+    {
+        auto* bankEl = new juce::XmlElement("Bank");
+        bankEl->setAttribute("index", index);
+        bankEl->setAttribute("bankName", b.bankName);
+        bankEl->setAttribute("pluginName", b.pluginName);
+        bankEl->setAttribute("pluginId", normalizePluginId(b.pluginId));
+        bankEl->setAttribute("activeProgram", b.activeProgram);
+
+        // Preset names
+        {
+            auto* presetsEl = new juce::XmlElement("PresetNames");
+            for (int p = 0; p < b.getNumPresets(); ++p)
+            {
+                auto* pe = new juce::XmlElement("Preset");
+                pe->setAttribute("index", p);
+                pe->setAttribute("name", b.presetNames[(size_t)p]);
+                presetsEl->addChildElement(pe);
+            }
+            bankEl->addChildElement(presetsEl);
+        }
+
+        // CC-матрица: назначения — по одному <Slot> на CC,
+        // состояния пресетов — одной упакованной строкой
+        {
+            juce::String rows;
+            const auto cells = packCCCells(b, rows);
+
+            auto* matrixEl = new juce::XmlElement("CCMatrix");
+            matrixEl->setAttribute("version", 2);
+            matrixEl->setAttribute("presets", b.getNumPresets());
+            matrixEl->setAttribute("ccs", numCCParams);
+            matrixEl->setAttribute("rows", rows);
+            matrixEl->setAttribute("cells", cells);
+
+            for (int cc = 0; cc < numCCParams; ++cc)
+            {
+                const auto& globalMap = b.globalCCMappings[cc];
+
+                auto* slotEl = new juce::XmlElement("Slot");
+                slotEl->setAttribute("number", cc);
+                slotEl->setAttribute("paramIndex", globalMap.paramIndex);
+                slotEl->setAttribute("paramName", globalMap.name);
+                matrixEl->addChildElement(slotEl);
+            }
+            bankEl->addChildElement(matrixEl);
+        }
+
+        // Полный state плагина
+        if (!b.pluginState.isEmpty())
+        {
+            auto* stateEl = new juce::XmlElement("PluginState");
+            if (stateByRef)
+                stateEl->setAttribute("ref", b.pluginState.getContentHash());
+            else
+                stateEl->addTextElement(b.pluginState.toBase64Encoding());
+            bankEl->addChildElement(stateEl);
+        }
+
+        // Полная раскладка (банк, ещё не приведённый к разреженной) — одним base64-блоком float32
+        if (!b.pluginParamValues.empty())
+            bankEl->addChildElement(makeParamsElement(b.pluginParamValues));
+
+        // Отличия от <PluginDefaults> — так же, парами индекс/значение
+        if (!b.paramDiffs.empty())
+        {
+            auto* diffsEl = new juce::XmlElement("ParamDiffs");
+            diffsEl->setAttribute("encoding", paramDiffsEncoding);
+            diffsEl->setAttribute("count", (int)b.paramDiffs.size());
+            diffsEl->addTextElement(encodeParamDiffs(b.paramDiffs));
+            bankEl->addChildElement(diffsEl);
+        }
+
+        return bankEl;
+    }
+
+    juce::String encodeFloatArray(const std::vector<float>& values)
+    {
+        juce::MemoryOutputStream mo(values.size() * sizeof(float));
+        for (float v : values)
+            mo.writeFloat(v); // little-endian, биты как есть
+        return juce::Base64::toBase64(mo.getData(), mo.getDataSize());
+    }
+
+    bool decodeFloatArray(const char* text, size_t length, size_t count, std::vector<float>& dest)
+    {
+        dest.resize(count);
+        if (count > length || !decodeBase64(text, length, reinterpret_cast<uint8_t*>(dest.data()), count * sizeof(float)))
+        {
+            dest.clear();
+            return false;
+        }
+
+       #if ! JUCE_LITTLE_ENDIAN
+        for (auto& v : dest)
+        {
+            uint32_t bits;
+            std::memcpy(&bits, &v, sizeof(bits));
+            bits = juce::ByteOrder::swap(bits);
+            std::memcpy(&v, &bits, sizeof(bits));
+        }
+       #endif
+        return true;
+    }
+
+    juce::String encodeParamDiffs(const std::unordered_map<int, float>& diffs)
+    {
+        std::vector<std::pair<int, float>> sorted(diffs.begin(), diffs.end());
+        std::sort(sorted.begin(), sorted.end());
+
+        juce::MemoryOutputStream mo(sorted.size() * 8);
+        for (const auto& [idx, val] : sorted)
+        {
+            mo.writeInt(idx);
+            mo.writeFloat(val);
+        }
+        return juce::Base64::toBase64(mo.getData(), mo.getDataSize());
+    }
+
+    bool decodeParamDiffs(const char* text, size_t length, size_t count, std::unordered_map<int, float>& dest)
+    {
+        if (count > length)
+            return false;
+
+        juce::HeapBlock<uint8_t> raw(count * 8);
+        if (!decodeBase64(text, length, raw.get(), count * 8))
+            return false;
+
+        dest.reserve(dest.size() + count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            const int idx = (int)juce::ByteOrder::littleEndianInt(raw.get() + i * 8);
+            const uint32_t bits = juce::ByteOrder::littleEndianInt(raw.get() + i * 8 + 4);
+
+            float val;
+            std::memcpy(&val, &bits, sizeof(val));
+            if (idx >= 0)
+                dest[idx] = val;
+        }
+        return true;
+    }
+
+    juce::String packCCCells(const Bank& b, juce::String& rows)
+    {
+        static constexpr char hexDigits[] = "0123456789ABCDEF";
+
+        juce::StringArray rowNumbers;
+        juce::MemoryOutputStream mo((size_t)b.getNumPresets() * numCCParams * 4 + 1);
+        for (int p = 0; p < b.getNumPresets(); ++p)
+        {
+            if (!b.hasPresetRow(p))
+                continue;
+
+            rowNumbers.add(juce::String(p));
+            for (const auto& m : b.presetCCMappings[(size_t)p])
+            {
+                const uint8_t bytes[2] = { (uint8_t)((m.enabled ? 1 : 0) | (m.invert ? 2 : 0)), m.ccValue };
+
+                for (auto v : bytes)
+                {
+                    mo.writeByte(hexDigits[v >> 4]);
+                    mo.writeByte(hexDigits[v & 15]);
+                }
+            }
+        }
+
+        rows = rowNumbers.joinIntoString(" ");
+        return mo.toUTF8();
+    }
+
+    std::vector<int> parseCCRows(const juce::String& rows)
+    {
+        std::vector<int> result;
+        for (const auto& token : juce::StringArray::fromTokens(rows, " ", {}))
+            if (token.isNotEmpty())
+                result.push_back(token.getIntValue());
+        return result;
+    }
+
+    bool unpackCCCells(Bank& b, const char* hex, size_t length, const std::vector<int>& rows, int ccs)
+    {
+        if (ccs < 0 || length < rows.size() * (size_t)ccs * 4)
+            return false;
+
+        auto nibble = [](char c) -> int
+            {
+                if (c >= '0' && c <= '9') return c - '0';
+                if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+                if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+                return -1;
+            };
+
+        for (const int p : rows)
+        {
+            PresetCCRow row;
+            for (int cc = 0; cc < ccs; ++cc, hex += 4)
+            {
+                const int f1 = nibble(hex[0]), f0 = nibble(hex[1]);
+                const int v1 = nibble(hex[2]), v0 = nibble(hex[3]);
+                if ((f1 | f0 | v1 | v0) < 0)
+                    return false;
+
+                if (cc >= numCCParams)
+                    continue; // матрица из сборки с большими размерами
+
+                const int flags = (f1 << 4) | f0;
+                auto& m = row[(size_t)cc];
+                m.enabled = (flags & 1) != 0;
+                m.invert = (flags & 2) != 0;
+                m.ccValue = (uint8_t)((v1 << 4) | v0);
+            }
+
+            if (juce::isPositiveAndBelow(p, b.getNumPresets()))
+                b.presetCCMappings[(size_t)p] = row;
+        }
+
+        return true;
+    }
+
+    StateBlobTable readStateBlobs(const juce::XmlElement& root)
+    {
+        StateBlobTable blobs;
+
+        if (auto* blobsEl = root.getChildByName("StateBlobs"))
+            forEachXmlChildElementWithTagName(*blobsEl, blobEl, "Blob")
+            {
+                const auto id = blobEl->getStringAttribute("id");
+                if (id.isEmpty() || blobs.find(id) != blobs.end())
+                    continue;
+
+                auto codec = PluginStateRef::Codec::none;
+                if (!PluginStateRef::parseCodecName(blobEl->getStringAttribute("codec"), codec))
+                {
+                    DBG("[BankLibraryIO] unknown state codec " << blobEl->getStringAttribute("codec"));
+                    continue;
+                }
+
+                blobs.emplace(id, PluginStateRef::fromBase64(blobEl->getAllSubText().trim(), id, codec,
+                                                             (size_t)blobEl->getStringAttribute("size").getLargeIntValue()));
+            }
+
+        return blobs;
+    }
+
+    PluginStateRef readPluginState(const juce::XmlElement& stateEl, const StateBlobTable* blobs)
+    {
+        if (stateEl.hasAttribute("ref"))
+        {
+            if (blobs != nullptr)
+            {
+                auto it = blobs->find(stateEl.getStringAttribute("ref"));
+                if (it != blobs->end())
+                    return it->second;
+            }
+
+            DBG("[BankLibraryIO] unresolved PluginState ref " << stateEl.getStringAttribute("ref"));
+            return {};
+        }
+
+        return PluginStateRef::fromBase64(stateEl.getAllSubText().trim());
+    }
+
+    void deserializeBank(Bank& b, const juce::XmlElement& bankEl, const StateBlobTable* blobs)
+    {
+        b.bankName = bankEl.getStringAttribute("bankName");
+        b.pluginName = bankEl.getStringAttribute("pluginName");
+        b.pluginId = normalizePluginId(bankEl.getStringAttribute("pluginId")); // теперь всегда .vst3
+        b.activeProgram = bankEl.getIntAttribute("activeProgram", -1);
+
+        // Preset names
+        if (auto* presetsEl = bankEl.getChildByName("PresetNames"))
+        {
+            forEachXmlChildElementWithTagName(*presetsEl, pe, "Preset")
+            {
+                int pIdx = pe->getIntAttribute("index", -1);
+                if (pIdx >= 0 && pIdx < b.getNumPresets())
+                    b.presetNames[(size_t)pIdx] = pe->getStringAttribute("name");
+            }
+        }
+
+        // CC-матрица (если есть — <CCPresetStates> не читается)
+        if (auto* matrixEl = bankEl.getChildByName("CCMatrix"))
+        {
+            const auto cells = matrixEl->getStringAttribute("cells");
+            unpackCCCells(b, cells.toRawUTF8(), (size_t)cells.getNumBytesAsUTF8(),
+                          parseCCRows(matrixEl->getStringAttribute("rows")),
+                          matrixEl->getIntAttribute("ccs", numCCParams));
+
+            forEachXmlChildElementWithTagName(*matrixEl, slotEl, "Slot")
+            {
+                int cc = slotEl->getIntAttribute("number", -1);
+                if (cc >= 0 && cc < numCCParams)
+                {
+                    auto& globalMap = b.globalCCMappings[cc];
+                    globalMap.paramIndex = slotEl->getIntAttribute("paramIndex", -1);
+                    globalMap.name = slotEl->getStringAttribute("paramName");
+                }
+            }
+        }
+        // CC состояния и назначения (version 1)
+        else if (auto* ccStatesEl = bankEl.getChildByName("CCPresetStates"))
+        {
+            forEachXmlChildElementWithTagName(*ccStatesEl, presetEl, "Preset")
+            {
+                int pIdx = presetEl->getIntAttribute("index", -1);
+                if (pIdx >= 0 && pIdx < b.getNumPresets())
+                {
+                    forEachXmlChildElementWithTagName(*presetEl, ccEl, "CC")
+                    {
+                        int cc = ccEl->getIntAttribute("number", -1);
+                        if (cc >= 0 && cc < numCCParams)
+                        {
+                            PresetCCMapping presetMap;
+                            presetMap.enabled = ccEl->getBoolAttribute("enabled", false);
+                            presetMap.ccValue = (uint8_t)ccEl->getIntAttribute("ccValue", 64);
+                            presetMap.invert = ccEl->getBoolAttribute("invert", false);
+                            if (presetMap != PresetCCMapping{})
+                                b.editPresetCC(pIdx, cc) = presetMap;
+
+                            auto& globalMap = b.globalCCMappings[cc];
+                            globalMap.paramIndex = ccEl->getIntAttribute("paramIndex", -1);
+                            globalMap.name = ccEl->getStringAttribute("paramName");
+                        }
+                    }
+                }
+            }
+        }
+
+        // Полный state плагина — остаётся в base64 до первого обращения
+        b.pluginState.reset();
+        if (auto* stateEl = bankEl.getChildByName("PluginState"))
+            b.pluginState = readPluginState(*stateEl, blobs);
+
+        // Полная раскладка (version 1 или банк, ещё не приведённый к разреженной)
+        b.pluginParamValues.clear();
+        if (auto* paramsEl = bankEl.getChildByName("PluginParams"))
+            readParamsElement(*paramsEl, b.pluginParamValues);
+
+        // Отличия от значений по умолчанию плагина
+        b.paramDiffs.clear();
+        if (auto* diffsEl = bankEl.getChildByName("ParamDiffs"))
+        {
+            if (diffsEl->getStringAttribute("encoding") == paramDiffsEncoding)
+            {
+                const auto text = diffsEl->getAllSubText();
+                decodeParamDiffs(text.toRawUTF8(), text.getNumBytesAsUTF8(),
+                                 (size_t)diffsEl->getStringAttribute("count").getLargeIntValue(), b.paramDiffs);
+            }
+            else forEachXmlChildElementWithTagName(*diffsEl, de, "Diff")
+            {
+                int idx = de->getIntAttribute("index", -1);
+                if (idx >= 0)
+                    b.paramDiffs[idx] = (float)de->getDoubleAttribute("value", 0.0);
+            }
+        }
+    }
+}
@@ -0,0 +1,244 @@
+#pragma once
+#include <JuceHeader.h>
+#include <atomic>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <functional>
+#include "bank_model.h"
+
+//==============================================================================
+// BankLibrary — содержимое одного файла библиотеки (все банки + глобальный плагин).
+// Чистые данные без GUI: читаются/пишутся через BankLibraryIO.
+// Размеры свои у каждой библиотеки: число банков — banks.size(), у каждого
+// банка numPresets пресетов (пределы — BankModel::maxBanks/maxPresets).
+//==============================================================================
+struct BankLibrary
+{
+    using Bank = BankModel::Bank;
+
+    int numPresets = BankModel::defaultNumPresets;
+    int activeBankIndex = 0;
+    int activePreset = 0;
+
+    // --- Глобальные данные о плагине ---
+    juce::String pluginName;
+    juce::String pluginId;
+    int activeProgram = -1;
+    std::vector<float> pluginParamValues;
+    PluginStateRef pluginState;
+
+    // Значения по умолчанию по плагинам: банки хранят только отличия (Bank::paramDiffs)
+    BankModel::ParamDefaults pluginDefaults;
+
+    std::vector<Bank> banks;
+
+    /** Новые размеры (приводятся к пределам): банки добавляются пустыми или
+        отбрасываются с конца, активные индексы остаются в границах. */
+    void setCapacity(int numBanks, int newNumPresets);
+};
+
+//==============================================================================
+// BankLibraryIO — чтение/запись библиотек в двух форматах:
+//   *.xml — исходный текстовый формат (импорт/экспорт, ручная правка);
+//           CC-матрица банка хранится упакованной (<CCMatrix>);
+//   *.nxb — бинарный формат: журнал секций с индексом в конце,
+//           float-массивы и state-блобы лежат «как есть» и читаются
+//           прямо из memory-mapped файла.
+// State'ы плагина в обоих форматах лежат в хранилище блобов по SHA-256:
+// одинаковый state нескольких банков (и глобальный) записывается один раз,
+// по умолчанию сжатым (zlib) — тег кодека лежит рядом с данными.
+//==============================================================================
+namespace BankLibraryIO
+{
+    using Bank = BankModel::Bank;
+
+    static constexpr const char* xmlExtension = ".xml";
+    static constexpr const char* binaryExtension = ".nxb";
+    static constexpr const char* fileWildcard = "*.xml;*.nxb";
+
+    /** Версия бинарного формата (.nxb); читается только она — раскладка описана у writeBinary. */
+    static constexpr uint32_t binaryVersion = 6;
+
+    /** Кодек, которым пишутся state'ы (по умолчанию zlib; none — как раньше). */
+    void setStateCodec(PluginStateRef::Codec codec);
+    PluginStateRef::Codec getStateCodec();
+
+    /** Хранилище state-блобов XML-библиотеки: хеш содержимого → state. */
+    using StateBlobTable = std::map<juce::String, PluginStateRef>;
+
+    /** Проверка «прервать чтение» — вызывается между банками/элементами
+        (при параллельном разборе — с разных потоков). */
+    using AbortCheck = std::function<bool()>;
+
+    /** Сколько потоков разбирают банки одной библиотеки: 0 — по числу ядер, 1 — последовательно. */
+    void setDecodeThreads(int numThreads);
+    int getDecodeThreads();
+
+    /** task(0..count-1) на общем пуле потоков (и на вызывающем); возвращает, когда все выполнены.
+        Каждая задача пишет только в свой слот — результат не зависит от числа потоков. */
+    void parallelFor(int count, const std::function<void(int)>& task);
+
+    /** Порядок разбора банков (прогрессивная загрузка). Читатель спрашивает
+        следующий банк, когда поток освобождается, поэтому bump() во время чтения
+        действует сразу. Без bump() первым идёт активный банк библиотеки. */
+    class BankReadOrder
+    {
+    public:
+        /** Банк разобран, его слот больше не меняется. Вызывается на потоке разбора. */
+        using BankReady = std::function<void(int bankIndex, const Bank& bank)>;
+
+        explicit BankReadOrder(BankReady onReady = {}) : onBankReady(std::move(onReady)) {}
+
+        /** Разобрать банк следующим (потокобезопасно; до или во время чтения). */
+        void bump(int bankIndex);
+
+        // --- для читателей ---
+        /** Заголовок прочитан (размеры и активный банк известны): возвращает число банков. */
+        int start(const BankLibrary& header);
+        /** Следующий банк; -1 — все уже розданы. */
+        int take();
+        void finished(int bankIndex, const Bank& bank)
+        {
+            delivered = true;
+            if (onBankReady) onBankReady(bankIndex, bank);
+        }
+
+        /** true, если хоть один банк уже отдан в BankReady: перечитывать out заново нельзя. */
+        bool hasDelivered() const noexcept { return delivered; }
+
+    private:
+        juce::CriticalSection lock;
+        std::vector<int> bumped;       // последний поднятый — первым
+        std::vector<char> taken;
+        int activeBank = 0, cursor = 0;
+        std::atomic<bool> delivered { false };
+        const BankReady onBankReady;
+
+        JUCE_DECLARE_NON_COPYABLE(BankReadOrder)
+    };
+
+    /** true, если файл начинается с сигнатуры бинарной библиотеки. */
+    bool isBinaryLibrary(const juce::File& file);
+
+    /** true, если файл следует сохранять в бинарном формате (по расширению). */
+    bool wantsBinaryFormat(const juce::File& file);
+
+    /** Читает библиотеку любого формата (формат определяется по сигнатуре).
+        order (если задан) — в каком порядке разбирать банки и кому сообщать о готовых;
+        глобальные данные и размеры к первому BankReady уже прочитаны. */
+    bool read(const juce::File& file, BankLibrary& out, const AbortCheck& shouldAbort = {},
+              BankReadOrder* order = nullptr);
+
+    /** Пишет библиотеку в формате, соответствующем расширению файла. */
+    bool write(const juce::File& file, const BankLibrary& lib);
+
+    /** Сериализация в поток: binary ? .nxb : XML.
+        false — какой-то state не прочитать (PluginStateRef::isAvailable): в поток ничего не записано. */
+    bool writeTo(juce::OutputStream& out, const BankLibrary& lib, bool binary);
+
+    /** Запись через временный файл рядом с целевым: write → fsync → rename. */
+    bool replaceFileAtomically(const juce::File& target, const void* data, size_t size);
+
+    /** Потоковый разбор XML (без DOM); при ошибке — откат на readXmlDom. */
+    bool readXml(const juce::File& file, BankLibrary& out, const AbortCheck& shouldAbort = {},
+                 BankReadOrder* order = nullptr);
+    bool readXmlDom(const juce::File& file, BankLibrary& out);
+    bool writeXml(const juce::File& file, const BankLibrary& lib);
+
+    bool readBinary(const juce::File& file, BankLibrary& out, const AbortCheck& shouldAbort = {},
+                    BankReadOrder* order = nullptr);
+    /** stateSource (если задан) — файл, из которого отображён data: state банков
+        не копируется, а остаётся ссылкой на диапазон в этом файле. */
+    bool readBinary(const void* data, size_t size, BankLibrary& out, const AbortCheck& shouldAbort = {},
+                    const std::shared_ptr<PluginStateRef::FileSource>& stateSource = nullptr,
+                    BankReadOrder* order = nullptr);
+    bool writeBinary(const juce::File& file, const BankLibrary& lib);
+    bool writeBinary(juce::OutputStream& out, const BankLibrary& lib);
+
+    /** Дописывает в существующий .nxb (текущей версии) только изменившиеся секции банков и новые
+        блобы, затем переключает заголовок на новый индекс. false — нужна полная запись:
+        файла нет, это не .nxb текущей версии или пора сжимать (мёртвых данных больше живых). */
+    bool appendBinary(const juce::File& file, const BankLibrary& lib);
+
+    /** nullptr — какой-то state не прочитать: библиотеку с пустышкой вместо него не пишем. */
+    std::unique_ptr<juce::XmlElement> toXml(const BankLibrary& lib);
+    /** false — неподдерживаемая версия схемы (out не тронут). */
+    bool fromXml(const juce::XmlElement& root, BankLibrary& out, BankReadOrder* order = nullptr);
+
+    /** stateByRef — писать <PluginState ref="хеш"/> вместо встроенного base64. */
+    juce::XmlElement* serializeBank(const Bank& b, int index, bool stateByRef = false);
+
+    /** blobs — хранилище блобов библиотеки, по нему разрешаются ссылки ref="...". */
+    void deserializeBank(Bank& b, const juce::XmlElement& bankEl, const StateBlobTable* blobs = nullptr);
+
+    /** Версия XML-схемы (атрибут version корня): хранилище state-блобов (<StateBlobs>),
+        упакованные <PluginParams>/<ParamDiffs> (encoding="f32le"), размеры в корне
+        (banks, presets), <CCMatrix> только по тронутым пресетам (rows), <PluginDefaults>
+        (вектор по умолчанию на плагин) — у банка только <ParamDiffs> относительно него.
+        Кроме неё читается лишь исходная схема (version 1 или без атрибута). */
+    static constexpr int xmlVersion = 6;
+
+    /** version корня, который читают fromXml и BankXmlStreamReader: 1 или xmlVersion. */
+    bool isSupportedXmlVersion(int version);
+
+    /** Значения атрибута encoding у <PluginParams> и <ParamDiffs>. */
+    static constexpr const char* floatArrayEncoding = "f32le";
+    static constexpr const char* paramDiffsEncoding = "i32f32le";
+
+    /** Float-массив для XML: base64 от little-endian float32 — бит в бит. */
+    juce::String encodeFloatArray(const std::vector<float>& values);
+
+    /** Обратное encodeFloatArray; count — число значений (атрибут count).
+        false — текст не base64 или длина не совпала (dest тогда пуст). */
+    bool decodeFloatArray(const char* text, size_t length, size_t count, std::vector<float>& dest);
+
+    /** Diff'ы для XML: base64 пар { i32 индекс; f32 значение } (little-endian),
+        по возрастанию индекса — файл детерминирован. */
+    juce::String encodeParamDiffs(const std::unordered_map<int, float>& diffs);
+    bool decodeParamDiffs(const char* text, size_t length, size_t count, std::unordered_map<int, float>& dest);
+
+    /** CC-матрица: ячейки строка × CC по 2 байта — флаги (бит 0 enabled,
+        бит 1 invert) и ccValue — подряд по строкам, в hex. Строки — только
+        тронутые пресеты (Bank::hasPresetRow); их номера через пробел — в rows. */
+    juce::String packCCCells(const Bank& b, juce::String& rows);
+
+    /** Номера строк матрицы из атрибута rows. */
+    std::vector<int> parseCCRows(const juce::String& rows);
+
+    /** Обратное packCCCells для матрицы rows × ccs (чужие пресеты и CC отбрасываются,
+        строки по умолчанию не выделяются); false — строка короче матрицы или не hex. */
+    bool unpackCCCells(Bank& b, const char* hex, size_t length, const std::vector<int>& rows, int ccs);
+
+    /** Читает <StateBlobs> из корня библиотеки. */
+    StateBlobTable readStateBlobs(const juce::XmlElement& root);
+
+    /** <PluginState>: ссылка ref="..." на блоб или встроенный base64 (старые файлы). */
+    PluginStateRef readPluginState(const juce::XmlElement& stateEl, const StateBlobTable* blobs);
+
+    /** Примерный объём библиотеки в памяти; state'ы, ещё не декодированные
+        (ссылки на файл или base64), не считаются. */
+    juce::int64 estimateMemoryBytes(const BankLibrary& lib);
+
+    /** Побайтовое сравнение двух библиотек (все поля, включая state и diff'ы). */
+    bool identical(const BankLibrary& a, const BankLibrary& b);
+
+    /** Значения параметров банка хранятся разреженно: paramDiffs — отличия от вектора
+        по умолчанию его плагина. Банки в старой полной раскладке (pluginParamValues,
+        исходная схема XML) переводятся в разреженную; если у плагина вектора
+        ещё нет, он выводится из этих банков — самое частое значение каждого параметра.
+        Читатели вызывают это сами после разбора всех банков — кроме чтения с BankReadOrder:
+        отданные банки уже читают другие потоки, приводит вызывающий (в своей копии). */
+    void compactParamValues(std::vector<Bank>& banks, BankModel::ParamDefaults& defaults);
+    void compactParamValues(BankLibrary& lib);
+
+    /** Банк — обратно в полную раскладку относительно defaults (перед заменой вектора по умолчанию). */
+    void expandParamValues(Bank& b, const std::vector<float>& defaults);
+
+    /** Проверка прочитанной библиотеки: размеры, NaN/Inf в параметрах, diff'ы,
+        распаковка state'ов и их SHA-256. Пусто — ошибок нет. */
+    juce::StringArray validate(const BankLibrary& lib);
+
+    /** Путь к .so внутри бандла *.vst3 → путь к самому бандлу. */
+    juce::String normalizePluginId(const juce::String& rawId);
+}
@@ -0,0 +1,370 @@
+#include "bank_library_bench.h"
+#include "bank_library.h"
+#include "bank_xml_stream.h"
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+
+#if JUCE_WINDOWS
+ #include <psapi.h>
+#elif JUCE_LINUX
+ #include <unistd.h>
+#endif
+
+namespace
+{
+    double ticksToMs(juce::int64 ticks)
+    {
+        return juce::Time::highResolutionTicksToSeconds(ticks) * 1000.0;
+    }
+
+    juce::String formatBytes(juce::int64 bytes)
+    {
+        return juce::String((double)bytes / (1024.0 * 1024.0), 2) + " MB";
+    }
+
+    int countElements(const juce::XmlElement& el)
+    {
+        int n = 1;
+        for (auto* child : el.getChildIterator())
+            n += countElements(*child);
+        return n;
+    }
+
+    struct ReaderResult
+    {
+        double avgMs = 0.0;
+        juce::int64 peakBytes = 0;
+        BankLibrary lib;
+    };
+
+    // readOnce(lib, sampleMemory) — один разбор; sampleMemory() вызывается
+    // в точках, где промежуточные данные ещё живы
+    template <typename ReadFn>
+    ReaderResult measure(int iterations, ReadFn&& readOnce)
+    {
+        ReaderResult r;
+        juce::int64 totalTicks = 0;
+
+        for (int i = 0; i < iterations; ++i)
+        {
+            BankLibrary lib;
+            const auto before = BankLibraryBench::getProcessMemoryBytes();
+            auto sample = [&] { r.peakBytes = std::max(r.peakBytes, BankLibraryBench::getProcessMemoryBytes() - before); };
+
+            const auto t0 = juce::Time::getHighResolutionTicks();
+            readOnce(lib, sample);
+            totalTicks += juce::Time::getHighResolutionTicks() - t0;
+
+            sample();
+            if (i == 0)
+                r.lib = std::move(lib);
+        }
+
+        r.avgMs = ticksToMs(totalTicks) / juce::jmax(1, iterations);
+        return r;
+    }
+
+    struct CodecResult
+    {
+        juce::String name;
+        juce::int64 fileBytes = 0;
+        double loadMs = 0.0;         // только чтение файла (state'ы ещё не распакованы)
+        double activeDecodeMs = 0.0; // то, что добавляется к applyBankToPlugin
+        double allDecodeMs = 0.0;
+        BankLibrary lib;
+    };
+
+    CodecResult measureCodec(const juce::File& file, const juce::String& name, int iterations)
+    {
+        CodecResult r;
+        r.name = name;
+        r.fileBytes = file.getSize();
+
+        juce::int64 loadTicks = 0, activeTicks = 0, allTicks = 0;
+        for (int i = 0; i < iterations; ++i)
+        {
+            BankLibrary lib;
+
+            auto t0 = juce::Time::getHighResolutionTicks();
+            BankLibraryIO::read(file, lib);
+            loadTicks += juce::Time::getHighResolutionTicks() - t0;
+
+            // copyDecoded не кладёт результат в кэш — каждый замер распаковывает заново
+            if (juce::isPositiveAndBelow(lib.activeBankIndex, (int)lib.banks.size()))
+            {
+                t0 = juce::Time::getHighResolutionTicks();
+                lib.banks[(size_t)lib.activeBankIndex].pluginState.copyDecoded();
+                activeTicks += juce::Time::getHighResolutionTicks() - t0;
+            }
+
+            t0 = juce::Time::getHighResolutionTicks();
+            lib.pluginState.copyDecoded();
+            for (const auto& b : lib.banks)
+                b.pluginState.copyDecoded();
+            allTicks += juce::Time::getHighResolutionTicks() - t0;
+
+            if (i == iterations - 1)
+                r.lib = std::move(lib);
+        }
+
+        r.loadMs = ticksToMs(loadTicks) / iterations;
+        r.activeDecodeMs = ticksToMs(activeTicks) / iterations;
+        r.allDecodeMs = ticksToMs(allTicks) / iterations;
+        return r;
+    }
+}
+
+namespace BankLibraryBench
+{
+    juce::int64 getProcessMemoryBytes()
+    {
+       #if JUCE_WINDOWS
+        PROCESS_MEMORY_COUNTERS_EX pmc{};
+        if (GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&pmc, sizeof(pmc)))
+            return (juce::int64)pmc.PrivateUsage;
+        return 0;
+       #elif JUCE_LINUX
+        juce::int64 pages = 0, resident = 0;
+        if (auto* f = std::fopen("/proc/self/statm", "r"))
+        {
+            if (std::fscanf(f, "%lld %lld", &pages, &resident) != 2)
+                resident = 0;
+            std::fclose(f);
+        }
+        return resident * (juce::int64)sysconf(_SC_PAGESIZE);
+       #else
+        return 0;
+       #endif
+    }
+
+    juce::String compareXmlReaders(const juce::File& file, int iterations)
+    {
+        if (!file.existsAsFile())
+            return "file not found: " + file.getFullPathName();
+
+        iterations = juce::jmax(1, iterations);
+
+        // Потоковый разбор меряем первым: DOM затем может переиспользовать
+        // освобождённые страницы, так что выигрыш по памяти занижается, а не завышается
+        auto stream = measure(iterations, [&](BankLibrary& lib, auto& sample)
+            {
+                BankXmlStreamReader::read(file, lib);
+                sample();
+            });
+
+        int domNodes = 0;
+        auto dom = measure(iterations, [&](BankLibrary& lib, auto& sample)
+            {
+                std::unique_ptr<juce::XmlElement> xml(juce::XmlDocument::parse(file));
+                if (xml == nullptr)
+                    return;
+
+                sample();
+                BankLibraryIO::fromXml(*xml, lib);
+                sample();               // пик: DOM и банки живы одновременно
+                domNodes = countElements(*xml);
+            });
+
+        const bool same = BankLibraryIO::identical(dom.lib, stream.lib);
+
+        juce::String report;
+        report << "file:      " << file.getFileName() << " (" << formatBytes(file.getSize()) << ")\n"
+               << "DOM:       " << juce::String(dom.avgMs, 2) << " ms avg, peak +" << formatBytes(dom.peakBytes)
+               << ", " << domNodes << " XmlElement nodes\n"
+               << "stream:    " << juce::String(stream.avgMs, 2) << " ms avg, peak +" << formatBytes(stream.peakBytes) << "\n"
+               << "speedup:   x" << juce::String(dom.avgMs / juce::jmax(0.001, stream.avgMs), 2) << "\n"
+               << "identical: " << (same ? "yes" : "NO") << "\n";
+        return report;
+    }
+
+    juce::String compareStateCodecs(const juce::File& file, int iterations)
+    {
+        if (!file.existsAsFile())
+            return "file not found: " + file.getFullPathName();
+
+        iterations = juce::jmax(1, iterations);
+
+        struct Variant
+        {
+            const char* name;
+            const char* extension;
+            PluginStateRef::Codec codec;
+        };
+
+        const Variant variants[] = {
+            { "xml  none", BankLibraryIO::xmlExtension,    PluginStateRef::Codec::none },
+            { "xml  zlib", BankLibraryIO::xmlExtension,    PluginStateRef::Codec::zlib },
+            { "nxb  none", BankLibraryIO::binaryExtension, PluginStateRef::Codec::none },
+            { "nxb  zlib", BankLibraryIO::binaryExtension, PluginStateRef::Codec::zlib },
+        };
+
+        std::vector<std::unique_ptr<juce::TemporaryFile>> files;
+        {
+            BankLibrary source;
+            if (!BankLibraryIO::read(file, source))
+                return "cannot read: " + file.getFullPathName();
+
+            const auto savedCodec = BankLibraryIO::getStateCodec();
+            for (const auto& v : variants)
+            {
+                files.push_back(std::make_unique<juce::TemporaryFile>(v.extension));
+                BankLibraryIO::setStateCodec(v.codec);
+                BankLibraryIO::write(files.back()->getFile(), source);
+            }
+            BankLibraryIO::setStateCodec(savedCodec);
+
+            // source уничтожается до замеров: иначе прочитанные state'ы с тем же
+            // хешем делили бы с ним данные и распаковывались бы из исходного файла
+        }
+
+        std::vector<CodecResult> results;
+        for (size_t i = 0; i < files.size(); ++i)
+            results.push_back(measureCodec(files[i]->getFile(), variants[i].name, iterations));
+
+        bool same = true;
+        for (size_t i = 1; i < results.size(); ++i)
+            same = same && BankLibraryIO::identical(results[0].lib, results[i].lib);
+
+        juce::String report;
+        report << "file:      " << file.getFileName() << " (" << formatBytes(file.getSize()) << ")\n";
+        for (const auto& r : results)
+            report << r.name << ": " << formatBytes(r.fileBytes)
+                   << ", load " << juce::String(r.loadMs, 2) << " ms"
+                   << ", active state " << juce::String(r.activeDecodeMs, 3) << " ms"
+                   << ", all states " << juce::String(r.allDecodeMs, 2) << " ms\n";
+        report << "identical: " << (same ? "yes" : "NO") << "\n";
+        return report;
+    }
+
+    juce::String compareDecodeThreads(const juce::File& file, int iterations)
+    {
+        if (!file.existsAsFile())
+            return "file not found: " + file.getFullPathName();
+
+        iterations = juce::jmax(1, iterations);
+
+        juce::TemporaryFile xmlFile(BankLibraryIO::xmlExtension), nxbFile(BankLibraryIO::binaryExtension);
+        {
+            BankLibrary source;
+            if (!BankLibraryIO::read(file, source))
+                return "cannot read: " + file.getFullPathName();
+
+            BankLibraryIO::write(xmlFile.getFile(), source);
+            BankLibraryIO::write(nxbFile.getFile(), source);
+        }
+
+        std::unique_ptr<juce::XmlElement> dom(juce::XmlDocument::parse(xmlFile.getFile()));
+        if (dom == nullptr)
+            return "cannot parse: " + xmlFile.getFile().getFullPathName();
+
+        struct Reader
+        {
+            const char* name;
+            std::function<void(BankLibrary&)> read;
+        };
+
+        const Reader readers[] = {
+            { "xml stream", [&](BankLibrary& lib) { BankXmlStreamReader::read(xmlFile.getFile(), lib); } },
+            { "xml DOM   ", [&](BankLibrary& lib) { BankLibraryIO::fromXml(*dom, lib); } }, // только fromXml, без XmlDocument
+            { "nxb       ", [&](BankLibrary& lib) { BankLibraryIO::readBinary(nxbFile.getFile(), lib); } },
+        };
+
+        std::vector<int> threadCounts;
+        for (int n = 1; n < juce::SystemStats::getNumCpus(); n *= 2)
+            threadCounts.push_back(n);
+        threadCounts.push_back(juce::SystemStats::getNumCpus());
+
+        const int savedThreads = BankLibraryIO::getDecodeThreads();
+        bool same = true;
+
+        juce::String report;
+        report << "file:      " << file.getFileName() << " (" << formatBytes(file.getSize()) << "), "
+               << juce::SystemStats::getNumCpus() << " cores\n";
+
+        for (const auto& reader : readers)
+        {
+            double serialMs = 0.0;
+            BankLibrary serial;
+
+            report << reader.name << ":";
+            for (int threads : threadCounts)
+            {
+                BankLibraryIO::setDecodeThreads(threads);
+                auto r = measure(iterations, [&](BankLibrary& lib, auto&) { reader.read(lib); });
+
+                if (threads == 1)
+                {
+                    serialMs = r.avgMs;
+                    serial = std::move(r.lib);
+                }
+                else
+                {
+                    same = same && BankLibraryIO::identical(serial, r.lib);
+                }
+
+                report << "  " << threads << "t " << juce::String(r.avgMs, 2) << " ms"
+                       << " (x" << juce::String(serialMs / juce::jmax(0.001, r.avgMs), 2) << ")";
+            }
+            report << "\n";
+        }
+
+        BankLibraryIO::setDecodeThreads(savedThreads);
+
+        report << "identical: " << (same ? "yes" : "NO") << "\n";
+        return report;
+    }
+
+    juce::String compareFirstBank(const juce::File& file, int iterations)
+    {
+        if (!file.existsAsFile())
+            return "file not found: " + file.getFullPathName();
+
+        iterations = juce::jmax(1, iterations);
+
+        juce::TemporaryFile xmlFile(BankLibraryIO::xmlExtension), nxbFile(BankLibraryIO::binaryExtension);
+        {
+            BankLibrary source;
+            if (!BankLibraryIO::read(file, source))
+                return "cannot read: " + file.getFullPathName();
+
+            BankLibraryIO::write(xmlFile.getFile(), source);
+            BankLibraryIO::write(nxbFile.getFile(), source);
+        }
+
+        juce::String report;
+        report << "file:      " << file.getFileName() << " (" << formatBytes(file.getSize()) << ")\n";
+        bool same = true;
+
+        for (const auto* f : { &xmlFile, &nxbFile })
+        {
+            const auto full = measure(iterations, [&](BankLibrary& lib, auto&) { BankLibraryIO::read(f->getFile(), lib); });
+
+            juce::int64 firstTicks = 0;
+            const auto progressive = measure(iterations, [&](BankLibrary& lib, auto&)
+                {
+                    const auto t0 = juce::Time::getHighResolutionTicks();
+                    BankLibraryIO::BankReadOrder order([&](int bankIndex, const BankLibraryIO::Bank& bank)
+                        {
+                            // как у загрузчика: активный банк отдаётся с распакованным state'ом
+                            if (bankIndex == lib.activeBankIndex)
+                            {
+                                bank.pluginState.getDecoded();
+                                firstTicks += juce::Time::getHighResolutionTicks() - t0;
+                            }
+                        });
+                    BankLibraryIO::read(f->getFile(), lib, {}, &order);
+                });
+
+            same = same && BankLibraryIO::identical(full.lib, progressive.lib);
+
+            report << (f == &xmlFile ? "xml: " : "nxb: ")
+                   << "active bank " << juce::String(ticksToMs(firstTicks) / iterations, 2) << " ms"
+                   << ", all banks " << juce::String(progressive.avgMs, 2) << " ms"
+                   << " (plain read " << juce::String(full.avgMs, 2) << " ms)\n";
+        }
+
+        report << "identical: " << (same ? "yes" : "NO") << "\n";
+        return report;
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <JuceHeader.h>
+
+//==============================================================================
+// BankLibraryBench — замеры чтения/записи библиотек банков.
+// Отчёты возвращаются текстом (для консоли/DBG), GUI не требуется.
+//==============================================================================
+namespace BankLibraryBench
+{
+    /** Текущий объём памяти процесса (private bytes на Windows, RSS на Linux). */
+    juce::int64 getProcessMemoryBytes();
+
+    /** DOM (XmlDocument) против потокового разбора: время, пик памяти, совпадение результата. */
+    juce::String compareXmlReaders(const juce::File& file, int iterations = 10);
+
+    /** State без сжатия против zlib (XML и .nxb): размер файла, время загрузки,
+        время распаковки state'а активного банка и всех state'ов. */
+    juce::String compareStateCodecs(const juce::File& file, int iterations = 10);
+
+    /** Разбор банков на 1, 2, 4… потоках (до числа ядер) для XML (потоковый и DOM)
+        и .nxb: время загрузки, ускорение относительно 1 потока, совпадение результата. */
+    juce::String compareDecodeThreads(const juce::File& file, int iterations = 10);
+
+    /** Постепенное чтение (BankReadOrder) для XML и .nxb: когда готов активный банк
+        (с распакованным state'ом) против полного чтения; совпадение результата. */
+    juce::String compareFirstBank(const juce::File& file, int iterations = 10);
+}
@@ -0,0 +1,108 @@
+#include "bank_library_cache.h"
+#include "bank_library.h"
+#include <algorithm>
+
+BankLibraryCache::BankLibraryCache(juce::int64 memoryCapBytes)
+    : memoryCap(memoryCapBytes)
+{
+}
+
+std::shared_ptr<const BankLibrary> BankLibraryCache::find(const juce::File& file)
+{
+    const juce::ScopedLock sl(lock);
+
+    auto it = std::find_if(order.begin(), order.end(), [&file](const Entry& e) { return e.file == file; });
+    if (it != order.end())
+    {
+        if (it->matches(file))
+        {
+            order.splice(order.begin(), order, it);
+            ++stats.hits;
+            DBG("[LibraryCache] hit " << file.getFileName() << " (" << stats.hits << "/" << stats.misses << ")");
+            return it->lib;
+        }
+
+        // файл изменился — запись больше никогда не совпадёт
+        stats.bytes -= it->bytes;
+        order.erase(it);
+        stats.entries = (int)order.size();
+    }
+
+    ++stats.misses;
+    return nullptr;
+}
+
+bool BankLibraryCache::contains(const juce::File& file) const
+{
+    const juce::ScopedLock sl(lock);
+
+    auto it = std::find_if(order.begin(), order.end(), [&file](const Entry& e) { return e.file == file; });
+    return it != order.end() && it->matches(file);
+}
+
+void BankLibraryCache::insert(const juce::File& file, juce::int64 stampSize, juce::Time stampTime,
+                              std::shared_ptr<const BankLibrary> lib)
+{
+    if (lib == nullptr)
+        return;
+
+    const auto bytes = BankLibraryIO::estimateMemoryBytes(*lib);
+
+    const juce::ScopedLock sl(lock);
+
+    auto it = std::find_if(order.begin(), order.end(), [&file](const Entry& e) { return e.file == file; });
+    if (it != order.end())
+    {
+        stats.bytes -= it->bytes;
+        order.erase(it);
+    }
+
+    // то, что больше всего кэша, не вытесняет остальное
+    if (bytes <= memoryCap)
+    {
+        order.push_front({ file, stampSize, stampTime, bytes, std::move(lib) });
+        stats.bytes += bytes;
+        trimLocked();
+    }
+
+    stats.entries = (int)order.size();
+}
+
+void BankLibraryCache::setMemoryCap(juce::int64 bytes)
+{
+    const juce::ScopedLock sl(lock);
+    memoryCap = bytes;
+    trimLocked();
+    stats.entries = (int)order.size();
+}
+
+juce::int64 BankLibraryCache::getMemoryCap() const
+{
+    const juce::ScopedLock sl(lock);
+    return memoryCap;
+}
+
+void BankLibraryCache::clear()
+{
+    const juce::ScopedLock sl(lock);
+    order.clear();
+    stats.bytes = 0;
+    stats.entries = 0;
+}
+
+BankLibraryCache::Stats BankLibraryCache::getStats() const
+{
+    const juce::ScopedLock sl(lock);
+    auto s = stats;
+    s.memoryCap = memoryCap;
+    return s;
+}
+
+void BankLibraryCache::trimLocked()
+{
+    while (!order.empty() && stats.bytes > memoryCap)
+    {
+        stats.bytes -= order.back().bytes;
+        order.pop_back();
+    }
+}
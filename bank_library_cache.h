@@ -0,0 +1,79 @@
+#pragma once
+#include <JuceHeader.h>
+#include <list>
+#include <memory>
+
+struct BankLibrary;
+
+//==============================================================================
+// BankLibraryCache — LRU разобранных библиотек внутри процесса.
+// Ключ — путь файла плюс его размер и время изменения на момент чтения:
+// повторная загрузка неизменённого файла (LOAD, переключение между песнями)
+// обходится без разбора, изменённый файл — промах. Объём ограничен
+// (оценка BankLibraryIO::estimateMemoryBytes); при переполнении
+// вытесняются давно не использованные библиотеки.
+// Потокобезопасен: наполняется загрузчиком на его потоке.
+//==============================================================================
+class BankLibraryCache
+{
+public:
+    struct Stats
+    {
+        int hits = 0;
+        int misses = 0;
+        int entries = 0;
+        juce::int64 bytes = 0;
+        juce::int64 memoryCap = 0;
+
+        double getHitRate() const noexcept
+        {
+            const int total = hits + misses;
+            return total > 0 ? (double)hits / total : 0.0;
+        }
+    };
+
+    explicit BankLibraryCache(juce::int64 memoryCapBytes = defaultMemoryCap);
+
+    /** Библиотека, если файл не менялся с момента её чтения (+1 к попаданиям/промахам). */
+    std::shared_ptr<const BankLibrary> find(const juce::File& file);
+
+    /** То же без учёта в статистике и без смены порядка LRU. */
+    bool contains(const juce::File& file) const;
+
+    /** stampSize/stampTime — размер и время изменения файла, снятые до чтения. */
+    void insert(const juce::File& file, juce::int64 stampSize, juce::Time stampTime,
+                std::shared_ptr<const BankLibrary> lib);
+
+    /** 0 — кэш выключен. */
+    void setMemoryCap(juce::int64 bytes);
+    juce::int64 getMemoryCap() const;
+
+    void clear();
+    Stats getStats() const;
+
+    static constexpr juce::int64 defaultMemoryCap = 128 * 1024 * 1024;
+
+private:
+    struct Entry
+    {
+        juce::File file;
+        juce::int64 stampSize = 0;
+        juce::Time stampTime;
+        juce::int64 bytes = 0;
+        std::shared_ptr<const BankLibrary> lib;
+
+        bool matches(const juce::File& f) const
+        {
+            return f.getSize() == stampSize && f.getLastModificationTime() == stampTime;
+        }
+    };
+
+    void trimLocked();
+
+    juce::CriticalSection lock;
+    std::list<Entry> order; // front — самая свежая
+    juce::int64 memoryCap;
+    Stats stats;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(BankLibraryCache)
+};
@@ -0,0 +1,280 @@
+#include "bank_library_importer.h"
+#include "bank_library.h"
+#include "bank_file_index.h"
+#include "bank_file_writer.h"
+#include <algorithm>
+#include <climits>
+#include <set>
+#include <unordered_map>
+
+namespace
+{
+    double ticksToMs(juce::int64 ticks)
+    {
+        return juce::Time::highResolutionTicksToSeconds(ticks) * 1000.0;
+    }
+
+    // Без префикса — в конец; дальше по имени, как в BankFileIndex
+    bool importsBefore(const juce::File& a, const juce::File& b)
+    {
+        const auto an = a.getFileNameWithoutExtension();
+        const auto bn = b.getFileNameWithoutExtension();
+
+        auto prefix = [](const juce::String& name)
+            {
+                const int p = BankFileIndex::getNumericPrefix(name);
+                return p < 0 ? INT_MAX : p;
+            };
+
+        if (const int ap = prefix(an), bp = prefix(bn); ap != bp)
+            return ap < bp;
+
+        if (const int c = an.compareNatural(bn))
+            return c < 0;
+
+        return a.getFullPathName() < b.getFullPathName();
+    }
+
+    // Отпечаток содержимого: .nxb-представление не зависит от формата и форматирования исходника
+    juce::String fingerprint(const BankLibrary& lib)
+    {
+        juce::MemoryOutputStream mo;
+        if (!BankLibraryIO::writeTo(mo, lib, true))
+            return {};
+        return juce::SHA256(mo.getData(), mo.getDataSize()).toHexString();
+    }
+
+    struct Parsed
+    {
+        std::shared_ptr<BankLibrary> lib;
+        juce::String hash;           // пусто — не прочитан
+        juce::String error;
+    };
+}
+
+BankLibraryImporter::BankLibraryImporter(BankFileWriter& writerToUse)
+    : juce::Thread("BankLibraryImporter"),
+      writer(writerToUse),
+      alive(std::make_shared<std::atomic<bool>>(true))
+{
+}
+
+BankLibraryImporter::~BankLibraryImporter()
+{
+    alive->store(false);
+    stopThread(10000);
+}
+
+bool BankLibraryImporter::start(const juce::Array<juce::File>& sourcesToImport, const juce::File& targetDir,
+                                const Options& optionsToUse, ProgressCallback onProgress, FinishedCallback onFinished)
+{
+    if (isThreadRunning())
+        return false;
+
+    sources = sourcesToImport;
+    bankDir = targetDir;
+    options = optionsToUse;
+    progressCallback = std::move(onProgress);
+    finishedCallback = std::move(onFinished);
+
+    for (auto* counter : { &total, &parsed, &queued, &failed, &duplicates })
+        counter->store(0);
+    lastProgressPost = 0;
+
+    startThread();
+    return true;
+}
+
+void BankLibraryImporter::cancel()
+{
+    signalThreadShouldExit();
+}
+
+juce::String BankLibraryImporter::stripNumericPrefix(const juce::String& name)
+{
+    auto title = name.trimStart();
+    int i = 0;
+    while (i < title.length() && juce::CharacterFunctions::isDigit(title[i]))
+        ++i;
+
+    title = title.substring(i).trimCharactersAtStart(" _-.").trimEnd();
+    return title.isNotEmpty() ? title : juce::String("Import");
+}
+
+void BankLibraryImporter::postProgress(bool force)
+{
+    if (progressCallback == nullptr)
+        return;
+
+    // пул разбирает файлы параллельно — отправляет только тот, кто первым застал интервал истёкшим
+    const auto now = juce::Time::getMillisecondCounter();
+    auto last = lastProgressPost.load();
+    if (!force && (now - last < (juce::uint32)progressIntervalMs || !lastProgressPost.compare_exchange_strong(last, now)))
+        return;
+
+    Progress p;
+    p.total = total.load();
+    p.parsed = parsed.load();
+    p.queued = queued.load();
+    p.failed = failed.load();
+    p.duplicates = duplicates.load();
+
+    juce::MessageManager::callAsync([alive = alive, callback = progressCallback, p]()
+        {
+            if (alive->load())
+                callback(p);
+        });
+}
+
+void BankLibraryImporter::run()
+{
+    const auto t0 = juce::Time::getHighResolutionTicks();
+
+    // --- Что импортировать: файлы библиотек, папки — рекурсивно ---
+    juce::Array<juce::File> files;
+    for (const auto& source : sources)
+    {
+        if (source.isDirectory())
+            files.addArray(source.findChildFiles(juce::File::findFiles, true, BankLibraryIO::fileWildcard));
+        else if (source.existsAsFile() && source.hasFileExtension(juce::String(BankLibraryIO::xmlExtension) + ";" + BankLibraryIO::binaryExtension))
+            files.add(source);
+    }
+
+    files.removeDuplicates(false);
+    std::sort(files.begin(), files.end(), importsBefore);
+
+    // --- Что уже лежит в BANK: с этим сверяются повторы и от этого идёт нумерация ---
+    bankDir.createDirectory();
+    const auto existing = bankDir.findChildFiles(juce::File::findFiles, false, BankLibraryIO::fileWildcard);
+
+    const int numFiles = files.size();
+    total = numFiles;
+    postProgress(true);
+
+    // --- Разбор, проверка и отпечатки — параллельно на общем пуле ---
+    const int numToHash = numFiles + (options.dedupe ? existing.size() : 0);
+    std::vector<Parsed> results((size_t)numToHash);
+    const BankLibraryIO::AbortCheck shouldAbort = [this] { return threadShouldExit(); };
+
+    BankLibraryIO::parallelFor(numToHash, [&](int i)
+        {
+            if (threadShouldExit())
+                return;
+
+            const bool isSource = i < numFiles;
+            const auto& file = isSource ? files.getReference(i) : existing.getReference(i - numFiles);
+            auto& r = results[(size_t)i];
+
+            auto lib = std::make_shared<BankLibrary>();
+            if (!BankLibraryIO::read(file, *lib, shouldAbort))
+                r.error = "cannot read";
+            else if (isSource)
+                r.error = BankLibraryIO::validate(*lib)[0];
+
+            if (r.error.isEmpty())
+            {
+                if (options.dedupe)
+                    r.hash = fingerprint(*lib);
+                if (isSource)
+                    r.lib = std::move(lib);
+            }
+
+            if (isSource)
+            {
+                if (r.error.isNotEmpty())
+                    ++failed;
+                ++parsed;
+                postProgress(false);
+            }
+        });
+
+    // --- Повторы и нумерация: последовательно, в порядке исходных префиксов ---
+    std::unordered_map<juce::String, juce::File> byHash;
+    std::set<int> usedNumbers; // номера файлов BANK и уже выданные в этом импорте
+    int nextNumber = 1;
+    for (int i = 0; i < existing.size(); ++i)
+    {
+        const int number = BankFileIndex::getNumericPrefix(existing[i].getFileNameWithoutExtension());
+        if (number >= 0)
+            usedNumbers.insert(number);
+        nextNumber = juce::jmax(nextNumber, number + 1);
+        if (options.dedupe && results[(size_t)(numFiles + i)].hash.isNotEmpty())
+            byHash.emplace(results[(size_t)(numFiles + i)].hash, existing[i]);
+    }
+
+    if (options.firstNumber >= 0)
+        nextNumber = options.firstNumber;
+
+    Result result;
+    result.items.resize((size_t)numFiles);
+
+    for (int i = 0; i < numFiles; ++i)
+    {
+        auto& item = result.items[(size_t)i];
+        auto& r = results[(size_t)i];
+        item.source = files[i];
+
+        if (threadShouldExit())
+        {
+            result.cancelled = true;
+            continue; // Status::cancelled
+        }
+
+        if (r.error.isNotEmpty())
+        {
+            item.status = Item::Status::failed;
+            item.message = r.error;
+            ++result.failed;
+            continue;
+        }
+
+        if (options.dedupe)
+        {
+            if (auto it = byHash.find(r.hash); it != byHash.end())
+            {
+                item.status = Item::Status::duplicate;
+                item.target = it->second;
+                ++result.duplicates;
+                ++duplicates;
+                continue;
+            }
+        }
+
+        const auto ext = options.binary ? juce::String(BankLibraryIO::binaryExtension) : item.source.getFileExtension();
+        const auto title = stripNumericPrefix(item.source.getFileNameWithoutExtension());
+
+        // firstNumber может попасть на занятые номера — их пропускаем: номер занят,
+        // если с него начинается любой файл BANK (NEXT/PREV идут по номерам), а не только одноимённый
+        juce::File target;
+        do
+            target = bankDir.getChildFile(juce::String(nextNumber++) + " " + title + ext);
+        while (usedNumbers.count(nextNumber - 1) > 0 || target.exists());
+        usedNumbers.insert(nextNumber - 1);
+
+        writer.enqueue(target, std::move(r.lib));
+
+        item.status = Item::Status::imported;
+        item.target = target;
+        ++result.imported;
+        ++queued;
+        if (options.dedupe)
+            byHash.emplace(r.hash, target);
+
+        postProgress(false);
+    }
+
+    // итог сообщаем, когда всё импортированное уже на диске
+    writer.flush();
+
+    result.ms = ticksToMs(juce::Time::getHighResolutionTicks() - t0);
+    postProgress(true);
+
+    if (finishedCallback != nullptr)
+    {
+        juce::MessageManager::callAsync([alive = alive, callback = finishedCallback, result = std::move(result)]()
+            {
+                if (alive->load())
+                    callback(result);
+            });
+    }
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <JuceHeader.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+struct BankLibrary;
+class BankFileWriter;
+
+//==============================================================================
+// BankLibraryImporter — массовый импорт библиотек в папку BANK.
+// Файлы (*.xml / *.nxb, папки — рекурсивно) читаются, проверяются
+// (BankLibraryIO::validate) и получают отпечаток — SHA-256 .nxb-представления —
+// параллельно на общем пуле разбора; так же снимаются отпечатки библиотек,
+// уже лежащих в BANK. Повторы (внутри партии и с тем, что есть) пропускаются,
+// остальные нумеруются дальше последнего префикса папки ("N название") в
+// порядке исходных префиксов и пишутся через BankFileWriter
+// (temp → fsync → rename). Всё выполняется на собственном потоке; ход и итог
+// приходят колбэками в message thread, поэтому UI не ждёт.
+//==============================================================================
+class BankLibraryImporter : private juce::Thread
+{
+public:
+    struct Options
+    {
+        bool dedupe = true;          // пропускать библиотеки, совпадающие с уже импортированными/имеющимися
+        bool binary = false;         // писать .nxb; false — в формате исходного файла
+        int firstNumber = -1;        // первый префикс; -1 — следующий после последнего в папке
+    };
+
+    struct Progress
+    {
+        int total = 0;
+        int parsed = 0;              // прочитано и проверено (в том числе с ошибкой)
+        int queued = 0;              // отдано BankFileWriter
+        int failed = 0;
+        int duplicates = 0;
+    };
+
+    struct Item
+    {
+        enum class Status { imported, duplicate, failed, cancelled };
+
+        juce::File source;
+        juce::File target;           // imported: куда записан; duplicate: с чем совпал
+        Status status = Status::cancelled;
+        juce::String message;        // failed: первая ошибка
+    };
+
+    struct Result
+    {
+        std::vector<Item> items;     // в порядке импорта
+        int imported = 0;
+        int duplicates = 0;
+        int failed = 0;
+        bool cancelled = false;
+        double ms = 0.0;
+    };
+
+    using ProgressCallback = std::function<void(const Progress&)>;
+    using FinishedCallback = std::function<void(const Result&)>;
+
+    explicit BankLibraryImporter(BankFileWriter& writer);
+    ~BankLibraryImporter() override;
+
+    /** Запускает импорт sources в bankDir; false — предыдущий ещё идёт.
+        Колбэки вызываются только в message thread. */
+    bool start(const juce::Array<juce::File>& sources, const juce::File& bankDir, const Options& options,
+               ProgressCallback onProgress, FinishedCallback onFinished);
+
+    /** Прерывает импорт: уже отданное писателю дописывается, остальное — cancelled. */
+    void cancel();
+
+    bool isImporting() const { return isThreadRunning(); }
+
+    /** "12 Strings.xml" → "Strings": без числового префикса и разделителей. */
+    static juce::String stripNumericPrefix(const juce::String& name);
+
+    /** Не чаще раза в столько мс ход импорта уходит в message thread. */
+    static constexpr int progressIntervalMs = 100;
+
+private:
+    void run() override;
+    void postProgress(bool force);
+
+    BankFileWriter& writer;
+
+    juce::Array<juce::File> sources;
+    juce::File bankDir;
+    Options options;
+    ProgressCallback progressCallback;
+    FinishedCallback finishedCallback;
+
+    std::atomic<int> total{ 0 }, parsed{ 0 }, queued{ 0 }, failed{ 0 }, duplicates{ 0 };
+    std::atomic<juce::uint32> lastProgressPost{ 0 };
+
+    // shared — колбэки, уже стоящие в очереди message thread, проверяют его после удаления импортёра
+    std::shared_ptr<std::atomic<bool>> alive;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(BankLibraryImporter)
+};
@@ -0,0 +1,213 @@
+#include "bank_library_loader.h"
+#include "bank_library.h"
+#include "bank_library_cache.h"
+#include <algorithm>
+
+BankLibraryLoader::BankLibraryLoader(BankLibraryCache* cacheToFill)
+    : juce::Thread("BankLibraryLoader"),
+      cache(cacheToFill),
+      latestGeneration(std::make_shared<std::atomic<uint32_t>>(0)),
+      deliveredGeneration(std::make_shared<std::atomic<uint32_t>>(0))
+{
+    startThread();
+}
+
+BankLibraryLoader::~BankLibraryLoader()
+{
+    cancelPending();
+    signalThreadShouldExit();
+    wakeUp.signal();
+    stopThread(4000);
+}
+
+void BankLibraryLoader::requestLoad(const juce::File& file, Callback onLoaded,
+                                    PartialCallback onActiveBankReady, BankCallback onBankReady)
+{
+    {
+        const juce::ScopedLock sl(lock);
+        pendingFile = file;
+        pendingCallback = std::move(onLoaded);
+        pendingPartialCallback = std::move(onActiveBankReady);
+        pendingBankCallback = std::move(onBankReady);
+        pendingBumps.clear();
+        pendingGeneration = ++(*latestGeneration);
+        hasPending = true;
+    }
+
+    wakeUp.signal();
+}
+
+void BankLibraryLoader::prioritiseBank(int bankIndex)
+{
+    const juce::ScopedLock sl(lock);
+    if (hasPending)
+        pendingBumps.push_back(bankIndex);   // текущий разбор уже устарел
+    else if (currentOrder != nullptr)
+        currentOrder->bump(bankIndex);
+}
+
+void BankLibraryLoader::cancelPending()
+{
+    const juce::ScopedLock sl(lock);
+    hasPending = false;
+    pendingCallback = nullptr;
+    pendingPartialCallback = nullptr;
+    pendingBankCallback = nullptr;
+    pendingBumps.clear();
+    deliveredGeneration->store(++(*latestGeneration));
+}
+
+bool BankLibraryLoader::isLoading() const noexcept
+{
+    return latestGeneration->load() != deliveredGeneration->load();
+}
+
+void BankLibraryLoader::run()
+{
+    while (!threadShouldExit())
+    {
+        juce::File file;
+        Callback callback;
+        PartialCallback partialCallback;
+        BankCallback bankCallback;
+        uint32_t generation = 0;
+
+        auto latest = latestGeneration;
+        auto lib = std::make_shared<BankLibrary>();
+
+        // --- Постепенная выдача: вызывается на потоках разбора по мере готовности банков ---
+        juce::CriticalSection deliveryLock;
+        std::vector<char> ready;
+        bool partialSent = false;
+
+        BankLibraryIO::BankReadOrder order([&](int bankIndex, const BankLibraryIO::Bank&)
+            {
+                if (latest->load() != generation)
+                    return;
+
+                const juce::ScopedLock dl(deliveryLock);
+
+                // заготовка уже ушла — банк отдаётся сам по себе (слот в lib больше не меняется)
+                if (partialSent)
+                {
+                    juce::MessageManager::callAsync([latest, generation, lib, bankIndex, bankCallback]()
+                        {
+                            if (latest->load() == generation && bankCallback != nullptr)
+                                bankCallback(bankIndex, *lib);
+                        });
+                    return;
+                }
+
+                // до активного банка могли успеть поднятые (prioritiseBank) — войдут в заготовку
+                if (ready.empty())
+                    ready.assign(lib->banks.size(), 0);
+                ready[(size_t)bankIndex] = 1;
+
+                if (bankIndex != lib->activeBankIndex)
+                    return;
+
+                // заголовок и глобальные данные к первому BankReady прочитаны и не меняются
+                auto partial = std::make_shared<BankLibrary>();
+                partial->numPresets = lib->numPresets;
+                partial->activeBankIndex = lib->activeBankIndex;
+                partial->activePreset = lib->activePreset;
+                partial->pluginName = lib->pluginName;
+                partial->pluginId = lib->pluginId;
+                partial->activeProgram = lib->activeProgram;
+                partial->pluginParamValues = lib->pluginParamValues;
+                partial->pluginDefaults = lib->pluginDefaults;
+                partial->pluginState = lib->pluginState;
+                partial->banks.assign(lib->banks.size(), BankLibraryIO::Bank(lib->numPresets));
+
+                std::vector<int> pending;
+                for (size_t i = 0; i < ready.size(); ++i)
+                {
+                    if (ready[i] != 0) partial->banks[i] = lib->banks[i];
+                    else               pending.push_back((int)i);
+                }
+
+                // state активного банка распаковываем здесь, а не в applyBankToPlugin
+                partial->banks[(size_t)bankIndex].pluginState.getDecoded();
+                partialSent = true;
+
+                juce::MessageManager::callAsync([latest, generation, partial, pending = std::move(pending), file, partialCallback]()
+                    {
+                        if (latest->load() == generation)
+                            partialCallback(partial, pending, file);
+                    });
+            });
+
+        {
+            const juce::ScopedLock sl(lock);
+            if (hasPending)
+            {
+                file = pendingFile;
+                callback = std::move(pendingCallback);
+                partialCallback = std::move(pendingPartialCallback);
+                bankCallback = std::move(pendingBankCallback);
+                generation = pendingGeneration;
+                hasPending = false;
+
+                for (const int bank : pendingBumps)
+                    order.bump(bank);
+                pendingBumps.clear();
+                currentOrder = &order;
+            }
+        }
+
+        if (callback == nullptr)
+        {
+            wakeUp.wait(-1);
+            continue;
+        }
+
+        auto isStale = [this, latest, generation]
+            {
+                return threadShouldExit() || latest->load() != generation;
+            };
+
+        // отметка для кэша снимается до чтения: она не новее прочитанного
+        const auto stampSize = file.getSize();
+        const auto stampTime = file.getLastModificationTime();
+
+        const bool ok = BankLibraryIO::read(file, *lib, isStale, partialCallback != nullptr ? &order : nullptr);
+
+        {
+            const juce::ScopedLock sl(lock);
+            currentOrder = nullptr;
+        }
+
+        if (isStale())
+            continue; // пришёл более новый запрос — результат никому не нужен
+
+        // с BankReadOrder читатель старую полную раскладку не приводит: отданные банки
+        // ещё читает message thread — приводим копию, она и уходит дальше
+        if (ok && partialCallback != nullptr
+            && std::any_of(lib->banks.begin(), lib->banks.end(), [](const BankLibraryIO::Bank& b) { return !b.pluginParamValues.empty(); }))
+        {
+            auto compacted = std::make_shared<BankLibrary>(*lib);
+            BankLibraryIO::compactParamValues(*compacted);
+            lib = std::move(compacted);
+        }
+
+        // state активного банка распаковываем здесь, а не в applyBankToPlugin
+        if (ok && juce::isPositiveAndBelow(lib->activeBankIndex, (int)lib->banks.size()))
+            lib->banks[(size_t)lib->activeBankIndex].pluginState.getDecoded();
+
+        // в кэш — копия: присланную библиотеку редактор разберёт на части (swap)
+        if (ok && cache != nullptr)
+            cache->insert(file, stampSize, stampTime, std::make_shared<const BankLibrary>(*lib));
+
+        // колбэки банков уже в очереди message thread — эта доставка придёт после них
+        juce::MessageManager::callAsync([latest, delivered = deliveredGeneration, generation,
+                                         lib = ok ? lib : std::shared_ptr<BankLibrary>(), file, callback]()
+            {
+                // пока сообщение шло, мог прийти новый запрос
+                if (latest->load() != generation)
+                    return;
+
+                delivered->store(generation);
+                callback(lib, file);
+            });
+    }
+}
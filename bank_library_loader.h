@@ -0,0 +1,80 @@
+#pragma once
+#include <JuceHeader.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+struct BankLibrary;
+class BankLibraryCache;
+namespace BankLibraryIO { class BankReadOrder; }
+
+//==============================================================================
+// BankLibraryLoader — фоновая загрузка библиотек банков.
+// Файл читается и разбирается на собственном потоке в новый BankLibrary;
+// результат отдаётся колбэком в message thread. Каждый новый запрос
+// отменяет предыдущий (быстрые NEXT/PREV): устаревший разбор прерывается,
+// а его результат не публикуется.
+// Прочитанные библиотеки (копией) кладутся в BankLibraryCache, если он задан.
+//
+// Постепенная загрузка (onActiveBankReady): первым разбирается активный банк,
+// и как только он готов, в message thread уходит «заготовка» — заголовок,
+// глобальные данные и этот банк (остальные слоты пустые, их индексы — в
+// pendingBanks). Прочие банки приходят по одному через onBankReady, по мере
+// разбора; prioritiseBank() поднимает нужный банк в начало очереди.
+// onLoaded в конце, как и раньше, получает библиотеку целиком.
+//==============================================================================
+class BankLibraryLoader : private juce::Thread
+{
+public:
+    /** lib == nullptr — файл не прочитан. Вызывается только в message thread. */
+    using Callback = std::function<void(std::shared_ptr<BankLibrary> lib, const juce::File& file)>;
+
+    /** Заготовка библиотеки: pendingBanks — слоты, которые ещё разбираются. */
+    using PartialCallback = std::function<void(std::shared_ptr<BankLibrary> lib, std::vector<int> pendingBanks,
+                                               const juce::File& file)>;
+
+    /** Очередной банк заготовки разобран: source.banks[bankIndex] готов и больше не меняется
+        (остальные слоты source ещё могут заполняться — их не трогать). */
+    using BankCallback = std::function<void(int bankIndex, const BankLibrary& source)>;
+
+    explicit BankLibraryLoader(BankLibraryCache* cache = nullptr);
+    ~BankLibraryLoader() override;
+
+    /** Ставит файл в очередь, отменяя все предыдущие запросы.
+        onActiveBankReady/onBankReady (необязательные) — постепенная загрузка, см. выше. */
+    void requestLoad(const juce::File& file, Callback onLoaded,
+                     PartialCallback onActiveBankReady = {}, BankCallback onBankReady = {});
+
+    /** Разобрать банк текущего (или ожидающего) запроса следующим. */
+    void prioritiseBank(int bankIndex);
+
+    /** Отменяет ожидающий/текущий запрос без запуска нового. */
+    void cancelPending();
+
+    /** true, пока последний запрос не доставлен (или не отменён). */
+    bool isLoading() const noexcept;
+
+private:
+    void run() override;
+
+    juce::CriticalSection lock;
+    juce::File pendingFile;
+    Callback pendingCallback;
+    PartialCallback pendingPartialCallback;
+    BankCallback pendingBankCallback;
+    std::vector<int> pendingBumps;                      // prioritiseBank до начала разбора
+    BankLibraryIO::BankReadOrder* currentOrder = nullptr; // под lock, живёт на стеке run()
+    uint32_t pendingGeneration = 0;
+    bool hasPending = false;
+
+    juce::WaitableEvent wakeUp;
+    BankLibraryCache* const cache;
+
+    // shared — чтобы колбэки, уже стоящие в очереди message thread,
+    // могли проверить актуальность и после удаления загрузчика
+    std::shared_ptr<std::atomic<uint32_t>> latestGeneration;
+    std::shared_ptr<std::atomic<uint32_t>> deliveredGeneration;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(BankLibraryLoader)
+};
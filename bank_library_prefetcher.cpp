@@ -0,0 +1,236 @@
+#include "bank_library_prefetcher.h"
+#include "bank_library.h"
+#include <algorithm>
+
+BankLibraryPrefetcher::BankLibraryPrefetcher()
+    : juce::Thread("BankLibraryPrefetcher")
+{
+    startThread();
+}
+
+BankLibraryPrefetcher::~BankLibraryPrefetcher()
+{
+    signalThreadShouldExit();
+    wakeUp.signal();
+    stopThread(4000);
+}
+
+void BankLibraryPrefetcher::prefetch(const juce::Array<juce::File>& files)
+{
+    std::vector<Request> requests;
+    for (const auto& f : files)
+        requests.push_back({ f, {} });
+
+    prefetch(requests);
+}
+
+void BankLibraryPrefetcher::prefetch(const std::vector<Request>& requests)
+{
+    {
+        const juce::ScopedLock sl(lock);
+
+        std::vector<Entry> next;
+        std::vector<std::vector<int>> stagedBefore; // по next: что уже распаковано
+        for (const auto& r : requests)
+        {
+            const auto& f = r.file;
+            if (f == juce::File())
+                continue;
+
+            // один файл в нескольких запросах (песни из одной библиотеки) — банки объединяются
+            auto dup = std::find_if(next.begin(), next.end(), [&f](const Entry& e) { return e.file == f; });
+            if (dup == next.end())
+            {
+                auto it = std::find_if(entries.begin(), entries.end(), [&f](const Entry& e) { return e.file == f; });
+                if (it != entries.end())
+                    next.push_back(std::move(*it)); // уже прочитана (или в очереди) — оставляем
+                else
+                    next.push_back({ f });
+
+                dup = next.end() - 1;
+                stagedBefore.push_back(dup->staged ? std::move(dup->stageBanks) : std::vector<int>());
+                dup->stageBanks.clear();
+            }
+
+            const auto& before = stagedBefore[(size_t)(dup - next.begin())];
+            for (const int bank : r.stageBanks)
+            {
+                if (std::find(dup->stageBanks.begin(), dup->stageBanks.end(), bank) != dup->stageBanks.end())
+                    continue;
+
+                dup->stageBanks.push_back(bank);
+                if (std::find(before.begin(), before.end(), bank) == before.end())
+                    dup->staged = false;
+            }
+        }
+
+        entries.swap(next);
+        ++generation;
+
+        stats.entries = (int)entries.size();
+        stats.bytesCached = 0;
+        for (const auto& e : entries)
+            stats.bytesCached += e.bytes;
+    }
+
+    wakeUp.signal();
+}
+
+std::shared_ptr<const BankLibrary> BankLibraryPrefetcher::take(const juce::File& file)
+{
+    const juce::ScopedLock sl(lock);
+
+    auto it = std::find_if(entries.begin(), entries.end(), [&file](const Entry& e) { return e.file == file; });
+    if (it != entries.end() && it->lib != nullptr)
+    {
+        if (file.getSize() == it->stampSize && file.getLastModificationTime() == it->stampTime)
+        {
+            ++stats.hits;
+            DBG("[Prefetch] hit " << file.getFileName() << " (hits " << stats.hits << ", misses " << stats.misses << ")");
+            return it->lib;
+        }
+
+        // файл изменился после чтения — перечитаем, если он снова понадобится
+        stats.bytesCached -= it->bytes;
+        it->lib.reset();
+        it->bytes = 0;
+    }
+
+    ++stats.misses;
+    DBG("[Prefetch] miss " << file.getFileName() << " (hits " << stats.hits << ", misses " << stats.misses << ")");
+    return nullptr;
+}
+
+void BankLibraryPrefetcher::setMemoryBudget(juce::int64 bytes)
+{
+    const juce::ScopedLock sl(lock);
+    memoryBudget = bytes;
+    trimToBudgetLocked();
+}
+
+juce::int64 BankLibraryPrefetcher::getMemoryBudget() const
+{
+    const juce::ScopedLock sl(lock);
+    return memoryBudget;
+}
+
+BankLibraryPrefetcher::Stats BankLibraryPrefetcher::getStats() const
+{
+    const juce::ScopedLock sl(lock);
+    return stats;
+}
+
+// Вызывается под lock: сначала освобождаются дальние соседи (конец списка)
+void BankLibraryPrefetcher::trimToBudgetLocked()
+{
+    for (auto it = entries.rbegin(); it != entries.rend() && stats.bytesCached > memoryBudget; ++it)
+    {
+        if (it->lib == nullptr)
+            continue;
+
+        stats.bytesCached -= it->bytes;
+        it->lib.reset();
+        it->bytes = 0;
+    }
+}
+
+void BankLibraryPrefetcher::stage(const BankLibrary& lib, const std::vector<int>& banks)
+{
+    // state активного банка распаковываем заранее — как и загрузчик
+    if (juce::isPositiveAndBelow(lib.activeBankIndex, (int)lib.banks.size()))
+        lib.banks[(size_t)lib.activeBankIndex].pluginState.getDecoded();
+
+    for (const int bank : banks)
+        if (juce::isPositiveAndBelow(bank, (int)lib.banks.size()))
+            lib.banks[(size_t)bank].pluginState.getDecoded();
+}
+
+void BankLibraryPrefetcher::run()
+{
+    while (!threadShouldExit())
+    {
+        juce::File file;
+        std::vector<int> stageBanks;
+        std::shared_ptr<const BankLibrary> toStage;
+        uint32_t startedGeneration = 0;
+
+        {
+            const juce::ScopedLock sl(lock);
+            for (const auto& e : entries)
+            {
+                if (e.lib == nullptr)
+                {
+                    file = e.file;
+                    stageBanks = e.stageBanks;
+                    break;
+                }
+
+                // прочитана раньше, а банки для распаковки добавились позже
+                if (!e.staged && toStage == nullptr)
+                {
+                    toStage = e.lib;
+                    stageBanks = e.stageBanks;
+                }
+            }
+            startedGeneration = generation;
+        }
+
+        if (file == juce::File() && toStage != nullptr)
+        {
+            stage(*toStage, stageBanks);
+
+            const juce::ScopedLock sl(lock);
+            for (auto& e : entries)
+                if (e.lib == toStage && e.stageBanks == stageBanks)
+                    e.staged = true;
+            continue;
+        }
+
+        if (file == juce::File())
+        {
+            wakeUp.wait(-1);
+            continue;
+        }
+
+        // отметка берётся до чтения: она не новее прочитанного содержимого
+        const auto stampSize = file.getSize();
+        const auto stampTime = file.getLastModificationTime();
+
+        auto isStale = [this, startedGeneration]
+            {
+                if (threadShouldExit())
+                    return true;
+                const juce::ScopedLock sl(lock);
+                return generation != startedGeneration;
+            };
+
+        auto lib = std::make_shared<BankLibrary>();
+        const bool ok = file.existsAsFile() && BankLibraryIO::read(file, *lib, isStale);
+
+        if (ok)
+            stage(*lib, stageBanks);
+
+        const auto bytes = ok ? BankLibraryIO::estimateMemoryBytes(*lib) : 0;
+
+        const juce::ScopedLock sl(lock);
+        auto it = std::find_if(entries.begin(), entries.end(), [&file](const Entry& e) { return e.file == file; });
+        if (it == entries.end() || it->lib != nullptr)
+            continue; // файл больше не сосед — результат не нужен
+
+        if (!ok || bytes > memoryBudget - stats.bytesCached)
+        {
+            // не читается или не помещается в бюджет — больше не пытаемся
+            DBG("[Prefetch] skipped " << file.getFileName());
+            entries.erase(it);
+            stats.entries = (int)entries.size();
+            continue;
+        }
+
+        it->stampSize = stampSize;
+        it->stampTime = stampTime;
+        it->bytes = bytes;
+        it->lib = std::move(lib);
+        it->staged = it->stageBanks == stageBanks;
+        stats.bytesCached += bytes;
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <JuceHeader.h>
+#include <memory>
+#include <vector>
+
+struct BankLibrary;
+
+//==============================================================================
+// BankLibraryPrefetcher — заранее разобранные соседние библиотеки.
+// После загрузки библиотеки редактор называет её соседей по NEXT/PREV;
+// они читаются и разбираются на отдельном потоке и держатся в памяти
+// в пределах бюджета. NEXT/PREV, попавший в готовую библиотеку, сразу
+// переходит к применению, без чтения файла.
+// Перед выдачей сверяются размер и время изменения файла: изменённый
+// (или перезаписанный STORE) файл считается промахом.
+// Кроме активного банка можно заранее распаковать state других банков
+// (Request::stageBanks) — так сет-лист держит следующую песню готовой.
+//==============================================================================
+class BankLibraryPrefetcher : private juce::Thread
+{
+public:
+    struct Stats
+    {
+        int hits = 0;
+        int misses = 0;
+        int entries = 0;
+        juce::int64 bytesCached = 0;
+    };
+
+    struct Request
+    {
+        juce::File file;
+        std::vector<int> stageBanks;    // банки, чей state распаковать заранее (активный — всегда)
+    };
+
+    BankLibraryPrefetcher();
+    ~BankLibraryPrefetcher() override;
+
+    /** Новый набор соседей: остальные записи отбрасываются, недостающие ставятся в очередь. */
+    void prefetch(const juce::Array<juce::File>& files);
+    void prefetch(const std::vector<Request>& requests);
+
+    /** Готовая библиотека для файла (и +1 к попаданиям) или nullptr (+1 к промахам). */
+    std::shared_ptr<const BankLibrary> take(const juce::File& file);
+
+    /** Предел памяти под разобранные библиотеки (оценка BankLibraryIO::estimateMemoryBytes). */
+    void setMemoryBudget(juce::int64 bytes);
+    juce::int64 getMemoryBudget() const;
+
+    Stats getStats() const;
+
+    static constexpr juce::int64 defaultMemoryBudget = 64 * 1024 * 1024;
+
+private:
+    struct Entry
+    {
+        juce::File file;
+        juce::int64 stampSize = 0;
+        juce::Time stampTime;
+        juce::int64 bytes = 0;
+        std::shared_ptr<const BankLibrary> lib; // nullptr — ещё не прочитана
+        std::vector<int> stageBanks;
+        bool staged = false;                    // state'ы stageBanks распакованы
+    };
+
+    void run() override;
+    static void stage(const BankLibrary& lib, const std::vector<int>& banks);
+    void trimToBudgetLocked();
+
+    juce::CriticalSection lock;
+    std::vector<Entry> entries;     // в порядке приоритета соседей
+    juce::int64 memoryBudget = defaultMemoryBudget;
+    uint32_t generation = 0;        // меняется с каждым prefetch(): прерывает устаревшее чтение
+    Stats stats;
+
+    juce::WaitableEvent wakeUp;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(BankLibraryPrefetcher)
+};
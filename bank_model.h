@@ -0,0 +1,169 @@
+#pragma once
+#include <JuceHeader.h>
+#include <array>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include "plugin_state_ref.h"
+#include "SetCCDialog.h" // CCMapping — единственное определение, общее с диалогом назначения CC
+
+//==============================================================================
+// Модель банка: банк, мэппинги CC пресетов и пределы размеров библиотеки.
+// Её включают и BankEditor, и BankLibrary/BankLibraryIO. Из GUI сюда попадает
+// только SetCCDialog.h (ради CCMapping) — хост плагинов, LearnController,
+// FileManager и <windows.h> консольной цели bank_tool не нужны.
+//==============================================================================
+
+struct PresetCCMapping
+{
+    uint8_t ccValue = 64;
+    bool enabled = false;
+    bool invert = false; // добавляем поле invert
+
+    bool operator==(const PresetCCMapping& o) const noexcept { return ccValue == o.ccValue && enabled == o.enabled && invert == o.invert; }
+    bool operator!=(const PresetCCMapping& o) const noexcept { return !(*this == o); }
+};
+
+namespace BankModel
+{
+    // Число банков и пресетов задаёт библиотека (BankLibrary); здесь — значения
+    // для новой библиотеки и пределы. numCCParams — раскладка контроллера (10 CC + 4 педали).
+    constexpr int defaultNumPresets = 6;
+    constexpr int defaultNumBanks = 20;
+    constexpr int maxPresets = 8;   // кнопок пресетов в строке UI
+    constexpr int maxBanks = 128;
+    constexpr int numCCParams = 14;
+
+    using PresetCCRow = std::array<PresetCCMapping, numCCParams>;
+
+    /** Значения параметров по умолчанию — один вектор на плагин (ключ — нормализованный pluginId). */
+    using ParamDefaults = std::map<juce::String, std::vector<float>>;
+
+    struct Bank
+    {
+        // --- Пользовательские данные ---
+        juce::String  bankName{ "PRESET" };
+        juce::String  pluginName{ "None" };
+        std::vector<juce::String> presetNames;   // размер — число пресетов библиотеки
+        int           activeProgram = -1;
+
+        std::vector<float>             presetVolumes;   // пусто — у всех пресетов 1.0
+        std::array<CCMapping, numCCParams> globalCCMappings;
+        // Строки CC всех пресетов — фиксированный массив на maxPresets: onPluginParameterChanged
+        // читает его из аудио-потока, поэтому без выделений и поиска по контейнеру.
+        // Действительны первые getNumPresets() строк, остальные — по умолчанию.
+        std::array<PresetCCRow, maxPresets> presetCCMappings {};
+        std::vector<float> pluginParamValues;   // старая полная раскладка; после чтения пусто (см. paramDiffs)
+
+        // --- Технические данные ---
+        juce::String  pluginId;
+        PluginStateRef pluginState;      // декодируется при первом обращении
+        std::unordered_map<int, float> paramDiffs; // параметры, отличные от ParamDefaults плагина банка
+
+        // --- Конструктор ---
+        explicit Bank(int numPresets = defaultNumPresets)
+        {
+            setNumPresets(numPresets);
+
+            for (int i = 0; i < numCCParams; ++i)
+                globalCCMappings[i].name = "<none>";
+        }
+
+        int getNumPresets() const noexcept { return (int)presetNames.size(); }
+
+        /** Меняет число пресетов: новые получают имена "Scene N", лишние строки CC сбрасываются. */
+        void setNumPresets(int numPresets)
+        {
+            numPresets = juce::jlimit(1, maxPresets, numPresets);
+
+            for (int i = (int)presetNames.size(); i < numPresets; ++i)
+                presetNames.push_back("Scene " + juce::String(i + 1));
+            presetNames.resize((size_t)numPresets);
+
+            if (!presetVolumes.empty())
+                presetVolumes.resize((size_t)numPresets, 1.0f);
+
+            for (int p = numPresets; p < maxPresets; ++p)
+                presetCCMappings[(size_t)p] = PresetCCRow{};
+        }
+
+        /** Мэппинг CC в пресете (безопасно и из аудио-потока). */
+        const PresetCCMapping& getPresetCC(int preset, int cc) const
+        {
+            jassert(juce::isPositiveAndBelow(preset, maxPresets) && juce::isPositiveAndBelow(cc, numCCParams));
+            return presetCCMappings[(size_t)preset][(size_t)cc];
+        }
+
+        PresetCCMapping& editPresetCC(int preset, int cc)
+        {
+            jassert(juce::isPositiveAndBelow(preset, getNumPresets()) && juce::isPositiveAndBelow(cc, numCCParams));
+            return presetCCMappings[(size_t)preset][(size_t)cc];
+        }
+
+        /** Строка пресета отличается от значений по умолчанию — её пишут в файл. */
+        bool hasPresetRow(int preset) const
+        {
+            return presetCCMappings[(size_t)preset] != PresetCCRow{};
+        }
+
+        // --- Совместимость с раскладкой на 6 пресетов (Rig_control, LearnController) ---
+        /** Бывший ccPresetStates[preset][cc] — он повторял enabled. */
+        bool getCCPresetState(int preset, int cc) const { return getPresetCC(preset, cc).enabled; }
+
+        /** Имя пресета; за пределами getNumPresets() — пустая строка (не выход за вектор). */
+        juce::String getPresetName(int preset) const
+        {
+            return juce::isPositiveAndBelow(preset, getNumPresets()) ? presetNames[(size_t)preset] : juce::String();
+        }
+
+        /** Громкость пресета; пустой presetVolumes и пресет за пределами — 1.0. */
+        float getPresetVolume(int preset) const
+        {
+            return juce::isPositiveAndBelow(preset, (int)presetVolumes.size()) ? presetVolumes[(size_t)preset] : 1.0f;
+        }
+
+        /** Ничего не задано — в файле банк можно не хранить: читатель создаст такой же. */
+        bool isEmpty() const
+        {
+            return bankName == Bank().bankName && activeProgram < 0 && paramDiffs.empty()
+                && pluginState.isEmpty() && *this == Bank(getNumPresets());
+        }
+
+        // --- Сравнение для мигания Store ---
+        bool operator==(const Bank& other) const
+        {
+            if (bankName.trim().toLowerCase() != other.bankName.trim().toLowerCase())
+                return false;
+
+            if (pluginName != other.pluginName) return false;
+            if (pluginId != other.pluginId) return false;
+       
+            if (presetNames != other.presetNames)
+                return false;
+
+            if (presetVolumes != other.presetVolumes) return false;
+
+            for (int i = 0; i < numCCParams; ++i)
+            {
+                if (globalCCMappings[i].name != other.globalCCMappings[i].name) return false;
+                if (globalCCMappings[i].paramIndex != other.globalCCMappings[i].paramIndex) return false;
+            }
+
+            // строка, выделенная, но оставшаяся по умолчанию, равна отсутствующей
+            for (int p = 0; p < getNumPresets(); ++p)
+                for (int i = 0; i < numCCParams; ++i)
+                    if (getPresetCC(p, i) != other.getPresetCC(p, i))
+                        return false;
+
+            if (pluginParamValues != other.pluginParamValues) return false;
+            if (paramDiffs != other.paramDiffs) return false;
+
+            return true;
+        }
+
+        bool operator!=(const Bank& other) const
+        {
+            return !(*this == other);
+        }
+    };
+}
@@ -0,0 +1,465 @@
+#include "bank_search_index.h"
+#include "bank_library.h"
+#include <algorithm>
+#include <unordered_set>
+
+namespace
+{
+    constexpr int maxPresets = BankModel::maxPresets;   // по биту на пресет в маске банка
+    constexpr int numCCParams = BankModel::numCCParams;
+
+    constexpr uint32_t bankLevelBit = 0x80000000u; // совпал сам банк (имя, плагин, CC), а не пресет
+
+    uint64_t bankKey(uint32_t fileId, int bank)
+    {
+        return ((uint64_t)fileId << 16) | (uint64_t)(uint16_t)bank;
+    }
+
+    // Совпадения одного слова запроса
+    struct TermMatch
+    {
+        std::unordered_set<uint32_t> files;              // по имени библиотеки
+        std::unordered_map<uint64_t, uint32_t> banks;    // bankKey → биты пресетов | bankLevelBit
+    };
+}
+
+BankSearchIndex::BankSearchIndex()
+    : juce::Thread("BankSearchIndex")
+{
+    startThread();
+}
+
+BankSearchIndex::~BankSearchIndex()
+{
+    signalThreadShouldExit();
+    wakeUp.signal();
+    stopThread(4000);
+}
+
+void BankSearchIndex::setDirectory(const juce::File& dir)
+{
+    {
+        const juce::ScopedLock sl(lock);
+        directory = dir;
+        files.clear();
+        fileIdByPath.clear();
+        docs.clear();
+        postings.clear();
+        deadDocs = 0;
+        ready = false;
+        stats = {};
+    }
+
+    wakeUp.signal();
+}
+
+void BankSearchIndex::refresh()
+{
+    wakeUp.signal();
+}
+
+bool BankSearchIndex::isReady() const
+{
+    const juce::ScopedLock sl(lock);
+    return ready;
+}
+
+BankSearchIndex::Stats BankSearchIndex::getStats() const
+{
+    const juce::ScopedLock sl(lock);
+    return stats;
+}
+
+juce::StringArray BankSearchIndex::tokenize(const juce::String& text)
+{
+    juce::StringArray words;
+    const auto lower = text.toLowerCase();
+
+    for (auto p = lower.getCharPointer(); !p.isEmpty();)
+    {
+        while (!p.isEmpty() && !juce::CharacterFunctions::isLetterOrDigit(*p))
+            ++p;
+
+        const auto start = p;
+        while (!p.isEmpty() && juce::CharacterFunctions::isLetterOrDigit(*p))
+            ++p;
+
+        if (p != start)
+            words.add(juce::String(start, p));
+    }
+
+    words.removeDuplicates(false);
+    return words;
+}
+
+//==============================================================================
+std::vector<BankSearchIndex::Hit> BankSearchIndex::search(const juce::String& query, int maxHits) const
+{
+    const auto words = tokenize(query);
+    if (words.isEmpty() || maxHits <= 0)
+        return {};
+
+    struct Scored
+    {
+        uint32_t fileId;
+        int bank, preset, score;
+    };
+
+    const juce::ScopedLock sl(lock);
+
+    std::vector<TermMatch> matches((size_t)words.size());
+    for (int w = 0; w < words.size(); ++w)
+    {
+        auto& m = matches[(size_t)w];
+        for (auto it = postings.lower_bound(words[w]); it != postings.end() && it->first.startsWith(words[w]); ++it)
+        {
+            for (auto docId : it->second)
+            {
+                const auto& d = docs[docId];
+                if (!files[d.fileId].alive)
+                    continue;
+
+                if (d.bank < 0)
+                    m.files.insert(d.fileId);
+                else
+                    m.banks[bankKey(d.fileId, d.bank)] |= d.preset >= 0 ? (1u << d.preset) : bankLevelBit;
+            }
+        }
+    }
+
+    std::vector<Scored> scored;
+
+    // Банк подходит, если каждое слово есть в нём самом, в его пресете или в имени библиотеки
+    std::unordered_set<uint64_t> candidates;
+    for (const auto& m : matches)
+        for (const auto& [key, bits] : m.banks)
+            candidates.insert(key);
+
+    for (auto key : candidates)
+    {
+        const auto fileId = (uint32_t)(key >> 16);
+        int presetWords[maxPresets] = {};
+        int inBank = 0;
+        bool all = true;
+
+        for (const auto& m : matches)
+        {
+            auto it = m.banks.find(key);
+            if (it == m.banks.end())
+            {
+                all = m.files.count(fileId) != 0;
+                if (!all)
+                    break;
+                continue;
+            }
+
+            ++inBank;
+            for (int p = 0; p < maxPresets; ++p)
+                presetWords[p] += (it->second >> p) & 1u;
+        }
+
+        if (!all)
+            continue;
+
+        // пресет, в котором совпало больше всего слов
+        const auto best = std::max_element(presetWords, presetWords + maxPresets);
+        const int preset = *best > 0 ? (int)(best - presetWords) : -1;
+        scored.push_back({ fileId, (int)(key & 0xffff), preset, inBank + 2 * (preset >= 0 ? *best : 0) });
+    }
+
+    // Все слова — в имени библиотеки
+    for (auto fileId : matches[0].files)
+    {
+        if (std::all_of(matches.begin() + 1, matches.end(), [fileId](const TermMatch& m) { return m.files.count(fileId) != 0; }))
+            scored.push_back({ fileId, -1, -1, 0 });
+    }
+
+    std::sort(scored.begin(), scored.end(), [this](const Scored& a, const Scored& b)
+        {
+            if (a.score != b.score)
+                return a.score > b.score;
+            if (a.fileId != b.fileId)
+                return files[a.fileId].file < files[b.fileId].file;
+            if (a.bank != b.bank)
+                return a.bank < b.bank;
+            return a.preset < b.preset;
+        });
+
+    if ((int)scored.size() > maxHits)
+        scored.resize((size_t)maxHits);
+
+    std::vector<Hit> hits;
+    hits.reserve(scored.size());
+    for (const auto& s : scored)
+    {
+        Doc d;
+        d.fileId = s.fileId;
+        d.bank = (int16_t)s.bank;
+        d.preset = (int16_t)s.preset;
+        hits.push_back({ files[s.fileId].file, s.bank, s.preset, describeLocked(d) });
+    }
+
+    return hits;
+}
+
+juce::String BankSearchIndex::describeLocked(const Doc& d) const
+{
+    const auto& labels = files[d.fileId].labels;
+    juce::String text = labels.library;
+
+    if (d.bank >= 0 && d.bank < labels.banks.size())
+    {
+        text << " / " << juce::String(d.bank + 1) << " " << labels.banks[d.bank];
+        if (d.preset >= 0 && d.preset < labels.presets[(size_t)d.bank].size())
+            text << " / " << labels.presets[(size_t)d.bank][d.preset];
+    }
+
+    return text;
+}
+
+//==============================================================================
+void BankSearchIndex::run()
+{
+    while (!threadShouldExit())
+    {
+        update();
+        wakeUp.wait(rescanIntervalMs);
+    }
+}
+
+void BankSearchIndex::update()
+{
+    juce::File dir;
+    {
+        const juce::ScopedLock sl(lock);
+        dir = directory;
+    }
+
+    const auto t0 = juce::Time::getHighResolutionTicks();
+
+    // Отметки снимаются вне замка: поиск не ждёт обхода папки
+    struct Stamp
+    {
+        juce::File file;
+        juce::int64 size;
+        juce::Time time;
+    };
+
+    std::vector<Stamp> found;
+    if (dir.isDirectory())
+        for (const auto& f : dir.findChildFiles(juce::File::findFiles, false, BankLibraryIO::fileWildcard))
+            found.push_back({ f, f.getSize(), f.getLastModificationTime() });
+
+    std::vector<juce::File> changed;
+    std::vector<uint32_t> removed;
+    {
+        const juce::ScopedLock sl(lock);
+        if (directory != dir)
+            return;
+
+        std::unordered_set<juce::String> present;
+        for (const auto& s : found)
+        {
+            const auto path = s.file.getFullPathName();
+            present.insert(path);
+
+            auto it = fileIdByPath.find(path);
+            if (it == fileIdByPath.end() || files[it->second].stampSize != s.size || files[it->second].stampTime != s.time)
+                changed.push_back(s.file);
+        }
+
+        for (const auto& [path, id] : fileIdByPath)
+            if (present.count(path) == 0)
+                removed.push_back(id);
+
+        for (auto id : removed)
+            removeFileLocked(id);
+    }
+
+    // Изменённые файлы читаются по одному: индексатор не занимает общий пул целиком,
+    // банки внутри файла разбираются параллельно, как при обычной загрузке
+    auto shouldAbort = [this] { return threadShouldExit(); };
+    for (const auto& f : changed)
+    {
+        if (threadShouldExit())
+            return;
+
+        Parsed parsed;
+        parseFile(f, parsed, shouldAbort);
+
+        const juce::ScopedLock sl(lock);
+        if (directory != dir)
+            return;
+
+        auto it = fileIdByPath.find(f.getFullPathName());
+        if (it != fileIdByPath.end())
+            removeFileLocked(it->second);
+
+        // нечитаемый файл тоже запоминается (без документов) — до следующего изменения
+        addFileLocked(parsed);
+    }
+
+    const juce::ScopedLock sl(lock);
+    if (directory != dir)
+        return;
+
+    if (deadDocs > 1024 && deadDocs > docs.size() / 2)
+        compactLocked();
+
+    if (!changed.empty() || !removed.empty())
+    {
+        stats.lastUpdateMs = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - t0) * 1000.0;
+        DBG("[Search] indexed " << (int)changed.size() << " files, removed " << (int)removed.size()
+            << " in " << juce::String(stats.lastUpdateMs, 1) << " ms");
+    }
+
+    stats.files = (int)fileIdByPath.size();
+    stats.documents = (int)(docs.size() - deadDocs);
+    stats.terms = (int)postings.size();
+    ready = true;
+}
+
+void BankSearchIndex::parseFile(const juce::File& file, Parsed& out, const std::function<bool()>& shouldAbort)
+{
+    // отметка берётся до чтения: она не новее прочитанного содержимого
+    out.entry.file = file;
+    out.entry.stampSize = file.getSize();
+    out.entry.stampTime = file.getLastModificationTime();
+    out.entry.labels.library = file.getFileNameWithoutExtension();
+
+    out.docs.push_back({ 0, -1, -1 });
+    out.terms.push_back(tokenize(out.entry.labels.library));
+
+    BankLibrary lib;
+    if (!BankLibraryIO::read(file, lib, shouldAbort))
+        return;
+
+    // значения по умолчанию (пустые банки, "Scene N", "<none>") не индексируются
+    static const BankLibrary::Bank defaults(maxPresets);
+
+    for (size_t i = 0; i < lib.banks.size(); ++i)
+    {
+        const auto& b = lib.banks[i];
+        out.entry.labels.banks.add(b.bankName);
+        out.entry.labels.presets.emplace_back(b.presetNames.data(), b.getNumPresets());
+
+        juce::StringArray words;
+        auto addField = [&words](const juce::String& text, const juce::String& defaultText)
+            {
+                if (text != defaultText)
+                    words.addArray(tokenize(text));
+            };
+
+        addField(b.bankName, defaults.bankName);
+        addField(b.pluginName, defaults.pluginName);
+        for (int cc = 0; cc < numCCParams; ++cc)
+            addField(b.globalCCMappings[cc].name, defaults.globalCCMappings[cc].name);
+
+        words.removeDuplicates(false);
+        if (!words.isEmpty())
+        {
+            out.docs.push_back({ 0, (int16_t)i, -1 });
+            out.terms.push_back(words);
+        }
+
+        for (int p = 0; p < b.getNumPresets(); ++p)
+        {
+            const auto& name = b.presetNames[(size_t)p];
+            if (name == defaults.presetNames[(size_t)p])
+                continue;
+
+            auto presetWords = tokenize(name);
+            if (presetWords.isEmpty())
+                continue;
+
+            out.docs.push_back({ 0, (int16_t)i, (int16_t)p });
+            out.terms.push_back(presetWords);
+        }
+    }
+}
+
+//==============================================================================
+// Вызывается под lock: документы файла остаются в docs/postings до сжатия,
+// но в выдачу не попадают (alive == false)
+void BankSearchIndex::removeFileLocked(uint32_t fileId)
+{
+    auto& entry = files[fileId];
+    if (!entry.alive)
+        return;
+
+    entry.alive = false;
+    entry.labels = {};
+    deadDocs += (size_t)entry.numDocs;
+    fileIdByPath.erase(entry.file.getFullPathName());
+}
+
+void BankSearchIndex::addFileLocked(Parsed& parsed)
+{
+    const auto fileId = (uint32_t)files.size();
+
+    for (size_t i = 0; i < parsed.docs.size(); ++i)
+    {
+        auto d = parsed.docs[i];
+        d.fileId = fileId;
+
+        const auto docId = (uint32_t)docs.size();
+        docs.push_back(d);
+
+        for (const auto& word : parsed.terms[i])
+            postings[word].push_back(docId);
+    }
+
+    parsed.entry.numDocs = (int)parsed.docs.size();
+    fileIdByPath[parsed.entry.file.getFullPathName()] = fileId;
+    files.push_back(std::move(parsed.entry));
+}
+
+// Вызывается под lock: выбрасывает мёртвые файлы и документы, перенумеровывая живые
+void BankSearchIndex::compactLocked()
+{
+    constexpr uint32_t gone = 0xffffffffu;
+
+    std::vector<uint32_t> newFileId(files.size(), gone);
+    std::vector<FileEntry> liveFiles;
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        if (!files[i].alive)
+            continue;
+
+        newFileId[i] = (uint32_t)liveFiles.size();
+        liveFiles.push_back(std::move(files[i]));
+    }
+
+    std::vector<uint32_t> newDocId(docs.size(), gone);
+    std::vector<Doc> liveDocs;
+    for (size_t i = 0; i < docs.size(); ++i)
+    {
+        if (newFileId[docs[i].fileId] == gone)
+            continue;
+
+        newDocId[i] = (uint32_t)liveDocs.size();
+        auto d = docs[i];
+        d.fileId = newFileId[d.fileId];
+        liveDocs.push_back(d);
+    }
+
+    for (auto it = postings.begin(); it != postings.end();)
+    {
+        auto& list = it->second;
+        size_t kept = 0;
+        for (auto docId : list)
+            if (newDocId[docId] != gone)
+                list[kept++] = newDocId[docId];
+        list.resize(kept);
+
+        it = list.empty() ? postings.erase(it) : std::next(it);
+    }
+
+    files.swap(liveFiles);
+    docs.swap(liveDocs);
+    deadDocs = 0;
+
+    fileIdByPath.clear();
+    for (size_t i = 0; i < files.size(); ++i)
+        fileIdByPath[files[i].file.getFullPathName()] = (uint32_t)i;
+}
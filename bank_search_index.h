@@ -0,0 +1,117 @@
+#pragma once
+#include <JuceHeader.h>
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+//==============================================================================
+// BankSearchIndex — полнотекстовый поиск по всем библиотекам папки BANK.
+// Фоновый поток читает каждую библиотеку и строит инвертированный индекс
+// слов: имя файла, bankName, pluginName, имена CC (уровень банка) и
+// presetNames (уровень пресета). Раз в rescanIntervalMs папка сверяется
+// по размеру и времени изменения файлов: переиндексируются только
+// новые/изменённые файлы, удалённые выпадают из выдачи сразу.
+// search() работает по готовому индексу под замком, без чтения файлов;
+// слово запроса совпадает с любым словом индекса, которое с него начинается.
+//==============================================================================
+class BankSearchIndex : private juce::Thread
+{
+public:
+    /** Найденное место: bank == -1 — совпало имя библиотеки, preset == -1 — банк целиком. */
+    struct Hit
+    {
+        juce::File file;
+        int bank = -1;
+        int preset = -1;
+        juce::String text;   // "библиотека / банк / пресет" для меню
+    };
+
+    struct Stats
+    {
+        int files = 0;
+        int documents = 0;
+        int terms = 0;
+        double lastUpdateMs = 0.0;   // последнее обновление (чтение изменённых файлов)
+    };
+
+    BankSearchIndex();
+    ~BankSearchIndex() override;
+
+    /** Папка для индексации; индекс строится заново. */
+    void setDirectory(const juce::File& dir);
+
+    /** Сверить папку сейчас, не дожидаясь очередного интервала. */
+    void refresh();
+
+    /** Места, где встречаются все слова запроса; сначала точнее (совпал пресет). */
+    std::vector<Hit> search(const juce::String& query, int maxHits = 50) const;
+
+    /** true после первого полного прохода по папке. */
+    bool isReady() const;
+
+    Stats getStats() const;
+
+    /** Слова текста в нижнем регистре (разделители — всё, кроме букв и цифр). */
+    static juce::StringArray tokenize(const juce::String& text);
+
+    static constexpr int rescanIntervalMs = 2000;
+
+private:
+    struct Labels
+    {
+        juce::String library;
+        juce::StringArray banks;                 // bankName по индексам
+        std::vector<juce::StringArray> presets;  // presetNames по банкам
+    };
+
+    struct FileEntry
+    {
+        juce::File file;
+        juce::int64 stampSize = 0;
+        juce::Time stampTime;
+        bool alive = true;
+        int numDocs = 0;
+        Labels labels;
+    };
+
+    // Документ — одна область поиска: библиотека, банк или пресет банка
+    struct Doc
+    {
+        uint32_t fileId = 0;
+        int16_t bank = -1;
+        int16_t preset = -1;
+    };
+
+    // Разобранный файл до публикации в индекс
+    struct Parsed
+    {
+        FileEntry entry;
+        std::vector<Doc> docs;
+        std::vector<juce::StringArray> terms;    // слова каждого документа
+    };
+
+    void run() override;
+    void update();
+    static void parseFile(const juce::File& file, Parsed& out, const std::function<bool()>& shouldAbort);
+
+    // вызываются под lock
+    void removeFileLocked(uint32_t fileId);
+    void addFileLocked(Parsed& parsed);
+    void compactLocked();
+    juce::String describeLocked(const Doc& d) const;
+
+    mutable juce::CriticalSection lock;
+    juce::File directory;
+    std::vector<FileEntry> files;                               // fileId → файл (мёртвые остаются до сжатия)
+    std::unordered_map<juce::String, uint32_t> fileIdByPath;
+    std::vector<Doc> docs;
+    std::map<juce::String, std::vector<uint32_t>> postings;     // слово → документы (упорядочено для префиксов)
+    size_t deadDocs = 0;
+    bool ready = false;
+    Stats stats;
+
+    juce::WaitableEvent wakeUp;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(BankSearchIndex)
+};
@@ -0,0 +1,539 @@
+#include "bank_tool.h"
+#include "bank_library.h"
+#include "bank_library_bench.h"
+#include "bank_xml_stream.h"
+#include <atomic>
+#include <map>
+#include <set>
+
+namespace
+{
+    constexpr int exitOk = 0;
+    constexpr int exitFileErrors = 1;
+    constexpr int exitUsage = 2;
+
+    double ticksToMs(juce::int64 ticks)
+    {
+        return juce::Time::highResolutionTicksToSeconds(ticks) * 1000.0;
+    }
+
+    juce::String formatBytes(juce::int64 bytes)
+    {
+        return juce::String((double)bytes / (1024.0 * 1024.0), 2) + " MB";
+    }
+
+    struct Options
+    {
+        juce::String command;
+        juce::StringArray paths;
+        juce::String to;             // convert: xml | nxb
+        juce::File outDir;           // convert: пусто — рядом с исходным
+        juce::String codec;          // пусто — кодек по умолчанию
+        bool rewrite = false;        // dedupe
+        int iterations = 10;         // bench
+        int threads = -1;            // -1 — не менять
+        juce::String error;
+    };
+
+    Options parseArgs(const juce::StringArray& args)
+    {
+        Options o;
+        if (args.isEmpty())
+        {
+            o.error = "no command";
+            return o;
+        }
+
+        o.command = args[0];
+        for (int i = 1; i < args.size(); ++i)
+        {
+            const auto& a = args[i];
+            auto value = [&]() -> juce::String
+                {
+                    if (i + 1 < args.size())
+                        return args[++i];
+                    o.error = "missing value for " + a;
+                    return {};
+                };
+
+            if (a == "--to")              o.to = value().toLowerCase().trimCharactersAtStart(".");
+            else if (a == "--out")        o.outDir = juce::File::getCurrentWorkingDirectory().getChildFile(value());
+            else if (a == "--codec")      o.codec = value().toLowerCase();
+            else if (a == "--rewrite")    o.rewrite = true;
+            else if (a == "--iterations") o.iterations = juce::jmax(1, value().getIntValue());
+            else if (a == "--threads")    o.threads = juce::jmax(0, value().getIntValue());
+            else if (a.startsWith("--"))  o.error = "unknown option " + a;
+            else                          o.paths.add(a);
+        }
+
+        if (o.error.isEmpty() && o.paths.isEmpty())
+            o.error = "no input files";
+        return o;
+    }
+
+    // Результат обработки одного файла: строка отчёта и признак ошибки
+    struct FileResult
+    {
+        bool ok = true;
+        juce::String text;
+
+        void fail(const juce::String& what)
+        {
+            ok = false;
+            text << "  error: " << what << "\n";
+        }
+    };
+
+    /** task(i, result) для каждого файла на общем пуле; результаты — в порядке файлов. */
+    std::vector<FileResult> forEachFile(const juce::Array<juce::File>& files,
+                                        const std::function<void(const juce::File&, FileResult&)>& task)
+    {
+        std::vector<FileResult> results((size_t)files.size());
+        BankLibraryIO::parallelFor(files.size(), [&](int i) { task(files.getReference(i), results[(size_t)i]); });
+        return results;
+    }
+
+    int printResults(const juce::Array<juce::File>& files, const std::vector<FileResult>& results, juce::String& report)
+    {
+        int failed = 0;
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            report << (results[i].ok ? "ok    " : "FAIL  ") << files[(int)i].getFullPathName() << "\n"
+                   << results[i].text;
+            failed += results[i].ok ? 0 : 1;
+        }
+
+        report << files.size() << " files, " << failed << " failed\n";
+        return failed == 0 ? exitOk : exitFileErrors;
+    }
+
+    bool readTimed(const juce::File& file, BankLibrary& lib, double& ms)
+    {
+        const auto t0 = juce::Time::getHighResolutionTicks();
+        const bool ok = BankLibraryIO::read(file, lib);
+        ms = ticksToMs(juce::Time::getHighResolutionTicks() - t0);
+        return ok;
+    }
+
+    // fn(state, bankIndex): bankIndex == -1 — глобальный state библиотеки
+    template <typename Fn>
+    void forEachState(const BankLibrary& lib, Fn&& fn)
+    {
+        if (!lib.pluginState.isEmpty())
+            fn(lib.pluginState, -1);
+
+        for (size_t i = 0; i < lib.banks.size(); ++i)
+            if (!lib.banks[i].pluginState.isEmpty())
+                fn(lib.banks[i].pluginState, (int)i);
+    }
+
+    // Запись в память и обратное чтение тем же путём, что и с диска
+    bool roundTrips(const BankLibrary& lib, bool binary)
+    {
+        juce::MemoryOutputStream mo;
+        if (!BankLibraryIO::writeTo(mo, lib, binary))
+            return false;
+
+        BankLibrary back;
+        const bool ok = binary ? BankLibraryIO::readBinary(mo.getData(), mo.getDataSize(), back)
+                               : BankXmlStreamReader::read(static_cast<const char*>(mo.getData()), mo.getDataSize(), back);
+        return ok && BankLibraryIO::identical(lib, back);
+    }
+
+    //==========================================================================
+    void validateFile(const juce::File& file, FileResult& r)
+    {
+        BankLibrary lib;
+        if (!BankLibraryIO::read(file, lib))
+        {
+            r.fail("cannot read");
+            return;
+        }
+
+        for (const auto& error : BankLibraryIO::validate(lib))
+            r.fail(error);
+
+        if (!roundTrips(lib, false)) r.fail("XML round-trip differs");
+        if (!roundTrips(lib, true))  r.fail(".nxb round-trip differs");
+    }
+
+    //==========================================================================
+    // Куда писать: --out с сохранением пути относительно корня аргумента, иначе рядом
+    juce::File convertTarget(const juce::File& file, const juce::File& root, const Options& o)
+    {
+        const auto ext = o.to == "nxb" ? BankLibraryIO::binaryExtension : BankLibraryIO::xmlExtension;
+        if (o.outDir == juce::File())
+            return file.withFileExtension(ext);
+
+        const auto relative = root.isDirectory() ? file.getRelativePathFrom(root) : file.getFileName();
+        return o.outDir.getChildFile(relative).withFileExtension(ext);
+    }
+
+    // Полная запись: для .nxb без дописывания — заодно сжимает журнал
+    bool writeFull(const juce::File& target, const BankLibrary& lib)
+    {
+        return BankLibraryIO::wantsBinaryFormat(target) ? BankLibraryIO::writeBinary(target, lib)
+                                                        : BankLibraryIO::writeXml(target, lib);
+    }
+
+    void convertFile(const juce::File& file, const juce::File& target, FileResult& r)
+    {
+        BankLibrary lib;
+        if (!BankLibraryIO::read(file, lib))
+        {
+            r.fail("cannot read");
+            return;
+        }
+
+        if (!target.getParentDirectory().createDirectory() || !writeFull(target, lib))
+        {
+            r.fail("cannot write " + target.getFullPathName());
+            return;
+        }
+
+        // записанное должно читаться в то же самое
+        BankLibrary back;
+        if (!BankLibraryIO::read(target, back) || !BankLibraryIO::identical(lib, back))
+            r.fail("written file differs: " + target.getFullPathName());
+        else
+            r.text << "  -> " << target.getFullPathName() << " (" << formatBytes(target.getSize()) << ")\n";
+    }
+
+    //==========================================================================
+    struct StateInfo
+    {
+        juce::String hash;
+        juce::int64 size = 0;
+    };
+
+    struct FileStats
+    {
+        bool binary = false;
+        juce::int64 fileBytes = 0;
+        double loadMs = 0.0;
+        int usedBanks = 0;
+        int numBanks = 0, numPresets = 0;
+        int params = 0;
+        int diffs = 0;
+        juce::int64 memoryBytes = 0;
+        std::vector<StateInfo> states;
+    };
+
+    bool collectStats(const juce::File& file, FileStats& s)
+    {
+        BankLibrary lib;
+        if (!readTimed(file, lib, s.loadMs))
+            return false;
+
+        s.binary = BankLibraryIO::isBinaryLibrary(file);
+        s.fileBytes = file.getSize();
+        s.params = (int)lib.pluginParamValues.size();
+        for (const auto& [id, values] : lib.pluginDefaults)
+            s.params += (int)values.size(); // полные векторы — только умолчания, у банков — diff'ы
+        s.numBanks = (int)lib.banks.size();
+        s.numPresets = lib.numPresets;
+        s.memoryBytes = BankLibraryIO::estimateMemoryBytes(lib);
+
+        for (const auto& b : lib.banks)
+        {
+            s.usedBanks += b.pluginId.isNotEmpty() ? 1 : 0;
+            s.params += (int)b.pluginParamValues.size();
+            s.diffs += (int)b.paramDiffs.size();
+        }
+
+        // хеш обычно уже записан в файле — распаковки нет
+        forEachState(lib, [&](const PluginStateRef& st, int) { s.states.push_back({ st.getContentHash(), (juce::int64)st.getSize() }); });
+        return true;
+    }
+
+    int uniqueStates(const FileStats& s, juce::int64& uniqueBytes)
+    {
+        std::set<juce::String> seen;
+        uniqueBytes = 0;
+        for (const auto& st : s.states)
+            if (seen.insert(st.hash).second)
+                uniqueBytes += st.size;
+        return (int)seen.size();
+    }
+
+    int runStats(const juce::Array<juce::File>& files, juce::String& report)
+    {
+        std::vector<FileStats> stats((size_t)files.size());
+        std::vector<FileResult> results((size_t)files.size());
+
+        const auto t0 = juce::Time::getHighResolutionTicks();
+        BankLibraryIO::parallelFor(files.size(), [&](int i)
+            {
+                if (!collectStats(files.getReference(i), stats[(size_t)i]))
+                    results[(size_t)i].fail("cannot read");
+            });
+        const auto wallMs = ticksToMs(juce::Time::getHighResolutionTicks() - t0);
+
+        FileStats total;
+        int totalUnique = 0;
+        for (size_t i = 0; i < stats.size(); ++i)
+        {
+            const auto& s = stats[i];
+            if (!results[i].ok)
+                continue;
+
+            juce::int64 uniqueBytes = 0;
+            const int unique = uniqueStates(s, uniqueBytes);
+
+            results[i].text << "  " << (s.binary ? "nxb" : "xml") << ", " << formatBytes(s.fileBytes)
+                            << ", load " << juce::String(s.loadMs, 2) << " ms"
+                            << ", banks " << s.usedBanks << "/" << s.numBanks << " x " << s.numPresets << " presets"
+                            << ", states " << (int)s.states.size() << " (" << unique << " unique, " << formatBytes(uniqueBytes) << ")"
+                            << ", params " << s.params << ", diffs " << s.diffs
+                            << ", memory ~" << formatBytes(s.memoryBytes) << "\n";
+
+            total.fileBytes += s.fileBytes;
+            total.loadMs += s.loadMs;
+            total.usedBanks += s.usedBanks;
+            total.params += s.params;
+            total.diffs += s.diffs;
+            total.memoryBytes += s.memoryBytes;
+            totalUnique += unique;
+        }
+
+        const int code = printResults(files, results, report);
+        report << "total: " << formatBytes(total.fileBytes)
+               << ", banks " << total.usedBanks << ", states " << totalUnique << " unique per file"
+               << ", params " << total.params << ", diffs " << total.diffs
+               << ", memory ~" << formatBytes(total.memoryBytes) << "\n"
+               << "load: " << juce::String(total.loadMs, 2) << " ms summed, "
+               << juce::String(wallMs, 2) << " ms wall\n";
+        return code;
+    }
+
+    //==========================================================================
+    int runDedupe(const juce::Array<juce::File>& files, bool rewrite, juce::String& report)
+    {
+        std::vector<FileStats> stats((size_t)files.size());
+        std::vector<FileResult> results((size_t)files.size());
+        BankLibraryIO::parallelFor(files.size(), [&](int i)
+            {
+                if (!collectStats(files.getReference(i), stats[(size_t)i]))
+                    results[(size_t)i].fail("cannot read");
+            });
+
+        // Хеш → размер и число файлов с ним
+        struct Shared
+        {
+            juce::int64 size = 0;
+            int references = 0;
+            std::set<int> files;
+        };
+        std::map<juce::String, Shared> byHash;
+
+        juce::int64 rawBytes = 0, perFileBytes = 0;
+        int rawCount = 0;
+        for (size_t i = 0; i < stats.size(); ++i)
+        {
+            juce::int64 uniqueBytes = 0;
+            uniqueStates(stats[i], uniqueBytes);
+            perFileBytes += uniqueBytes;
+
+            for (const auto& st : stats[i].states)
+            {
+                auto& sh = byHash[st.hash];
+                sh.size = st.size;
+                sh.references++;
+                sh.files.insert((int)i);
+                rawBytes += st.size;
+                rawCount++;
+            }
+        }
+
+        juce::int64 uniqueBytes = 0;
+        int sharedAcrossFiles = 0;
+        for (const auto& [hash, sh] : byHash)
+        {
+            uniqueBytes += sh.size;
+            sharedAcrossFiles += sh.files.size() > 1 ? 1 : 0;
+        }
+
+        if (rewrite)
+        {
+            // полная запись кладёт state'ы в таблицу блобов (по одному на хеш) и сжимает журнал .nxb
+            BankLibraryIO::parallelFor(files.size(), [&](int i)
+                {
+                    auto& r = results[(size_t)i];
+                    if (!r.ok)
+                        return;
+
+                    const auto& file = files.getReference(i);
+                    const auto before = file.getSize();
+
+                    BankLibrary lib;
+                    if (!BankLibraryIO::read(file, lib) || !writeFull(file, lib))
+                        r.fail("cannot rewrite");
+                    else
+                        r.text << "  rewritten: " << formatBytes(before) << " -> " << formatBytes(file.getSize()) << "\n";
+                });
+        }
+
+        const int code = printResults(files, results, report);
+        report << "states: " << rawCount << " (" << formatBytes(rawBytes) << " decoded)\n"
+               << "unique per file: " << formatBytes(perFileBytes)
+               << " (blob table saves " << formatBytes(rawBytes - perFileBytes) << ")\n"
+               << "unique overall: " << (int)byHash.size() << " (" << formatBytes(uniqueBytes) << "), "
+               << sharedAcrossFiles << " shared by several files ("
+               << formatBytes(perFileBytes - uniqueBytes) << " duplicated across files)\n";
+        return code;
+    }
+
+    //==========================================================================
+    // Загрузка всего каталога на 1 потоке и на всех ядрах
+    juce::String benchDirectory(const juce::Array<juce::File>& files, int iterations)
+    {
+        juce::int64 totalBytes = 0;
+        for (const auto& f : files)
+            totalBytes += f.getSize();
+
+        const int savedThreads = BankLibraryIO::getDecodeThreads();
+        juce::String report;
+        report << files.size() << " files, " << formatBytes(totalBytes) << ", "
+               << juce::SystemStats::getNumCpus() << " cores\n";
+
+        for (int threads : { 1, 0 })
+        {
+            BankLibraryIO::setDecodeThreads(threads);
+
+            juce::int64 ticks = 0;
+            std::atomic<int> failed{ 0 };
+            for (int it = 0; it < iterations; ++it)
+            {
+                const auto t0 = juce::Time::getHighResolutionTicks();
+                BankLibraryIO::parallelFor(files.size(), [&](int i)
+                    {
+                        BankLibrary lib;
+                        if (!BankLibraryIO::read(files.getReference(i), lib))
+                            failed++;
+                    });
+                ticks += juce::Time::getHighResolutionTicks() - t0;
+            }
+
+            const auto ms = ticksToMs(ticks) / iterations;
+            report << (threads == 1 ? "1 thread:  " : "all cores: ") << juce::String(ms, 2) << " ms, "
+                   << juce::String((double)totalBytes / (1024.0 * 1024.0) / juce::jmax(0.001, ms / 1000.0), 1) << " MB/s"
+                   << (failed > 0 ? ", " + juce::String(failed.load()) + " reads failed" : juce::String()) << "\n";
+        }
+
+        BankLibraryIO::setDecodeThreads(savedThreads);
+        return report;
+    }
+
+    int runBench(const Options& o, const juce::Array<juce::File>& files, juce::String& report)
+    {
+        if (o.paths.size() == 1 && juce::File::getCurrentWorkingDirectory().getChildFile(o.paths[0]).existsAsFile())
+        {
+            const auto& file = files.getReference(0);
+            report << BankLibraryBench::compareXmlReaders(file, o.iterations) << "\n"
+                   << BankLibraryBench::compareStateCodecs(file, o.iterations) << "\n"
+                   << BankLibraryBench::compareDecodeThreads(file, o.iterations) << "\n"
+                   << BankLibraryBench::compareFirstBank(file, o.iterations);
+            return exitOk;
+        }
+
+        report << benchDirectory(files, o.iterations);
+        return exitOk;
+    }
+}
+
+namespace BankTool
+{
+    juce::String getUsage()
+    {
+        return "usage: bank_tool <command> <file|dir>... [options]\n"
+               "  validate                         read, check states and XML/.nxb round-trip\n"
+               "  convert  --to xml|nxb [--out dir] [--codec none|zlib]\n"
+               "  dedupe   [--rewrite]             shared plugin states by SHA-256\n"
+               "  stats                            banks, states, params, load time\n"
+               "  bench    [--iterations N]        file: reader/codec/thread/first-bank; dir: bulk load\n"
+               "options: --threads N (0 = all cores)\n";
+    }
+
+    juce::Array<juce::File> collectFiles(const juce::StringArray& paths)
+    {
+        juce::Array<juce::File> files;
+        for (const auto& p : paths)
+        {
+            const auto f = juce::File::getCurrentWorkingDirectory().getChildFile(p);
+            if (f.isDirectory())
+            {
+                auto found = f.findChildFiles(juce::File::findFiles, true, BankLibraryIO::fileWildcard);
+                found.sort();
+                files.addArray(found);
+            }
+            else if (f.existsAsFile())
+            {
+                files.add(f);
+            }
+        }
+        return files;
+    }
+
+    int run(const juce::StringArray& args, juce::String& report)
+    {
+        auto o = parseArgs(args);
+
+        static const juce::StringArray commands{ "validate", "convert", "dedupe", "stats", "bench" };
+        if (o.error.isEmpty() && !commands.contains(o.command))
+            o.error = "unknown command " + o.command;
+        if (o.error.isEmpty() && o.command == "convert" && o.to != "xml" && o.to != "nxb")
+            o.error = "convert needs --to xml or --to nxb";
+
+        PluginStateRef::Codec codec = BankLibraryIO::getStateCodec();
+        if (o.error.isEmpty() && o.codec.isNotEmpty() && !PluginStateRef::parseCodecName(o.codec, codec))
+            o.error = "unknown codec " + o.codec;
+
+        if (o.error.isNotEmpty())
+        {
+            report << o.error << "\n" << getUsage();
+            return exitUsage;
+        }
+
+        const auto files = collectFiles(o.paths);
+        if (files.isEmpty())
+        {
+            report << "no bank libraries found\n";
+            return exitUsage;
+        }
+
+        if (o.threads >= 0)
+            BankLibraryIO::setDecodeThreads(o.threads);
+        BankLibraryIO::setStateCodec(codec);
+
+        if (o.command == "validate")
+            return printResults(files, forEachFile(files, validateFile), report);
+
+        if (o.command == "convert")
+        {
+            // корень — тот аргумент, из которого найден файл (для --out с подкаталогами)
+            auto rootOf = [&](const juce::File& file)
+                {
+                    for (const auto& p : o.paths)
+                    {
+                        const auto root = juce::File::getCurrentWorkingDirectory().getChildFile(p);
+                        if (file == root || file.isAChildOf(root))
+                            return root;
+                    }
+                    return file;
+                };
+
+            return printResults(files, forEachFile(files, [&](const juce::File& file, FileResult& r)
+                {
+                    convertFile(file, convertTarget(file, rootOf(file), o), r);
+                }), report);
+        }
+
+        if (o.command == "dedupe")
+            return runDedupe(files, o.rewrite, report);
+
+        if (o.command == "stats")
+            return runStats(files, report);
+
+        return runBench(o, files, report);
+    }
+}
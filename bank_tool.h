@@ -0,0 +1,30 @@
+#pragma once
+#include <JuceHeader.h>
+
+//==============================================================================
+// BankTool — пакетная обработка библиотек банков без GUI (консольная цель
+// bank_tool/CMakeLists.txt: bank_tool_main.cpp + bank_library, bank_library_bench,
+// bank_xml_stream, plugin_state_ref; модель банков — bank_model.h, без хоста плагинов и окон).
+// BankEditor не создаётся: чтение/запись идут через BankLibraryIO, файлы
+// каталога обрабатываются параллельно (BankLibraryIO::parallelFor).
+//
+//   validate <путь...>                     чтение, проверка state'ов и round-trip
+//   convert  <путь...> --to xml|nxb [--out каталог] [--codec none|zlib]
+//   dedupe   <путь...> [--rewrite]         одинаковые state'ы по SHA-256 (--rewrite — переписать файлы)
+//   stats    <путь...>                     банки, state'ы, параметры, время загрузки
+//   bench    <файл|каталог> [--iterations N]
+//
+// Общие опции: --threads N (0 — по числу ядер). Каталоги обходятся рекурсивно.
+//==============================================================================
+namespace BankTool
+{
+    /** Выполняет команду (args без имени программы); отчёт дописывается в report.
+        Возвращает код завершения процесса: 0 — успех, 1 — есть ошибки в файлах, 2 — неверные аргументы. */
+    int run(const juce::StringArray& args, juce::String& report);
+
+    /** Справка по командам. */
+    juce::String getUsage();
+
+    /** Файлы библиотек (*.xml, *.nxb) по путям: файл берётся как есть, каталог — рекурсивно. */
+    juce::Array<juce::File> collectFiles(const juce::StringArray& paths);
+}
@@ -0,0 +1,18 @@
+#include <JuceHeader.h>
+#include <iostream>
+#include "bank_tool.h"
+
+// Консольная цель bank_tool: без JUCEApplication и окон
+int main(int argc, char* argv[])
+{
+    juce::StringArray args;
+    for (int i = 1; i < argc; ++i)
+        args.add(juce::CharPointer_UTF8(argv[i]));
+
+    juce::String report;
+    const int code = BankTool::run(args, report);
+
+    // неверные аргументы — в stderr, отчёт (даже с ошибками в файлах) — в stdout
+    (code == 2 ? std::cerr : std::cout) << report.toStdString() << std::flush;
+    return code;
+}
@@ -0,0 +1,941 @@
+#include "bank_xml_stream.h"
+#include "bank_library.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace
+{
+    constexpr int numCCParams = BankModel::numCCParams;
+
+    //==========================================================================
+    // Участок исходного буфера (без копирования)
+    //==========================================================================
+    struct Span
+    {
+        const char* p = nullptr;
+        size_t n = 0;
+
+        // Имена тегов сравниваются без учёта регистра — как XmlElement::hasTagName
+        bool is(const char* name) const noexcept
+        {
+            auto lower = [](char c) { return (c >= 'A' && c <= 'Z') ? char(c + ('a' - 'A')) : c; };
+
+            for (size_t i = 0; i < n; ++i, ++name)
+                if (*name == 0 || lower(p[i]) != lower(*name))
+                    return false;
+
+            return *name == 0;
+        }
+
+        // Имена атрибутов — с учётом регистра, как XmlElement::getAttribute
+        bool equals(const char* name) const noexcept
+        {
+            return std::strlen(name) == n && std::memcmp(p, name, n) == 0;
+        }
+
+        bool contains(char c) const noexcept
+        {
+            return n > 0 && std::memchr(p, c, n) != nullptr;
+        }
+    };
+
+    // Раскрывает &amp; &lt; &gt; &quot; &apos; &#N; &#xH; — как XmlDocument
+    juce::String decodeText(Span s)
+    {
+        if (!s.contains('&'))
+            return juce::String::fromUTF8(s.p, (int)s.n);
+
+        juce::MemoryOutputStream mo(s.n);
+        for (size_t i = 0; i < s.n; ++i)
+        {
+            const char c = s.p[i];
+            auto* semi = c == '&' ? static_cast<const char*>(std::memchr(s.p + i, ';', s.n - i)) : nullptr;
+            if (semi == nullptr)
+            {
+                mo.writeByte(c);
+                continue;
+            }
+
+            const Span ent{ s.p + i + 1, (size_t)(semi - (s.p + i + 1)) };
+            juce::juce_wchar ch = 0;
+
+            if (ent.equals("amp"))       ch = '&';
+            else if (ent.equals("lt"))   ch = '<';
+            else if (ent.equals("gt"))   ch = '>';
+            else if (ent.equals("quot")) ch = '"';
+            else if (ent.equals("apos")) ch = '\'';
+            else if (ent.n > 1 && ent.p[0] == '#')
+            {
+                if (ent.p[1] == 'x' || ent.p[1] == 'X')
+                    ch = (juce::juce_wchar)juce::String::fromUTF8(ent.p + 2, (int)ent.n - 2).getHexValue32();
+                else
+                    ch = (juce::juce_wchar)juce::CharacterFunctions::getIntValue<int>(juce::CharPointer_UTF8(ent.p + 1));
+            }
+
+            if (ch == 0)
+            {
+                mo.writeByte(c);
+                continue;
+            }
+
+            const auto decoded = juce::String::charToString(ch);
+            mo.write(decoded.toRawUTF8(), decoded.getNumBytesAsUTF8());
+            i = (size_t)(semi - s.p);
+        }
+
+        return mo.toUTF8();
+    }
+
+    //==========================================================================
+    // XmlScanner — лексер: выдаёт начало/конец элемента и текст по одному.
+    // Атрибуты остаются ссылками в исходный буфер до явного запроса значения.
+    //==========================================================================
+    class XmlScanner
+    {
+    public:
+        enum class Token { startElement, endElement, text, end, error };
+
+        struct Attribute { Span name, value; };
+
+        XmlScanner(const char* d, size_t n) noexcept : data(d), size(n)
+        {
+            // UTF-8 BOM
+            if (size >= 3 && (uint8_t)d[0] == 0xEF && (uint8_t)d[1] == 0xBB && (uint8_t)d[2] == 0xBF)
+                pos = 3;
+
+            attributes.reserve(8);
+        }
+
+        Span tagName, text;
+        bool selfClosing = false;
+        bool textIsCData = false;
+
+        /** Начало последнего выданного токена и позиция сразу после него. */
+        size_t tokenStart() const noexcept { return start; }
+        size_t position() const noexcept { return pos; }
+
+        /** После startElement: пропускает содержимое до парного закрывающего тега. */
+        bool skipElement()
+        {
+            for (int depth = selfClosing ? 0 : 1; depth > 0;)
+            {
+                switch (next())
+                {
+                case Token::startElement: if (!selfClosing) ++depth; break;
+                case Token::endElement:   --depth; break;
+                case Token::text:         break;
+                case Token::end:
+                case Token::error:
+                default:                  return false;
+                }
+            }
+            return true;
+        }
+
+        Token next()
+        {
+            for (;;)
+            {
+                start = pos;
+                if (pos >= size)
+                    return Token::end;
+
+                if (data[pos] != '<')
+                {
+                    auto* lt = static_cast<const char*>(std::memchr(data + pos, '<', size - pos));
+                    const size_t end = lt != nullptr ? (size_t)(lt - data) : size;
+                    text = { data + pos, end - pos };
+                    textIsCData = false;
+                    pos = end;
+                    return Token::text;
+                }
+
+                if (startsWith("<!--"))
+                {
+                    if (!skipPast("-->")) return Token::error;
+                    continue;
+                }
+
+                if (startsWith("<![CDATA["))
+                {
+                    pos += 9;
+                    auto* e = search("]]>");
+                    if (e == nullptr) return Token::error;
+                    text = { data + pos, (size_t)(e - (data + pos)) };
+                    textIsCData = true;
+                    pos = (size_t)(e - data) + 3;
+                    return Token::text;
+                }
+
+                if (startsWith("<?"))
+                {
+                    if (!skipPast("?>")) return Token::error;
+                    continue;
+                }
+
+                if (startsWith("<!"))
+                {
+                    if (!skipDeclaration()) return Token::error;
+                    continue;
+                }
+
+                if (startsWith("</"))
+                {
+                    pos += 2;
+                    tagName = readName();
+                    auto* gt = static_cast<const char*>(std::memchr(data + pos, '>', size - pos));
+                    if (gt == nullptr) return Token::error;
+                    pos = (size_t)(gt - data) + 1;
+                    return Token::endElement;
+                }
+
+                ++pos;
+                return readStartTag();
+            }
+        }
+
+        const Span* findAttribute(const char* name) const noexcept
+        {
+            for (auto& a : attributes)
+                if (a.name.equals(name))
+                    return &a.value;
+            return nullptr;
+        }
+
+        int getInt(const char* name, int defaultValue) const
+        {
+            if (auto* v = findAttribute(name))
+                return v->contains('&') ? decodeText(*v).getIntValue()
+                                        : juce::CharacterFunctions::getIntValue<int>(juce::CharPointer_UTF8(v->p));
+            return defaultValue;
+        }
+
+        double getDouble(const char* name, double defaultValue) const
+        {
+            if (auto* v = findAttribute(name))
+                return v->contains('&') ? decodeText(*v).getDoubleValue()
+                                        : juce::CharacterFunctions::getDoubleValue(juce::CharPointer_UTF8(v->p));
+            return defaultValue;
+        }
+
+        bool getBool(const char* name, bool defaultValue) const
+        {
+            if (auto* v = findAttribute(name))
+            {
+                juce::juce_wchar first = 0;
+                if (v->contains('&'))
+                {
+                    const auto s = decodeText(*v);
+                    first = *(s.getCharPointer().findEndOfWhitespace());
+                }
+                else
+                {
+                    size_t i = 0;
+                    while (i < v->n && juce::CharacterFunctions::isWhitespace(v->p[i]))
+                        ++i;
+                    first = i < v->n ? (juce::juce_wchar)v->p[i] : 0;
+                }
+                return first == '1' || first == 't' || first == 'y' || first == 'T' || first == 'Y';
+            }
+            return defaultValue;
+        }
+
+        juce::String getString(const char* name) const
+        {
+            if (auto* v = findAttribute(name))
+                return decodeText(*v);
+            return {};
+        }
+
+    private:
+        const char* data;
+        size_t size;
+        size_t pos = 0;
+        size_t start = 0;
+        std::vector<Attribute> attributes;
+
+        static bool isNameEnd(char c) noexcept
+        {
+            return c == ' ' || c == '\t' || c == '\r' || c == '\n'
+                || c == '=' || c == '/' || c == '>' || c == '<';
+        }
+
+        bool startsWith(const char* prefix) const noexcept
+        {
+            const size_t len = std::strlen(prefix);
+            return size - pos >= len && std::memcmp(data + pos, prefix, len) == 0;
+        }
+
+        const char* search(const char* needle) const noexcept
+        {
+            const size_t len = std::strlen(needle);
+            for (size_t i = pos; i + len <= size; ++i)
+                if (data[i] == needle[0] && std::memcmp(data + i, needle, len) == 0)
+                    return data + i;
+            return nullptr;
+        }
+
+        bool skipPast(const char* terminator) noexcept
+        {
+            auto* e = search(terminator);
+            if (e == nullptr) return false;
+            pos = (size_t)(e - data) + std::strlen(terminator);
+            return true;
+        }
+
+        // <!DOCTYPE ... [ ... ]>
+        bool skipDeclaration() noexcept
+        {
+            int depth = 0;
+            for (; pos < size; ++pos)
+            {
+                if (data[pos] == '[') ++depth;
+                else if (data[pos] == ']') --depth;
+                else if (data[pos] == '>' && depth <= 0) { ++pos; return true; }
+            }
+            return false;
+        }
+
+        void skipWhitespace() noexcept
+        {
+            while (pos < size && (data[pos] == ' ' || data[pos] == '\t' || data[pos] == '\r' || data[pos] == '\n'))
+                ++pos;
+        }
+
+        Span readName() noexcept
+        {
+            const size_t start = pos;
+            while (pos < size && !isNameEnd(data[pos]))
+                ++pos;
+            return { data + start, pos - start };
+        }
+
+        Token readStartTag()
+        {
+            tagName = readName();
+            if (tagName.n == 0)
+                return Token::error;
+
+            attributes.clear();
+            selfClosing = false;
+
+            for (;;)
+            {
+                skipWhitespace();
+                if (pos >= size)
+                    return Token::error;
+
+                if (data[pos] == '>')
+                {
+                    ++pos;
+                    return Token::startElement;
+                }
+
+                if (data[pos] == '/')
+                {
+                    if (pos + 1 >= size || data[pos + 1] != '>')
+                        return Token::error;
+                    pos += 2;
+                    selfClosing = true;
+                    return Token::startElement;
+                }
+
+                Attribute a;
+                a.name = readName();
+                skipWhitespace();
+                if (a.name.n == 0 || pos >= size || data[pos] != '=')
+                    return Token::error;
+
+                ++pos;
+                skipWhitespace();
+                if (pos >= size || (data[pos] != '"' && data[pos] != '\''))
+                    return Token::error;
+
+                const char quote = data[pos++];
+                auto* close = static_cast<const char*>(std::memchr(data + pos, quote, size - pos));
+                if (close == nullptr)
+                    return Token::error;
+
+                a.value = { data + pos, (size_t)(close - (data + pos)) };
+                pos = (size_t)(close - data) + 1;
+                attributes.push_back(a);
+            }
+        }
+    };
+
+    //==========================================================================
+    // LibraryBuilder — раскладывает события сканера по полям BankLibrary.
+    // Повторяет семантику DOM-пути: getChildByName берёт первый дочерний
+    // элемент с данным именем, forEachXmlChildElementWithTagName — все.
+    //==========================================================================
+    class LibraryBuilder
+    {
+    public:
+        /** singleBank — разбор одного вынесенного <Bank> (корнем будет он сам). */
+        explicit LibraryBuilder(BankLibrary& l, BankLibrary::Bank* singleBank = nullptr)
+            : lib(l), bankOnly(singleBank) {}
+
+        bool finished() const noexcept { return rootDone && stack.empty(); }
+
+        /** Текущий элемент — <Bank> прямо в корне: его можно разобрать отдельно. */
+        bool isRootBank(const XmlScanner& x) const noexcept
+        {
+            return bankOnly == nullptr && stack.size() == 1 && stack.back() == Ctx::root && x.tagName.is("Bank");
+        }
+
+        /** Корень с неподдерживаемой версией схемы: разбор прекращается сразу. */
+        bool isRejected() const noexcept { return versionRejected; }
+
+        /** Таблица <StateBlobs> корня — после первого прохода полная, дальше только читается. */
+        const BankLibraryIO::StateBlobTable& getBlobs() const noexcept { return blobs; }
+
+        void startElement(const XmlScanner& x)
+        {
+            const Ctx parent = stack.empty() ? Ctx::document : stack.back();
+            stack.push_back(childContext(parent, x));
+
+            if (x.selfClosing)
+                endElement();
+        }
+
+        bool endElement()
+        {
+            if (stack.empty())
+                return false;
+
+            const Ctx ctx = stack.back();
+            stack.pop_back();
+
+            if (ctx == Ctx::rootState)
+                lib.pluginState = finishState();
+            else if (ctx == Ctx::bankState)
+                current->pluginState = finishState();
+            else if (ctx == Ctx::blob)
+                addBlob();
+            else if (packedArray && (ctx == Ctx::rootParams || ctx == Ctx::defaults || ctx == Ctx::bankParams || ctx == Ctx::bankDiffs))
+                finishPackedArray(ctx);
+            else if (ctx == Ctx::root || (bankOnly != nullptr && stack.empty()))
+                rootDone = true;
+
+            return true;
+        }
+
+        /** После всего корня: <StateBlobs> может идти после ссылок на него.
+            Банк, разобранный отдельно, разрешает свои ссылки по таблице корня. */
+        void resolveStateRefs(const BankLibraryIO::StateBlobTable& table)
+        {
+            for (auto& [dest, id] : pendingRefs)
+            {
+                auto it = table.find(id);
+                if (it != table.end()) *dest = it->second;
+                else                   dest->reset();
+            }
+
+            pendingRefs.clear();
+        }
+
+        void text(const XmlScanner& x)
+        {
+            if (stateDepth == 0 || stack.size() < stateDepth)
+                return;
+
+            if (x.textIsCData || !x.text.contains('&'))
+            {
+                stateText.write(x.text.p, x.text.n);
+            }
+            else
+            {
+                const auto decoded = decodeText(x.text);
+                stateText.write(decoded.toRawUTF8(), decoded.getNumBytesAsUTF8());
+            }
+        }
+
+    private:
+        enum class Ctx
+        {
+            document, root, rootParams, rootState, stateBlobs, blob, pluginDefaults, defaults,
+            bank, bankParams, bankState, bankDiffs, presetNames, ccStates, ccPreset, ccMatrix,
+            ignore
+        };
+
+        BankLibrary& lib;
+        BankLibrary::Bank* const bankOnly;
+        std::vector<Ctx> stack;
+        bool rootDone = false;
+        bool versionRejected = false;
+
+        bool rootParamsSeen = false, rootStateSeen = false, stateBlobsSeen = false, defaultsSeen = false;
+        bool bankParamsSeen = false, bankStateSeen = false, bankDiffsSeen = false;
+        bool presetNamesSeen = false, ccStatesSeen = false, ccMatrixSeen = false;
+
+        BankLibrary::Bank* current = nullptr;
+        int currentPreset = -1;
+        std::vector<float>* currentDefaults = nullptr;   // <Defaults> внутри <PluginDefaults>
+
+        size_t stateDepth = 0;
+        juce::MemoryOutputStream stateText;
+
+        // упакованный <PluginParams>/<ParamDiffs>: текст собирается в stateText
+        bool packedArray = false;
+        size_t packedCount = 0;
+
+        // <StateBlobs> может идти после ссылок на него — ссылки разрешаются в конце
+        BankLibraryIO::StateBlobTable blobs;
+        juce::String currentBlobId;
+        PluginStateRef::Codec currentBlobCodec = PluginStateRef::Codec::none;
+        size_t currentBlobSize = 0;
+        bool currentBlobCodecKnown = true;
+        std::vector<std::pair<PluginStateRef*, juce::String>> pendingRefs;
+
+        Ctx childContext(Ctx parent, const XmlScanner& x)
+        {
+            const auto& tag = x.tagName;
+
+            switch (parent)
+            {
+            case Ctx::document:
+                if (rootDone)
+                    return Ctx::ignore;
+                if (bankOnly != nullptr)
+                {
+                    beginBank(*bankOnly, x);
+                    return Ctx::bank;
+                }
+                if (!BankLibraryIO::isSupportedXmlVersion(x.getInt("version", 1)))
+                {
+                    DBG("[BankXmlStreamReader] unsupported XML version " << x.getInt("version", 1));
+                    versionRejected = true;
+                    return Ctx::ignore;
+                }
+                beginLibrary(x);
+                return Ctx::root;
+
+            case Ctx::root:
+                if (tag.is("Bank"))
+                {
+                    const int idx = x.getInt("index", -1);
+                    if (idx < 0 || idx >= (int)lib.banks.size())
+                        return Ctx::ignore;
+
+                    beginBank(lib.banks[(size_t)idx], x);
+                    return Ctx::bank;
+                }
+                if (tag.is("PluginParams") && !rootParamsSeen)
+                {
+                    rootParamsSeen = true;
+                    return beginParams(x, Ctx::rootParams, BankLibraryIO::floatArrayEncoding);
+                }
+                if (tag.is("PluginState") && !rootStateSeen)
+                {
+                    rootStateSeen = true;
+                    return beginState(x, lib.pluginState, Ctx::rootState);
+                }
+                if (tag.is("StateBlobs") && !stateBlobsSeen)
+                {
+                    stateBlobsSeen = true;
+                    return Ctx::stateBlobs;
+                }
+                if (tag.is("PluginDefaults") && !defaultsSeen)
+                {
+                    defaultsSeen = true;
+                    return Ctx::pluginDefaults;
+                }
+                return Ctx::ignore;
+
+            case Ctx::pluginDefaults:
+                if (tag.is("Defaults"))
+                {
+                    // ключ — как в fromXml: нормализованный pluginId
+                    currentDefaults = &lib.pluginDefaults[BankLibraryIO::normalizePluginId(x.getString("pluginId"))];
+                    return beginParams(x, Ctx::defaults, BankLibraryIO::floatArrayEncoding);
+                }
+                return Ctx::ignore;
+
+            case Ctx::defaults:
+                if (tag.is("Param"))
+                    currentDefaults->push_back((float)x.getDouble("value", 0.0));
+                return Ctx::ignore;
+
+            case Ctx::stateBlobs:
+                if (tag.is("Blob"))
+                {
+                    currentBlobId = x.getString("id");
+                    currentBlobSize = (size_t)x.getString("size").getLargeIntValue();
+                    currentBlobCodecKnown = PluginStateRef::parseCodecName(x.getString("codec"), currentBlobCodec);
+                    beginStateText();
+                    return Ctx::blob;
+                }
+                return Ctx::ignore;
+
+            case Ctx::rootParams:
+                if (tag.is("Param"))
+                    lib.pluginParamValues.push_back((float)x.getDouble("value", 0.0));
+                return Ctx::ignore;
+
+            case Ctx::bank:
+                if (tag.is("PluginParams") && !bankParamsSeen)
+                {
+                    bankParamsSeen = true;
+                    return beginParams(x, Ctx::bankParams, BankLibraryIO::floatArrayEncoding);
+                }
+                if (tag.is("ParamDiffs") && !bankDiffsSeen)
+                {
+                    bankDiffsSeen = true;
+                    return beginParams(x, Ctx::bankDiffs, BankLibraryIO::paramDiffsEncoding);
+                }
+                if (tag.is("PresetNames") && !presetNamesSeen)  { presetNamesSeen = true; return Ctx::presetNames; }
+                if (tag.is("CCMatrix") && !ccMatrixSeen)
+                {
+                    ccMatrixSeen = true;
+                    readCCMatrix(x);
+                    return Ctx::ccMatrix;
+                }
+                // как deserializeBank: при наличии <CCMatrix> <CCPresetStates> не читается
+                if (tag.is("CCPresetStates") && !ccStatesSeen && !ccMatrixSeen) { ccStatesSeen = true; return Ctx::ccStates; }
+                if (tag.is("PluginState") && !bankStateSeen)
+                {
+                    bankStateSeen = true;
+                    return beginState(x, current->pluginState, Ctx::bankState);
+                }
+                return Ctx::ignore;
+
+            case Ctx::bankParams:
+                if (tag.is("Param"))
+                    current->pluginParamValues.push_back((float)x.getDouble("value", 0.0));
+                return Ctx::ignore;
+
+            case Ctx::bankDiffs:
+                if (tag.is("Diff"))
+                {
+                    const int idx = x.getInt("index", -1);
+                    if (idx >= 0)
+                        current->paramDiffs[idx] = (float)x.getDouble("value", 0.0);
+                }
+                return Ctx::ignore;
+
+            case Ctx::presetNames:
+                if (tag.is("Preset"))
+                {
+                    const int pIdx = x.getInt("index", -1);
+                    if (pIdx >= 0 && pIdx < current->getNumPresets())
+                        current->presetNames[(size_t)pIdx] = x.getString("name");
+                }
+                return Ctx::ignore;
+
+            case Ctx::ccStates:
+                if (tag.is("Preset"))
+                {
+                    currentPreset = x.getInt("index", -1);
+                    if (currentPreset >= 0 && currentPreset < current->getNumPresets())
+                        return Ctx::ccPreset;
+                }
+                return Ctx::ignore;
+
+            case Ctx::ccPreset:
+                if (tag.is("CC"))
+                    readCC(x);
+                return Ctx::ignore;
+
+            case Ctx::ccMatrix:
+                if (tag.is("Slot"))
+                    readSlot(x);
+                return Ctx::ignore;
+
+            case Ctx::rootState:
+            case Ctx::bankState:
+            case Ctx::blob:
+            case Ctx::ignore:
+            default:
+                return Ctx::ignore;
+            }
+        }
+
+        void beginLibrary(const XmlScanner& x)
+        {
+            lib.activeBankIndex = x.getInt("activeBankIndex", 0);
+            lib.activePreset = x.getInt("activePreset", 0);
+
+            lib.pluginName = x.getString("pluginName");
+            lib.pluginId = BankLibraryIO::normalizePluginId(x.getString("pluginId"));
+            lib.activeProgram = x.getInt("activeProgram", -1);
+
+            lib.pluginParamValues.clear();
+            lib.pluginDefaults.clear();
+            lib.pluginState.reset();
+
+            // размеры и границы активных индексов — как у fromXml (version 1 — всегда 20 × 6)
+            lib.banks.clear();
+            lib.setCapacity(x.getInt("banks", BankModel::defaultNumBanks),
+                            x.getInt("presets", BankModel::defaultNumPresets));
+        }
+
+        void beginBank(BankLibrary::Bank& b, const XmlScanner& x)
+        {
+            current = &b;
+            bankParamsSeen = bankStateSeen = bankDiffsSeen = false;
+            presetNamesSeen = ccStatesSeen = ccMatrixSeen = false;
+
+            b.bankName = x.getString("bankName");
+            b.pluginName = x.getString("pluginName");
+            b.pluginId = BankLibraryIO::normalizePluginId(x.getString("pluginId"));
+            b.activeProgram = x.getInt("activeProgram", -1);
+
+            // deserializeBank сбрасывает эти поля безусловно
+            b.pluginState.reset();
+            b.pluginParamValues.clear();
+            b.paramDiffs.clear();
+        }
+
+        void readCC(const XmlScanner& x)
+        {
+            const int cc = x.getInt("number", -1);
+            if (cc < 0 || cc >= numCCParams)
+                return;
+
+            PresetCCMapping presetMap;
+            presetMap.enabled = x.getBool("enabled", false);
+            presetMap.ccValue = (uint8_t)x.getInt("ccValue", 64);
+            presetMap.invert = x.getBool("invert", false);
+            if (presetMap != PresetCCMapping{})
+                current->editPresetCC(currentPreset, cc) = presetMap;
+
+            auto& globalMap = current->globalCCMappings[cc];
+            globalMap.paramIndex = x.getInt("paramIndex", -1);
+            globalMap.name = x.getString("paramName");
+        }
+
+        void readCCMatrix(const XmlScanner& x)
+        {
+            const int ccs = x.getInt("ccs", numCCParams);
+            const auto rows = BankLibraryIO::parseCCRows(x.getString("rows"));
+
+            // hex без сущностей разбирается прямо из буфера
+            if (auto* cells = x.findAttribute("cells"))
+            {
+                if (!cells->contains('&'))
+                {
+                    BankLibraryIO::unpackCCCells(*current, cells->p, cells->n, rows, ccs);
+                }
+                else
+                {
+                    const auto decoded = decodeText(*cells);
+                    BankLibraryIO::unpackCCCells(*current, decoded.toRawUTF8(), decoded.getNumBytesAsUTF8(), rows, ccs);
+                }
+            }
+        }
+
+        void readSlot(const XmlScanner& x)
+        {
+            const int cc = x.getInt("number", -1);
+            if (cc < 0 || cc >= numCCParams)
+                return;
+
+            auto& globalMap = current->globalCCMappings[cc];
+            globalMap.paramIndex = x.getInt("paramIndex", -1);
+            globalMap.name = x.getString("paramName");
+        }
+
+        // encoding="..." — массив одним base64-текстом, иначе дочерние <Param>/<Diff>
+        Ctx beginParams(const XmlScanner& x, Ctx ctx, const char* encoding)
+        {
+            if (x.getString("encoding") == encoding)
+            {
+                packedArray = true;
+                packedCount = (size_t)x.getString("count").getLargeIntValue();
+                beginStateText();
+            }
+            return ctx;
+        }
+
+        void finishPackedArray(Ctx ctx)
+        {
+            stateDepth = 0;
+            packedArray = false;
+
+            const auto* text = static_cast<const char*>(stateText.getData());
+            const size_t length = stateText.getDataSize();
+
+            if (ctx == Ctx::rootParams)
+                BankLibraryIO::decodeFloatArray(text, length, packedCount, lib.pluginParamValues);
+            else if (ctx == Ctx::defaults)
+                BankLibraryIO::decodeFloatArray(text, length, packedCount, *currentDefaults);
+            else if (ctx == Ctx::bankParams)
+                BankLibraryIO::decodeFloatArray(text, length, packedCount, current->pluginParamValues);
+            else
+                BankLibraryIO::decodeParamDiffs(text, length, packedCount, current->paramDiffs);
+
+            stateText.reset();
+            packedCount = 0;
+        }
+
+        // <PluginState ref="хеш"/> — ссылка на блоб, иначе встроенный base64
+        Ctx beginState(const XmlScanner& x, PluginStateRef& dest, Ctx stateCtx)
+        {
+            const auto ref = x.getString("ref");
+            if (ref.isNotEmpty())
+            {
+                pendingRefs.emplace_back(&dest, ref);
+                return Ctx::ignore;
+            }
+
+            beginStateText();
+            return stateCtx;
+        }
+
+        void beginStateText()
+        {
+            stateText.reset();
+            stateDepth = stack.size() + 1; // уровень элемента после push
+        }
+
+        PluginStateRef finishState()
+        {
+            stateDepth = 0;
+            auto state = PluginStateRef::fromBase64(stateText.toUTF8().trim(), currentBlobId,
+                                                    currentBlobCodec, currentBlobSize);
+            stateText.reset();
+            currentBlobId.clear();
+            currentBlobCodec = PluginStateRef::Codec::none;
+            currentBlobSize = 0;
+            return state;
+        }
+
+        void addBlob()
+        {
+            const auto id = currentBlobId;
+            const bool codecKnown = currentBlobCodecKnown;
+            currentBlobCodecKnown = true;
+            auto state = finishState();
+
+            // как readStateBlobs: первый блоб с данным id выигрывает, неизвестный кодек пропускается
+            if (codecKnown && id.isNotEmpty() && blobs.find(id) == blobs.end())
+                blobs.emplace(id, std::move(state));
+        }
+    };
+
+    // Участок буфера с одним корневым <Bank>
+    struct BankSpan
+    {
+        size_t begin = 0, end = 0;
+    };
+
+    template <typename OnStart>
+    bool runScanner(XmlScanner& scanner, OnStart&& onStart, LibraryBuilder& builder,
+                    const BankXmlStreamReader::AbortCheck& shouldAbort)
+    {
+        uint32_t tokenCount = 0;
+
+        for (;;)
+        {
+            if (shouldAbort && (++tokenCount & 4095) == 0 && shouldAbort())
+                return false;
+
+            switch (scanner.next())
+            {
+            case XmlScanner::Token::startElement: if (!onStart()) return false; break;
+            case XmlScanner::Token::endElement:   if (!builder.endElement()) return false; break;
+            case XmlScanner::Token::text:         builder.text(scanner); break;
+            case XmlScanner::Token::end:          return builder.finished();
+            case XmlScanner::Token::error:
+            default:                              return false;
+            }
+        }
+    }
+}
+
+//==============================================================================
+bool BankXmlStreamReader::read(const char* data, size_t size, BankLibrary& out, const AbortCheck& shouldAbort,
+                               BankLibraryIO::BankReadOrder* order)
+{
+    if (data == nullptr || size == 0)
+        return false;
+
+    // UTF-16 оставляем DOM-парсеру
+    if (size >= 2 && (((uint8_t)data[0] == 0xFF && (uint8_t)data[1] == 0xFE)
+                   || ((uint8_t)data[0] == 0xFE && (uint8_t)data[1] == 0xFF)))
+        return false;
+
+    XmlScanner scanner(data, size);
+    LibraryBuilder builder(out);
+
+    // --- Проход 1: всё, кроме банков; банки только размечаются (по индексу) ---
+    // число слотов известно после корня (атрибут banks)
+    std::vector<std::vector<BankSpan>> bankSpans;
+    const bool ok = runScanner(scanner, [&]
+        {
+            if (!builder.isRootBank(scanner))
+            {
+                builder.startElement(scanner);
+                return !builder.isRejected();
+            }
+
+            const int idx = scanner.getInt("index", -1);
+            const auto begin = scanner.tokenStart();
+            if (!scanner.skipElement())
+                return false;
+
+            // как в DOM-пути: банки с одним индексом применяются по порядку
+            bankSpans.resize(out.banks.size());
+            if (idx >= 0 && idx < (int)bankSpans.size())
+                bankSpans[(size_t)idx].push_back({ begin, scanner.position() });
+            return true;
+        }, builder, shouldAbort);
+
+    if (!ok)
+        return false;
+
+    // ссылки корня (глобальный state) — сразу: к первому готовому банку заголовок полон
+    builder.resolveStateRefs(builder.getBlobs());
+
+    // --- Проход 2: банки параллельно, каждый в свой слот ---
+    const int numBanks = (int)out.banks.size();
+    bankSpans.resize((size_t)numBanks);
+    std::vector<char> bankOk((size_t)numBanks, 1);
+
+    BankLibraryIO::parallelFor(order != nullptr ? order->start(out) : numBanks, [&](int task)
+        {
+            const int idx = order != nullptr ? order->take() : task;
+            if (idx < 0)
+                return;
+
+            // как в DOM-пути: банки с одним индексом применяются по порядку
+            for (const auto& span : bankSpans[(size_t)idx])
+            {
+                LibraryBuilder bankBuilder(out, &out.banks[(size_t)idx]);
+                XmlScanner bankScanner(data + span.begin, span.end - span.begin);
+                const bool parsed = runScanner(bankScanner, [&]
+                    {
+                        bankBuilder.startElement(bankScanner);
+                        return true;
+                    }, bankBuilder, shouldAbort);
+
+                if (!parsed)
+                {
+                    bankOk[(size_t)idx] = 0;
+                    return;
+                }
+
+                bankBuilder.resolveStateRefs(builder.getBlobs());
+            }
+
+            if (order != nullptr)
+                order->finished(idx, out.banks[(size_t)idx]);
+        });
+
+    if (std::find(bankOk.begin(), bankOk.end(), 0) != bankOk.end())
+        return false;
+
+    // как fromXml: старая полная раскладка — к разреженной (с order — делает вызывающий)
+    if (order == nullptr)
+        BankLibraryIO::compactParamValues(out);
+    return true;
+}
+
+bool BankXmlStreamReader::read(const juce::File& file, BankLibrary& out, const AbortCheck& shouldAbort,
+                               BankLibraryIO::BankReadOrder* order)
+{
+    juce::MemoryMappedFile mapped(file, juce::MemoryMappedFile::readOnly);
+    return read(static_cast<const char*>(mapped.getData()), mapped.getSize(), out, shouldAbort, order);
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <JuceHeader.h>
+#include <functional>
+
+struct BankLibrary;
+namespace BankLibraryIO { class BankReadOrder; }
+
+//==============================================================================
+// BankXmlStreamReader — потоковый (SAX-подобный) разбор XML-библиотеки банков.
+// Не строит DOM: <Param>, <Diff>, <CC> и т.д. разбираются прямо из байтов
+// (memory-mapped файл) в поля Bank. Результат совпадает с DOM-путём
+// BankLibraryIO::fromXml; при синтаксической ошибке возвращает false.
+// Элементы <Bank> на первом проходе только размечаются, а разбираются
+// параллельно (BankLibraryIO::parallelFor) — каждый в свой слот banks,
+// в порядке BankReadOrder, если он задан; ссылки на блобы банк разрешает
+// сразу, так что готовый банк можно отдавать, не дожидаясь остальных.
+//==============================================================================
+class BankXmlStreamReader
+{
+public:
+    /** shouldAbort (если задан) периодически опрашивается; true — разбор прерывается. */
+    using AbortCheck = std::function<bool()>;
+
+    /** Разбор буфера в кодировке UTF-8 (с BOM или без). */
+    static bool read(const char* data, size_t size, BankLibrary& out, const AbortCheck& shouldAbort = {},
+                     BankLibraryIO::BankReadOrder* order = nullptr);
+
+    /** Разбор файла через MemoryMappedFile. */
+    static bool read(const juce::File& file, BankLibrary& out, const AbortCheck& shouldAbort = {},
+                     BankLibraryIO::BankReadOrder* order = nullptr);
+
+private:
+    BankXmlStreamReader() = delete;
+};
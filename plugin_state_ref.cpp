@@ -0,0 +1,893 @@
+#include "plugin_state_ref.h"
+#include <algorithm>
+#include <atomic>
+#include <list>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace
+{
+    // Потеря state'а — не отладочная мелочь: пишется в лог и в релизной сборке
+    void reportUnavailable(const juce::File& file, const juce::String& what)
+    {
+        juce::Logger::writeToLog("[PluginStateRef] " + file.getFullPathName() + " " + what);
+    }
+}
+
+//==============================================================================
+// FileSource — файл библиотеки, из которого state'ы читаются по смещению.
+// Ручка на файл не держится (иначе rename поверх него не пройдёт на Windows):
+// каждый read открывает файл заново и сверяет размер/время изменения.
+// Источник знает, какие диапазоны заняты живыми ссылками (retain/release):
+// перед перезаписью файла в память копируются только они.
+//==============================================================================
+class PluginStateRef::FileSource
+{
+public:
+    explicit FileSource(const juce::File& f)
+        : file(f), stampSize(f.getSize()), stampTime(f.getLastModificationTime()) {}
+
+    const juce::File file;
+
+    bool read(juce::int64 offset, size_t size, juce::MemoryBlock& dest)
+    {
+        const juce::ScopedLock sl(lock);
+
+        if (isDetached)
+        {
+            // диапазон ищется среди скопированных кусков: кусок с началом <= offset
+            auto it = detached.upper_bound(offset);
+            if (it == detached.begin())
+                return false;
+
+            --it;
+            const auto& piece = it->second;
+            const auto skip = offset - it->first;
+            if (offset < 0 || (juce::uint64)skip + size > piece.getSize())
+                return false;
+
+            dest.replaceAll(static_cast<const char*>(piece.getData()) + skip, size);
+            return true;
+        }
+
+        if (!isUnchanged())
+            return false;
+
+        juce::FileInputStream in(file);
+        if (!in.openedOk() || !in.setPosition(offset))
+            return false;
+
+        dest.setSize(size);
+        return in.read(dest.getData(), size) == (int)size;
+    }
+
+    /** Файл вырос дозаписью: старые диапазоны по-прежнему верны (вызывать под getLock()). */
+    void restamp(bool wasUnchanged)
+    {
+        if (wasUnchanged && !isDetached)
+        {
+            stampSize = file.getSize();
+            stampTime = file.getLastModificationTime();
+        }
+    }
+
+    juce::CriticalSection& getLock() noexcept { return lock; }
+
+    bool isUnchanged() const
+    {
+        return file.getSize() == stampSize && file.getLastModificationTime() == stampTime;
+    }
+
+    /** Диапазон занят живой ссылкой (Impl) — нужен при detach(). */
+    void retain(juce::int64 offset, size_t size)
+    {
+        const juce::ScopedLock sl(lock);
+        auto& r = live[offset];
+        r.size = juce::jmax(r.size, size);
+        ++r.refs;
+    }
+
+    void release(juce::int64 offset)
+    {
+        const juce::ScopedLock sl(lock);
+        auto it = live.find(offset);
+        if (it == live.end())
+            return;
+
+        if (--it->second.refs == 0)
+        {
+            live.erase(it);
+            detached.erase(offset); // после detach кусок больше никому не нужен
+        }
+    }
+
+    /** Сколько байт файла занято живыми ссылками. */
+    juce::int64 getLiveBytes()
+    {
+        const juce::ScopedLock sl(lock);
+        juce::int64 total = 0;
+        for (const auto& [offset, r] : live)
+            total += (juce::int64)r.size;
+        return total;
+    }
+
+    /** Диапазон ещё можно прочитать: он скопирован в память или файл не менялся. */
+    bool isReadable(juce::int64 offset)
+    {
+        const juce::ScopedLock sl(lock);
+        return isDetached ? detached.count(offset) > 0 : isUnchanged();
+    }
+
+    bool isDetachedSource()
+    {
+        const juce::ScopedLock sl(lock);
+        return isDetached;
+    }
+
+    /** Сколько байт занимает в памяти скопированный при detach() кусок. */
+    size_t getDetachedBytes(juce::int64 offset)
+    {
+        const juce::ScopedLock sl(lock);
+        auto it = detached.find(offset);
+        return it != detached.end() ? it->second.getSize() : 0;
+    }
+
+    /** Копирует в память только занятые диапазоны — дальше диск не нужен.
+        false — живые диапазоны не прочитались: перезапись файла их потеряет. */
+    bool detach()
+    {
+        const juce::ScopedLock sl(lock);
+
+        if (isDetached || live.empty())
+            return true;
+
+        if (!isUnchanged())
+        {
+            // файл подменили в обход программы — спасать уже нечего, перезапись хуже не сделает;
+            // ссылки на него при чтении помечаются failed
+            reportUnavailable(file, "changed on disk before it was detached");
+            return true;
+        }
+
+        std::map<juce::int64, juce::MemoryBlock> copy;
+        juce::FileInputStream in(file);
+        if (!in.openedOk())
+        {
+            reportUnavailable(file, "cannot be opened to detach states");
+            return false;
+        }
+
+        // live упорядочен по смещению — файл читается одним проходом вперёд
+        for (const auto& [offset, r] : live)
+        {
+            juce::MemoryBlock piece(r.size);
+            if (!in.setPosition(offset) || in.read(piece.getData(), r.size) != (int)r.size)
+            {
+                reportUnavailable(file, "cannot be read to detach states");
+                return false;
+            }
+            copy.emplace(offset, std::move(piece));
+        }
+
+        detached = std::move(copy);
+        isDetached = true;
+        return true;
+    }
+
+private:
+    struct LiveRange
+    {
+        size_t size = 0;
+        int refs = 0;
+    };
+
+    juce::int64 stampSize;
+    juce::Time stampTime;
+
+    juce::CriticalSection lock;
+    std::map<juce::int64, LiveRange> live;            // смещение → занятый диапазон
+    std::map<juce::int64, juce::MemoryBlock> detached; // смещение → копия диапазона
+    bool isDetached = false;
+};
+
+//==============================================================================
+struct PluginStateRef::Impl
+{
+    enum class Kind { decoded, base64, fileRange };
+
+    // evict() переводит decoded/base64 в fileRange на месте (под lock):
+    // kind, codec, encoded и поля диапазона читаются под lock
+    std::atomic<Kind> kind { Kind::decoded };
+    size_t size = 0;                        // размер декодированных данных
+    Codec codec = Codec::none;              // как данные лежат в encoded / в файле
+
+    juce::MemoryBlock encoded;              // base64: исходный текст (UTF-8)
+    std::shared_ptr<FileSource> source;     // fileRange
+    juce::int64 offset = 0;
+    size_t storedSize = 0;                  // fileRange: байт в файле
+
+    juce::CriticalSection lock;
+    std::shared_ptr<const juce::MemoryBlock> decoded; // кэш (для Kind::decoded — сами данные)
+    juce::String hash;                                // SHA-256 содержимого (hex), под lock
+    bool failed = false;                              // прочитать не удалось; под lock
+
+    ~Impl()
+    {
+        if (source != nullptr)
+            source->release(offset);
+    }
+
+    /** Переводит Impl на диапазон source (вызывать под lock или до публикации). */
+    void attachRange(std::shared_ptr<FileSource> newSource, juce::int64 newOffset, size_t newStoredSize)
+    {
+        newSource->retain(newOffset, newStoredSize);
+        if (source != nullptr)
+            source->release(offset);
+
+        source = std::move(newSource);
+        offset = newOffset;
+        storedSize = newStoredSize;
+        kind = Kind::fileRange;
+    }
+
+    juce::String encodedText() const
+    {
+        return juce::String::fromUTF8(static_cast<const char*>(encoded.getData()), (int)encoded.getSize());
+    }
+
+    /** Данные в том виде, в каком лежат в файле (после base64, до распаковки). */
+    bool readStored(juce::MemoryBlock& dest) const
+    {
+        if (kind == Kind::base64)
+            return dest.fromBase64Encoding(encodedText());
+
+        if (kind == Kind::fileRange)
+            return source != nullptr && source->read(offset, storedSize, dest);
+
+        return false;
+    }
+
+    /** false — данные недоступны (файл подменён, повреждён): Impl помечается failed
+        навсегда, пустой результат не кэшируется и никуда не применяется. */
+    bool decodeInto(juce::MemoryBlock& dest)
+    {
+        if (kind == Kind::decoded)
+            return true;
+
+        if (!failed && readStored(dest))
+        {
+            if (codec == Codec::none)
+                return true;
+
+            juce::MemoryBlock packed;
+            packed.swapWith(dest);
+            if (decompress(packed.getData(), packed.getSize(), codec, size, dest))
+                return true;
+        }
+
+        dest.reset();
+        if (!failed)
+        {
+            failed = true;
+            reportUnavailable(source != nullptr ? source->file : juce::File(),
+                              kind == Kind::fileRange ? "changed on disk or unreadable, state of "
+                                                            + juce::String((juce::int64)size) + " bytes lost"
+                                                      : "contains a corrupt " + getCodecName(codec) + " state");
+        }
+        return false;
+    }
+
+    /** Единственная копия данных — в памяти: у state'а нет файла, файл перезаписан
+        (диапазон скопирован при detach) или подменён в обход программы (вызывать под lock). */
+    bool dependsOnMemory() const
+    {
+        return kind != Kind::fileRange || source == nullptr
+            || source->isDetachedSource() || !source->isReadable(offset);
+    }
+
+    /** Данные ещё можно получить (вызывать под lock). */
+    bool isReadable() const
+    {
+        if (failed)
+            return false;
+        if (kind == Kind::fileRange)
+            return source != nullptr && source->isReadable(offset);
+        return true;
+    }
+};
+
+//==============================================================================
+// DecodedCache — LRU декодированных state'ов, у которых есть исходный вид.
+// Вытеснение только сбрасывает кэш в Impl; держатели shared_ptr не страдают.
+//==============================================================================
+struct PluginStateRef::DecodedCache
+{
+    juce::CriticalSection lock;
+    std::list<std::weak_ptr<Impl>> order; // front — самый свежий
+    int limit = 0;
+
+    void touch(const std::shared_ptr<Impl>& entry)
+    {
+        std::vector<std::shared_ptr<Impl>> victims;
+        {
+            const juce::ScopedLock sl(lock);
+
+            order.remove_if([&entry](const std::weak_ptr<Impl>& w)
+                {
+                    auto p = w.lock();
+                    return p == nullptr || p == entry;
+                });
+            order.push_front(entry);
+
+            while (limit > 0 && (int)order.size() > limit)
+            {
+                if (auto victim = order.back().lock())
+                    victims.push_back(std::move(victim));
+                order.pop_back();
+            }
+        }
+
+        // замок Impl берём уже без замка кэша — порядок захвата всегда один
+        for (auto& v : victims)
+        {
+            const juce::ScopedLock sl(v->lock);
+            v->decoded.reset();
+        }
+    }
+};
+
+PluginStateRef::DecodedCache& PluginStateRef::decodedCache()
+{
+    static DecodedCache cache;
+    return cache;
+}
+
+//==============================================================================
+// ContentIndex — хеш содержимого → живой Impl (content-addressed хранилище в памяти)
+//==============================================================================
+struct PluginStateRef::ContentIndex
+{
+    juce::CriticalSection lock;
+    std::map<juce::String, std::weak_ptr<Impl>> byHash;
+};
+
+PluginStateRef::ContentIndex& PluginStateRef::contentIndex()
+{
+    static ContentIndex index;
+    return index;
+}
+
+std::shared_ptr<PluginStateRef::Impl> PluginStateRef::intern(std::shared_ptr<Impl> fresh, bool onlyDecoded)
+{
+    auto& index = contentIndex();
+    const juce::ScopedLock sl(index.lock);
+
+    // kind и hash нового Impl ещё никому не видны — читаем без его замка
+    auto& slot = index.byHash[fresh->hash];
+    if (auto existing = slot.lock())
+        if (!onlyDecoded || existing->kind == Impl::Kind::decoded)
+            return existing;
+
+    slot = fresh;
+
+    for (auto it = index.byHash.begin(); it != index.byHash.end();)
+        it = it->second.expired() ? index.byHash.erase(it) : std::next(it);
+
+    return fresh;
+}
+
+//==============================================================================
+namespace
+{
+    struct FileSourceRegistry
+    {
+        juce::CriticalSection lock;
+        std::vector<std::weak_ptr<PluginStateRef::FileSource>> sources;
+    };
+
+    FileSourceRegistry& fileSources()
+    {
+        static FileSourceRegistry registry;
+        return registry;
+    }
+}
+
+//==============================================================================
+PluginStateRef::PluginStateRef(juce::MemoryBlock block)
+{
+    *this = std::move(block);
+}
+
+PluginStateRef& PluginStateRef::operator=(juce::MemoryBlock block)
+{
+    if (block.isEmpty())
+    {
+        impl.reset();
+        return *this;
+    }
+
+    auto i = std::make_shared<Impl>();
+    i->kind = Impl::Kind::decoded;
+    i->size = block.getSize();
+    i->hash = juce::SHA256(block).toHexString();
+    i->decoded = std::make_shared<const juce::MemoryBlock>(std::move(block));
+
+    // делим только с уже декодированной копией: та не зависит от файла на диске
+    impl = intern(std::move(i), true);
+    return *this;
+}
+
+PluginStateRef PluginStateRef::fromBase64(const juce::String& encoded, const juce::String& knownHash,
+                                          Codec codec, size_t decodedSize)
+{
+    PluginStateRef ref;
+
+    // формат JUCE: "<размер>.<данные>" — размер читается без декодирования
+    const int dot = encoded.indexOfChar('.');
+    const int size = dot > 0 ? encoded.substring(0, dot).getIntValue() : 0;
+    if (size <= 0)
+        return ref;
+
+    if (codec != Codec::none && decodedSize == 0)
+        return ref; // без размера распакованных данных state не восстановить
+
+    auto i = std::make_shared<Impl>();
+    i->kind = Impl::Kind::base64;
+    i->codec = codec;
+    i->size = codec != Codec::none ? decodedSize : (size_t)size;
+    i->encoded.replaceAll(encoded.toRawUTF8(), encoded.getNumBytesAsUTF8());
+    i->hash = knownHash;
+    ref.impl = knownHash.isNotEmpty() ? intern(std::move(i), false) : std::move(i);
+    return ref;
+}
+
+PluginStateRef PluginStateRef::fromFileRange(std::shared_ptr<FileSource> source, juce::int64 offset, size_t storedSize,
+                                             const juce::String& knownHash, Codec codec, size_t decodedSize)
+{
+    PluginStateRef ref;
+    if (source == nullptr || storedSize == 0 || (codec != Codec::none && decodedSize == 0))
+        return ref;
+
+    auto i = std::make_shared<Impl>();
+    i->kind = Impl::Kind::fileRange;
+    i->codec = codec;
+    i->size = codec != Codec::none ? decodedSize : storedSize;
+    i->attachRange(std::move(source), offset, storedSize);
+    i->hash = knownHash;
+    ref.impl = knownHash.isNotEmpty() ? intern(std::move(i), false) : std::move(i);
+    return ref;
+}
+
+size_t PluginStateRef::getSize() const noexcept
+{
+    return impl != nullptr ? impl->size : 0;
+}
+
+bool PluginStateRef::isDecoded() const
+{
+    if (impl == nullptr)
+        return true;
+
+    const juce::ScopedLock sl(impl->lock);
+    return impl->decoded != nullptr;
+}
+
+size_t PluginStateRef::getResidentBytes() const
+{
+    if (impl == nullptr)
+        return 0;
+
+    const juce::ScopedLock sl(impl->lock);
+    size_t bytes = impl->encoded.getSize() + (impl->decoded != nullptr ? impl->decoded->getSize() : 0);
+
+    // диапазон файла, который перед перезаписью скопирован в память, тоже занимает RAM
+    if (impl->kind == Impl::Kind::fileRange && impl->source != nullptr)
+        bytes += impl->source->getDetachedBytes(impl->offset);
+
+    return bytes;
+}
+
+juce::int64 PluginStateRef::getResidentBytes(const std::vector<const PluginStateRef*>& refs)
+{
+    std::set<const Impl*> seen;
+    juce::int64 total = 0;
+
+    for (auto* r : refs)
+        if (r != nullptr && r->impl != nullptr && seen.insert(r->impl.get()).second)
+            total += (juce::int64)r->getResidentBytes();
+
+    return total;
+}
+
+bool PluginStateRef::evict(const juce::File& spillFile, Codec codec)
+{
+    if (impl == nullptr)
+        return true;
+
+    {
+        const juce::ScopedLock sl(impl->lock);
+        if (!impl->dependsOnMemory())
+        {
+            impl->decoded.reset(); // исходный вид уже на диске и читается
+            return true;
+        }
+
+        if (impl->kind == Impl::Kind::fileRange)
+        {
+            // файл перезаписан, диапазон живёт копией в памяти — переносим его
+            // в spill как есть, без перекодирования
+            if (impl->source != nullptr && impl->source->isDetachedSource())
+                codec = impl->codec;
+            else if (impl->decoded == nullptr)
+                return false; // файл подменён, а декодированной копии нет — спасать нечего
+        }
+    }
+
+    // из памяти уходит только то, что удалось записать и прочитать обратно
+    auto stored = encodeForStorage(codec);
+    if (stored.isEmpty())
+    {
+        reportUnavailable(spillFile, "not written: state cannot be encoded, kept in memory");
+        return false;
+    }
+
+    // spill-файл только растёт: прежние диапазоны в нём остаются верными
+    juce::int64 offset = 0;
+    const bool written = appendToFile(spillFile, [&]
+        {
+            juce::FileOutputStream out(spillFile);
+            if (!out.openedOk())
+                return false;
+
+            offset = out.getPosition();
+            if (!out.write(stored.getData(), stored.getSize()))
+                return false;
+
+            out.flush();
+            return out.getStatus().wasOk();
+        });
+
+    if (!written)
+    {
+        reportUnavailable(spillFile, "cannot be written, state kept in memory");
+        return false;
+    }
+
+    auto source = openFileSource(spillFile);
+
+    juce::MemoryBlock check;
+    if (!source->read(offset, stored.getSize(), check) || check != stored)
+    {
+        reportUnavailable(spillFile, "does not read back what was written, state kept in memory");
+        return false;
+    }
+
+    const juce::ScopedLock sl(impl->lock);
+    if (impl->dependsOnMemory())
+    {
+        impl->attachRange(std::move(source), offset, stored.getSize());
+        impl->codec = codec;
+        impl->encoded.reset();
+    }
+    impl->decoded.reset();
+    return true;
+}
+
+std::shared_ptr<const juce::MemoryBlock> PluginStateRef::getDecoded() const
+{
+    static const auto empty = std::make_shared<const juce::MemoryBlock>();
+    if (impl == nullptr)
+        return empty;
+
+    std::shared_ptr<const juce::MemoryBlock> result;
+    {
+        const juce::ScopedLock sl(impl->lock);
+        if (impl->decoded == nullptr)
+        {
+            auto block = std::make_shared<juce::MemoryBlock>();
+            if (!impl->decodeInto(*block))
+                return empty; // пустышку не кэшируем: isFailed() отличит её от настоящего state'а
+            impl->decoded = std::move(block);
+        }
+        result = impl->decoded;
+    }
+
+    if (impl->kind != Impl::Kind::decoded)
+        decodedCache().touch(impl);
+
+    return result;
+}
+
+juce::MemoryBlock PluginStateRef::copyDecoded() const
+{
+    if (impl == nullptr)
+        return {};
+
+    const juce::ScopedLock sl(impl->lock);
+    if (impl->decoded != nullptr)
+        return *impl->decoded;
+
+    juce::MemoryBlock block;
+    impl->decodeInto(block);
+    return block;
+}
+
+bool PluginStateRef::isAvailable() const
+{
+    if (impl == nullptr)
+        return true;
+
+    const juce::ScopedLock sl(impl->lock);
+    return impl->decoded != nullptr || impl->isReadable();
+}
+
+bool PluginStateRef::isFailed() const
+{
+    if (impl == nullptr)
+        return false;
+
+    const juce::ScopedLock sl(impl->lock);
+    return impl->failed;
+}
+
+juce::String PluginStateRef::toBase64Encoding() const
+{
+    if (impl == nullptr)
+        return {};
+
+    {
+        const juce::ScopedLock sl(impl->lock);
+        if (impl->kind == Impl::Kind::base64 && impl->codec == Codec::none)
+            return impl->encodedText();
+    }
+
+    return copyDecoded().toBase64Encoding();
+}
+
+juce::MemoryBlock PluginStateRef::encodeForStorage(Codec& codec) const
+{
+    if (impl == nullptr)
+    {
+        codec = Codec::none;
+        return {};
+    }
+
+    // уже лежит в нужном кодеке — переписываем байты как есть
+    {
+        const juce::ScopedLock sl(impl->lock);
+        juce::MemoryBlock stored;
+        if (codec != Codec::none && impl->codec == codec && impl->readStored(stored))
+            return stored;
+    }
+
+    auto raw = copyDecoded();
+    if (codec == Codec::none)
+        return raw;
+
+    auto packed = compress(raw.getData(), raw.getSize(), codec);
+    if (packed.isEmpty() || packed.getSize() >= raw.getSize())
+    {
+        codec = Codec::none;
+        return raw;
+    }
+
+    return packed;
+}
+
+juce::String PluginStateRef::toBase64Encoding(Codec& codec) const
+{
+    if (impl != nullptr)
+    {
+        const juce::ScopedLock sl(impl->lock);
+        if (impl->kind == Impl::Kind::base64 && impl->codec == codec)
+            return impl->encodedText();
+    }
+
+    if (codec == Codec::none)
+        return toBase64Encoding();
+
+    return encodeForStorage(codec).toBase64Encoding();
+}
+
+juce::String PluginStateRef::getContentHash() const
+{
+    if (impl == nullptr)
+        return {};
+
+    {
+        const juce::ScopedLock sl(impl->lock);
+        if (impl->hash.isNotEmpty())
+            return impl->hash;
+    }
+
+    const auto hash = juce::SHA256(copyDecoded()).toHexString();
+
+    const juce::ScopedLock sl(impl->lock);
+    if (impl->hash.isEmpty())
+        impl->hash = hash;
+    return impl->hash;
+}
+
+bool PluginStateRef::operator==(const PluginStateRef& other) const
+{
+    if (impl == other.impl)
+        return true;
+
+    if (getSize() != other.getSize())
+        return false;
+
+    if (getSize() == 0)
+        return true;
+
+    {
+        // замки в порядке адресов — встречное сравнение не взаимоблокируется
+        auto* first = impl.get() < other.impl.get() ? impl.get() : other.impl.get();
+        auto* second = first == impl.get() ? other.impl.get() : impl.get();
+        const juce::ScopedLock sl1(first->lock);
+        const juce::ScopedLock sl2(second->lock);
+
+        if (impl->kind == Impl::Kind::base64 && other.impl->kind == Impl::Kind::base64
+            && impl->encoded == other.impl->encoded)
+            return true;
+    }
+
+    {
+        juce::String h1, h2;
+        { const juce::ScopedLock sl(impl->lock);       h1 = impl->hash; }
+        { const juce::ScopedLock sl(other.impl->lock); h2 = other.impl->hash; }
+        if (h1.isNotEmpty() && h2.isNotEmpty())
+            return h1 == h2;
+    }
+
+    return *getDecoded() == *other.getDecoded();
+}
+
+//==============================================================================
+void PluginStateRef::setDecodedCacheLimit(int maxDecoded)
+{
+    auto& cache = decodedCache();
+    {
+        const juce::ScopedLock sl(cache.lock);
+        cache.limit = juce::jmax(0, maxDecoded);
+    }
+
+    DBG("[PluginStateRef] decoded cache limit = " << maxDecoded);
+}
+
+int PluginStateRef::getDecodedCacheLimit()
+{
+    auto& cache = decodedCache();
+    const juce::ScopedLock sl(cache.lock);
+    return cache.limit;
+}
+
+std::shared_ptr<PluginStateRef::FileSource> PluginStateRef::openFileSource(const juce::File& file)
+{
+    auto source = std::make_shared<FileSource>(file);
+
+    auto& registry = fileSources();
+    const juce::ScopedLock sl(registry.lock);
+
+    registry.sources.erase(std::remove_if(registry.sources.begin(), registry.sources.end(),
+        [](const std::weak_ptr<FileSource>& w) { return w.expired(); }),
+        registry.sources.end());
+    registry.sources.push_back(source);
+
+    return source;
+}
+
+//==============================================================================
+juce::String PluginStateRef::getCodecName(Codec codec)
+{
+    switch (codec)
+    {
+    case Codec::zlib: return "zlib";
+    case Codec::none:
+    default:          return "none";
+    }
+}
+
+bool PluginStateRef::parseCodecName(const juce::String& name, Codec& codec)
+{
+    if (name.isEmpty() || name.equalsIgnoreCase("none")) { codec = Codec::none; return true; }
+    if (name.equalsIgnoreCase("zlib"))                   { codec = Codec::zlib; return true; }
+    return false;
+}
+
+juce::MemoryBlock PluginStateRef::compress(const void* data, size_t size, Codec codec)
+{
+    if (codec != Codec::zlib)
+        return juce::MemoryBlock(data, size);
+
+    juce::MemoryOutputStream mo;
+    {
+        juce::GZIPCompressorOutputStream zip(mo, 6); // windowBits 0 — формат zlib
+        zip.write(data, size);
+        zip.flush();
+    }
+    return mo.getMemoryBlock();
+}
+
+bool PluginStateRef::decompress(const void* data, size_t size, Codec codec, size_t decodedSize, juce::MemoryBlock& dest)
+{
+    if (codec == Codec::none)
+    {
+        dest.replaceAll(data, size);
+        return true;
+    }
+
+    juce::MemoryInputStream packed(data, size, false);
+    juce::GZIPDecompressorInputStream unzip(&packed, false, juce::GZIPDecompressorInputStream::zlibFormat,
+                                            (juce::int64)decodedSize);
+
+    dest.setSize(decodedSize);
+    size_t done = 0;
+    while (done < decodedSize)
+    {
+        const int n = unzip.read(static_cast<char*>(dest.getData()) + done, (int)juce::jmin<size_t>(decodedSize - done, 1 << 20));
+        if (n <= 0)
+            break;
+        done += (size_t)n;
+    }
+
+    return done == decodedSize;
+}
+
+namespace
+{
+    std::vector<std::shared_ptr<PluginStateRef::FileSource>> findFileSources(const juce::File& file)
+    {
+        std::vector<std::shared_ptr<PluginStateRef::FileSource>> matching;
+
+        auto& registry = fileSources();
+        const juce::ScopedLock sl(registry.lock);
+
+        for (const auto& w : registry.sources)
+            if (auto s = w.lock())
+                if (s->file == file)
+                    matching.push_back(std::move(s));
+
+        return matching;
+    }
+}
+
+juce::int64 PluginStateRef::getLiveBytes(const juce::File& file)
+{
+    juce::int64 total = 0;
+    for (auto& s : findFileSources(file))
+        total += s->getLiveBytes();
+    return total;
+}
+
+bool PluginStateRef::detachFileSources(const juce::File& file)
+{
+    bool ok = true;
+    for (auto& s : findFileSources(file))
+        ok = s->detach() && ok;
+    return ok;
+}
+
+bool PluginStateRef::appendToFile(const juce::File& file, const std::function<bool()>& append)
+{
+    auto matching = findFileSources(file);
+
+    // чтения из этого файла ждут, пока идёт дозапись: иначе они увидели бы
+    // новый размер при старой отметке и сочли бы файл подменённым
+    std::vector<bool> wasUnchanged;
+    for (auto& s : matching)
+    {
+        s->getLock().enter();
+        wasUnchanged.push_back(s->isUnchanged());
+    }
+
+    const bool ok = append();
+
+    for (size_t i = matching.size(); i-- > 0;)
+    {
+        matching[i]->restamp(wasUnchanged[i]);
+        matching[i]->getLock().exit();
+    }
+
+    return ok;
+}
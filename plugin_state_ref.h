@@ -0,0 +1,139 @@
+#pragma once
+#include <JuceHeader.h>
+#include <functional>
+#include <memory>
+#include <vector>
+
+//==============================================================================
+// PluginStateRef — state плагина одного банка с отложенным декодированием.
+// После загрузки библиотеки state остаётся в исходном виде: base64-текст из
+// XML или диапазон байтов в .nxb-файле. Декодируется один раз — при первом
+// getDecoded() (applyBankToPlugin / checkForChanges) — и кэшируется.
+// Число одновременно декодированных state'ов можно ограничить
+// (setDecodedCacheLimit): давно не нужные возвращаются в исходный вид.
+// Копии разделяют одни и те же неизменяемые данные, копирование дешёвое.
+// Одинаковые state'ы (по SHA-256 содержимого) в памяти хранятся один раз —
+// и внутри библиотеки, и между библиотеками, пока хоть одна ссылка жива.
+// В файле state может лежать сжатым (Codec): распаковка — часть декодирования.
+// evict() выгружает state из памяти совсем: остаётся только диапазон в файле
+// (при необходимости state сначала дописывается в spill-файл).
+//==============================================================================
+class PluginStateRef
+{
+public:
+    class FileSource;
+
+    /** Кодек хранения state'а в файле; тег пишется рядом с данными. */
+    enum class Codec { none, zlib };
+
+    PluginStateRef() = default;
+    PluginStateRef(juce::MemoryBlock decoded);
+    PluginStateRef& operator=(juce::MemoryBlock decoded);
+
+    /** Текст в формате MemoryBlock::toBase64Encoding ("size.data"); декодируется позже.
+        knownHash — хеш содержимого из файла (если есть): по нему ищется уже живая копия.
+        Для codec != none в base64 лежат сжатые данные, decodedSize — их размер после распаковки. */
+    static PluginStateRef fromBase64(const juce::String& encoded, const juce::String& knownHash = {},
+                                     Codec codec = Codec::none, size_t decodedSize = 0);
+
+    /** Байты state'а внутри файла библиотеки: [offset, offset + storedSize). */
+    static PluginStateRef fromFileRange(std::shared_ptr<FileSource> source, juce::int64 offset, size_t storedSize,
+                                        const juce::String& knownHash = {},
+                                        Codec codec = Codec::none, size_t decodedSize = 0);
+
+    void reset() noexcept { impl.reset(); }
+    bool isEmpty() const noexcept { return getSize() == 0; }
+
+    /** Размер декодированного state'а — известен без декодирования. */
+    size_t getSize() const noexcept;
+
+    /** true, если state уже лежит в памяти в декодированном виде. */
+    bool isDecoded() const;
+
+    /** Сколько байт state занимает в памяти сейчас: декодированная копия,
+        исходный base64-текст и/или диапазон файла, скопированный в память
+        перед его перезаписью; диапазон, читаемый с диска, — 0. */
+    size_t getResidentBytes() const;
+
+    /** То же для набора ссылок; общие данные (один блоб у нескольких банков) считаются один раз. */
+    static juce::int64 getResidentBytes(const std::vector<const PluginStateRef*>& refs);
+
+    /** Оставляет state только на диске. Если у него нет файла-источника (снят с плагина,
+        прочитан из XML) или файл-источник уже перезаписан (диапазон скопирован в память),
+        данные сначала дописываются в spillFile в кодеке codec и читаются обратно для сверки.
+        Действует на все копии ссылки; false — запись не удалась или не сверилась
+        (пишется в лог, state остаётся в памяти). */
+    bool evict(const juce::File& spillFile, Codec codec);
+
+    /** false — state уже не прочитать: его файл изменён или удалён в обход программы,
+        данные повреждены. Такой state нельзя ни применять к плагину, ни сохранять. */
+    bool isAvailable() const;
+
+    /** Чтение state'а уже не удалось (пишется в лог один раз); пустой результат
+        getDecoded()/copyDecoded() у такого state'а — не данные, а ошибка. */
+    bool isFailed() const;
+
+    /** Декодирует (один раз) и возвращает state; никогда не nullptr.
+        При ошибке чтения — пустой блок, который не кэшируется (см. isFailed()). */
+    std::shared_ptr<const juce::MemoryBlock> getDecoded() const;
+
+    /** Копия state'а для сериализации — без попадания в кэш декодированных. */
+    juce::MemoryBlock copyDecoded() const;
+
+    /** base64 для XML; исходный текст отдаётся как есть, без декодирования. */
+    juce::String toBase64Encoding() const;
+
+    /** Данные для записи в файл в кодеке codec. Уже сжатые тем же кодеком данные
+        отдаются без пересжатия; если сжатие не даёт выигрыша, codec становится none. */
+    juce::MemoryBlock encodeForStorage(Codec& codec) const;
+
+    /** То же в base64 (для XML). */
+    juce::String toBase64Encoding(Codec& codec) const;
+
+    /** SHA-256 содержимого (hex) — ключ в хранилище блобов; считается один раз. */
+    juce::String getContentHash() const;
+
+    bool operator==(const PluginStateRef& other) const;
+    bool operator!=(const PluginStateRef& other) const { return !(*this == other); }
+
+    //==========================================================================
+    /** Сколько state'ов держать декодированными одновременно (0 — без ограничения). */
+    static void setDecodedCacheLimit(int maxDecoded);
+    static int getDecodedCacheLimit();
+
+    /** Файл-источник для fromFileRange (запоминает размер и время изменения). */
+    static std::shared_ptr<FileSource> openFileSource(const juce::File& file);
+
+    /** Вызывается перед перезаписью файла: ссылки на него перестают зависеть от диска.
+        В память копируются только диапазоны, на которые есть живые ссылки.
+        false — файл не прочитался: перезаписывать его нельзя, живые state'ы пропадут. */
+    static bool detachFileSources(const juce::File& file);
+
+    /** Сколько байт файла занято живыми ссылками (остальное в нём — мёртвые диапазоны). */
+    static juce::int64 getLiveBytes(const juce::File& file);
+
+    /** Дозапись в конец файла старые байты не трогает: append выполняется под замками
+        источников этого файла, после чего их отметки размера/времени обновляются. */
+    static bool appendToFile(const juce::File& file, const std::function<bool()>& append);
+
+    //==========================================================================
+    static juce::String getCodecName(Codec codec);
+    /** false — кодек неизвестен (файл из более новой версии). */
+    static bool parseCodecName(const juce::String& name, Codec& codec);
+
+    static juce::MemoryBlock compress(const void* data, size_t size, Codec codec);
+    static bool decompress(const void* data, size_t size, Codec codec, size_t decodedSize, juce::MemoryBlock& dest);
+
+private:
+    struct Impl;
+    struct DecodedCache;
+    struct ContentIndex;
+
+    static DecodedCache& decodedCache();
+    static ContentIndex& contentIndex();
+
+    /** Уже живой Impl с тем же хешем — или сам fresh (и он регистрируется). */
+    static std::shared_ptr<Impl> intern(std::shared_ptr<Impl> fresh, bool onlyDecoded);
+
+    std::shared_ptr<Impl> impl;
+};
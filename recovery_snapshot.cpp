@@ -0,0 +1,248 @@
+#include "recovery_snapshot.h"
+#include "bank_library.h"
+#include <cstring>
+
+//==============================================================================
+// Раскладка (little-endian):
+//   [0, trailerOffset)   библиотека в формате .nxb (state'ы читаются по смещению)
+//   трейлер:  char[4] "NXRS"; u32 version;
+//             string путь рабочего файла (u32 длина + UTF-8);
+//             i32 активный слот; u32 число слотов;
+//             по слотам: u64 размер state'а; байты state'а
+//   конец:    u64 trailerOffset; char[4] "NXRI"
+//==============================================================================
+namespace
+{
+    constexpr char kTrailerMagic[4] = { 'N', 'X', 'R', 'S' };
+    constexpr char kEndMagic[4] = { 'N', 'X', 'R', 'I' };
+    constexpr uint32_t kVersion = 1;
+    constexpr size_t kEndSize = 12;
+    constexpr uint32_t kMaxSlots = 64;
+
+    double ticksToMs(juce::int64 ticks)
+    {
+        return juce::Time::highResolutionTicksToSeconds(ticks) * 1000.0;
+    }
+
+    void writeString(juce::MemoryOutputStream& mo, const juce::String& s)
+    {
+        const auto utf8 = s.toUTF8();
+        const auto len = utf8.sizeInBytes() - 1;
+        mo.writeInt((int)len);
+        mo.write(utf8.getAddress(), len);
+    }
+
+    juce::String readString(juce::MemoryInputStream& in)
+    {
+        const auto len = (size_t)(uint32_t)in.readInt();
+        if (len > (size_t)in.getNumBytesRemaining())
+            return {};
+
+        juce::MemoryBlock text(len);
+        in.read(text.getData(), (int)len);
+        return juce::String::fromUTF8(static_cast<const char*>(text.getData()), (int)len);
+    }
+}
+
+RecoverySnapshotter::RecoverySnapshotter(const juce::File& fileToUse)
+    : juce::Thread("RecoverySnapshotter"),
+      file(fileToUse),
+      runningMarker(fileToUse.withFileExtension("running"))
+{
+}
+
+RecoverySnapshotter::~RecoverySnapshotter()
+{
+    stopTimer();
+    signalThreadShouldExit();
+    wakeUp.signal();
+    stopThread(4000);
+}
+
+juce::File RecoverySnapshotter::getDefaultFile()
+{
+    auto sysDir = juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+        .getChildFile("NEXUS_KONTROL_OS");
+    sysDir.createDirectory();
+    return sysDir.getChildFile("recovery.nxr");
+}
+
+bool RecoverySnapshotter::previousRunCrashed()
+{
+    if (runningMarker.existsAsFile())
+        return true;
+
+    // выход был штатным, а файл пережил его (удаление не прошло) — восстанавливать его нельзя
+    if (file.existsAsFile())
+    {
+        DBG("[Recovery] stale snapshot after a clean exit, discarded: " << file.getFullPathName());
+        file.deleteFile();
+    }
+    return false;
+}
+
+void RecoverySnapshotter::start(Capture newCapture, int intervalMs)
+{
+    runningMarker.create();
+    capture = std::move(newCapture);
+    startThread();
+    startTimer(intervalMs);
+}
+
+void RecoverySnapshotter::stopAndDiscard()
+{
+    stopTimer();
+    signalThreadShouldExit();
+    wakeUp.signal();
+    stopThread(4000);
+
+    {
+        const juce::ScopedLock sl(lock);
+        back.reset();
+    }
+
+    // state'ы, ещё не прочитанные из восстановленного файла, забираем в память
+    PluginStateRef::detachFileSources(file);
+    file.deleteFile();
+
+    // метка — последней: выход, прерванный до этой строки, считается падением
+    runningMarker.deleteFile();
+}
+
+RecoverySnapshotter::Stats RecoverySnapshotter::getStats() const
+{
+    const juce::ScopedLock sl(lock);
+    return stats;
+}
+
+void RecoverySnapshotter::timerCallback()
+{
+    if (capture == nullptr)
+        return;
+
+    const auto t0 = juce::Time::getHighResolutionTicks();
+    std::shared_ptr<const Snapshot> snapshot = capture();
+    if (snapshot == nullptr)
+        return;
+
+    {
+        const juce::ScopedLock sl(lock);
+        back = std::move(snapshot); // незабранный старый снимок просто заменяется
+        ++stats.captures;
+        stats.lastCaptureMs = ticksToMs(juce::Time::getHighResolutionTicks() - t0);
+    }
+
+    wakeUp.signal();
+}
+
+void RecoverySnapshotter::run()
+{
+    while (!threadShouldExit())
+    {
+        wakeUp.wait(-1);
+
+        std::shared_ptr<const Snapshot> front;
+        {
+            const juce::ScopedLock sl(lock);
+            front.swap(back);
+        }
+
+        if (front != nullptr && !write(*front))
+            DBG("[Recovery] failed to write " << file.getFullPathName());
+    }
+}
+
+bool RecoverySnapshotter::write(const Snapshot& snapshot)
+{
+    const auto t0 = juce::Time::getHighResolutionTicks();
+
+    if (snapshot.library == nullptr)
+        return false;
+
+    juce::MemoryOutputStream mo;
+    if (!BankLibraryIO::writeBinary(mo, *snapshot.library))
+        return false;
+    const auto trailerOffset = (juce::int64)mo.getPosition();
+
+    mo.write(kTrailerMagic, 4);
+    mo.writeInt((int)kVersion);
+    writeString(mo, snapshot.libraryFile.getFullPathName());
+    mo.writeInt(snapshot.activeSlot);
+    mo.writeInt((int)snapshot.slotStates.size());
+    for (const auto& state : snapshot.slotStates)
+    {
+        mo.writeInt64((juce::int64)state.getSize());
+        mo.write(state.getData(), state.getSize());
+    }
+
+    mo.writeInt64(trailerOffset);
+    mo.write(kEndMagic, 4);
+
+    // между снимками ничего не менялось — диск не трогаем
+    auto hash = juce::SHA256(mo.getData(), mo.getDataSize()).getRawData();
+    if (hash == lastWrittenHash)
+    {
+        const juce::ScopedLock sl(lock);
+        ++stats.unchanged;
+        return true;
+    }
+
+    if (!BankLibraryIO::replaceFileAtomically(file, mo.getData(), mo.getDataSize()))
+        return false;
+
+    lastWrittenHash = std::move(hash);
+
+    const juce::ScopedLock sl(lock);
+    ++stats.writes;
+    stats.lastWriteMs = ticksToMs(juce::Time::getHighResolutionTicks() - t0);
+    stats.lastBytes = (juce::int64)mo.getDataSize();
+    return true;
+}
+
+bool RecoverySnapshotter::read(const juce::File& fileToRead, Snapshot& out)
+{
+    if (!fileToRead.existsAsFile())
+        return false;
+
+    // источник берётся до отображения — как в BankLibraryIO::readBinary
+    auto stateSource = PluginStateRef::openFileSource(fileToRead);
+    juce::MemoryMappedFile mapped(fileToRead, juce::MemoryMappedFile::readOnly);
+    auto* data = static_cast<const char*>(mapped.getData());
+    const auto size = mapped.getSize();
+
+    if (data == nullptr || size < kEndSize || std::memcmp(data + size - 4, kEndMagic, 4) != 0)
+        return false;
+
+    const auto trailerOffset = (size_t)juce::ByteOrder::littleEndianInt64(data + size - kEndSize);
+    if (trailerOffset >= size - kEndSize)
+        return false;
+
+    juce::MemoryInputStream in(data + trailerOffset, size - kEndSize - trailerOffset, false);
+
+    char magic[4] = {};
+    if (in.read(magic, 4) != 4 || std::memcmp(magic, kTrailerMagic, 4) != 0
+        || (uint32_t)in.readInt() != kVersion)
+        return false;
+
+    out.libraryFile = juce::File(readString(in));
+    out.activeSlot = in.readInt();
+
+    const auto numSlots = (uint32_t)in.readInt();
+    if (numSlots > kMaxSlots)
+        return false;
+
+    out.slotStates.assign(numSlots, {});
+    for (auto& state : out.slotStates)
+    {
+        const auto stateSize = in.readInt64();
+        if (stateSize < 0 || stateSize > in.getNumBytesRemaining())
+            return false;
+
+        state.setSize((size_t)stateSize);
+        in.read(state.getData(), (int)stateSize);
+    }
+
+    // --- Библиотека: .nxb-часть файла, state'ы банков — ссылками на него ---
+    out.library = std::make_shared<BankLibrary>();
+    return BankLibraryIO::readBinary(data, trailerOffset, *out.library, {}, stateSource);
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <JuceHeader.h>
+#include <functional>
+#include <memory>
+#include <vector>
+
+struct BankLibrary;
+
+//==============================================================================
+// RecoverySnapshotter — страховка от падения хоста посреди выступления.
+// Раз в intervalMs message thread снимает состояние (banks в памяти со всеми
+// несохранёнными правками, активные индексы, state плагина каждого слота) и
+// только отдаёт снимок — двойной буфер: поток записи забирает последний
+// снимок себе, а новый тем временем копится во втором; UI запись не ждёт.
+// Файл пишется атомарно (temp → fsync → rename): библиотека в формате .nxb,
+// за ней трейлер со слотами. Одинаковый снимок повторно не пишется.
+// start() ставит рядом метку сеанса, штатный выход удаляет файл и снимает её.
+// Метка на старте — прошлый запуск упал (previousRunCrashed), и read()
+// восстанавливает состояние: .nxb отображается в память, state'ы банков
+// читаются лениво — быстрее обычной загрузки библиотеки.
+//==============================================================================
+class RecoverySnapshotter : private juce::Thread,
+                            private juce::Timer
+{
+public:
+    struct Snapshot
+    {
+        juce::File libraryFile;                 // рабочий файл в момент снимка
+        std::shared_ptr<BankLibrary> library;   // banks из памяти, не с диска
+        int activeSlot = 0;
+        std::vector<juce::MemoryBlock> slotStates;   // по слотам VST; пустой — слот пуст
+    };
+
+    struct Stats
+    {
+        int captures = 0;
+        int writes = 0;
+        int unchanged = 0;                      // снимок совпал с записанным — не писали
+        double lastCaptureMs = 0.0;             // message thread
+        double lastWriteMs = 0.0;               // поток записи
+        juce::int64 lastBytes = 0;
+    };
+
+    /** Снимок берётся в message thread; nullptr — пропустить этот интервал. */
+    using Capture = std::function<std::unique_ptr<Snapshot>()>;
+
+    explicit RecoverySnapshotter(const juce::File& file = getDefaultFile());
+    ~RecoverySnapshotter() override;
+
+    /** recovery.nxr рядом с boot_config.xml. */
+    static juce::File getDefaultFile();
+
+    /** Прошлый запуск не дошёл до stopAndDiscard(): его метка сеанса осталась на диске.
+        Снимок без метки — остаток штатного выхода, который не удалось удалить: он удаляется.
+        Вызывать один раз до start() — start() ставит метку заново. */
+    bool previousRunCrashed();
+
+    /** Ставит метку сеанса и начинает снимать состояние раз в intervalMs. */
+    void start(Capture capture, int intervalMs = defaultIntervalMs);
+
+    /** Штатный выход: снимки прекращаются, файл удаляется, метка снимается. */
+    void stopAndDiscard();
+
+    Stats getStats() const;
+
+    /** Снимок прошлого запуска; false — файла нет (выход был штатным) или он повреждён. */
+    static bool read(const juce::File& file, Snapshot& out);
+
+    static constexpr int defaultIntervalMs = 3000;
+
+private:
+    void timerCallback() override;
+    void run() override;
+    bool write(const Snapshot& snapshot);
+
+    const juce::File file;
+    const juce::File runningMarker;             // есть, пока сеанс не завершён штатно
+    Capture capture;
+
+    mutable juce::CriticalSection lock;
+    std::shared_ptr<const Snapshot> back;       // последний снятый, ещё не забран потоком
+    juce::MemoryBlock lastWrittenHash;          // только поток записи
+    Stats stats;
+
+    juce::WaitableEvent wakeUp;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RecoverySnapshotter)
+};
@@ -0,0 +1,227 @@
+#include "session_image.h"
+#include "bank_library.h"
+#include <cstring>
+
+//==============================================================================
+// Раскладка (little-endian):
+//   [0, trailerOffset)   библиотека в формате .nxb (state'ы читаются по смещению)
+//   трейлер:  char[4] "NXSS"; u32 version;
+//             string путь исходного файла (u32 длина + UTF-8);
+//             i64 размер; i64 время изменения (мс); u8[32] SHA-256 файла;
+//             i32 индекс активного банка; u64 размер state'а; байты state'а
+//   конец:    u64 trailerOffset; char[4] "NXSI"
+//==============================================================================
+namespace
+{
+    constexpr char kTrailerMagic[4] = { 'N', 'X', 'S', 'S' };
+    constexpr char kEndMagic[4] = { 'N', 'X', 'S', 'I' };
+    constexpr uint32_t kVersion = 1;
+    constexpr size_t kEndSize = 12;
+
+    void writeString(juce::MemoryOutputStream& mo, const juce::String& s)
+    {
+        const auto utf8 = s.toUTF8();
+        const auto len = utf8.sizeInBytes() - 1;
+        mo.writeInt((int)len);
+        mo.write(utf8.getAddress(), len);
+    }
+
+    juce::String readString(juce::MemoryInputStream& in)
+    {
+        const auto len = (size_t)(uint32_t)in.readInt();
+        if (len > (size_t)in.getNumBytesRemaining())
+            return {};
+
+        juce::MemoryBlock text(len);
+        in.read(text.getData(), (int)len);
+        return juce::String::fromUTF8(static_cast<const char*>(text.getData()), (int)len);
+    }
+
+    juce::MemoryBlock hashFile(const juce::File& file)
+    {
+        return juce::SHA256(file).getRawData();
+    }
+}
+
+namespace SessionImage
+{
+    juce::File getDefaultFile()
+    {
+        auto sysDir = juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+            .getChildFile("NEXUS_KONTROL_OS");
+        sysDir.createDirectory();
+        return sysDir.getChildFile("session_image.nxs");
+    }
+
+    bool write(const juce::File& imageFile, const juce::File& libraryFile, const BankLibrary& lib, int activeBank)
+    {
+        if (!libraryFile.existsAsFile())
+            return false;
+
+        const auto stampSize = libraryFile.getSize();
+        const auto stampTime = libraryFile.getLastModificationTime();
+        const auto hash = hashFile(libraryFile);
+
+        juce::MemoryOutputStream mo;
+        if (!BankLibraryIO::writeBinary(mo, lib))
+            return false;
+        const auto trailerOffset = (juce::int64)mo.getPosition();
+
+        mo.write(kTrailerMagic, 4);
+        mo.writeInt((int)kVersion);
+        writeString(mo, libraryFile.getFullPathName());
+        mo.writeInt64(stampSize);
+        mo.writeInt64(stampTime.toMilliseconds());
+        mo.write(hash.getData(), hash.getSize());
+
+        // state банка, с которого начнётся сеанс, — уже распакованным: на старте он нужен первым
+        const bool hasActive = juce::isPositiveAndBelow(activeBank, (int)lib.banks.size());
+        const auto active = hasActive ? lib.banks[(size_t)activeBank].pluginState.getDecoded()
+                                      : std::make_shared<const juce::MemoryBlock>();
+        if (hasActive && lib.banks[(size_t)activeBank].pluginState.isFailed())
+            return false;
+        mo.writeInt(hasActive ? activeBank : -1);
+        mo.writeInt64((juce::int64)active->getSize());
+        mo.write(active->getData(), active->getSize());
+
+        mo.writeInt64(trailerOffset);
+        mo.write(kEndMagic, 4);
+
+        // файл источника за время записи не должен был измениться
+        if (libraryFile.getSize() != stampSize || libraryFile.getLastModificationTime() != stampTime)
+            return false;
+
+        return BankLibraryIO::replaceFileAtomically(imageFile, mo.getData(), mo.getDataSize());
+    }
+
+    bool read(const juce::File& imageFile, const juce::File& libraryFile, BankLibrary& out,
+              juce::MemoryBlock* deferredHash)
+    {
+        if (!imageFile.existsAsFile() || !libraryFile.existsAsFile())
+            return false;
+
+        // источник берётся до отображения — как в BankLibraryIO::readBinary
+        auto stateSource = PluginStateRef::openFileSource(imageFile);
+        juce::MemoryMappedFile mapped(imageFile, juce::MemoryMappedFile::readOnly);
+        auto* data = static_cast<const char*>(mapped.getData());
+        const auto size = mapped.getSize();
+
+        if (data == nullptr || size < kEndSize || std::memcmp(data + size - 4, kEndMagic, 4) != 0)
+            return false;
+
+        const auto trailerOffset = (size_t)juce::ByteOrder::littleEndianInt64(data + size - kEndSize);
+        if (trailerOffset >= size - kEndSize)
+            return false;
+
+        juce::MemoryInputStream in(data + trailerOffset, size - kEndSize - trailerOffset, false);
+
+        char magic[4] = {};
+        if (in.read(magic, 4) != 4 || std::memcmp(magic, kTrailerMagic, 4) != 0
+            || (uint32_t)in.readInt() != kVersion)
+            return false;
+
+        // --- Исходный файл: тот же путь, размер, время и содержимое ---
+        const auto path = readString(in);
+        const auto stampSize = in.readInt64();
+        const auto stampTime = in.readInt64();
+
+        juce::MemoryBlock hash(32);
+        if (in.read(hash.getData(), 32) != 32)
+            return false;
+
+        if (juce::File(path) != libraryFile
+            || libraryFile.getSize() != stampSize
+            || libraryFile.getLastModificationTime().toMilliseconds() != stampTime)
+        {
+            DBG("[SessionImage] library changed since shutdown: " << libraryFile.getFullPathName());
+            return false;
+        }
+
+        if (deferredHash != nullptr)
+            *deferredHash = hash;
+        else if (hashFile(libraryFile) != hash)
+        {
+            DBG("[SessionImage] library content differs: " << libraryFile.getFullPathName());
+            return false;
+        }
+
+        const int activeBank = in.readInt();
+        const auto stateSize = in.readInt64();
+        if (stateSize < 0 || stateSize > in.getNumBytesRemaining())
+            return false;
+
+        const auto stateOffset = trailerOffset + (size_t)in.getPosition();
+
+        // --- Библиотека: .nxb-часть образа, state'ы — ссылками на образ ---
+        if (!BankLibraryIO::readBinary(data, trailerOffset, out, {}, stateSource))
+            return false;
+
+        if (juce::isPositiveAndBelow(activeBank, (int)out.banks.size()) && stateSize > 0)
+            out.banks[(size_t)activeBank].pluginState = juce::MemoryBlock(data + stateOffset, (size_t)stateSize);
+
+        return true;
+    }
+
+    //==========================================================================
+    ContentCheck::ContentCheck() : juce::Thread("SessionImageCheck") {}
+
+    ContentCheck::~ContentCheck()
+    {
+        cancel();
+        stopThread(4000);
+    }
+
+    void ContentCheck::start(const juce::File& libraryFile, const juce::MemoryBlock& expectedHash, Callback onDone)
+    {
+        // прежняя сверка дочитывает файл — дожидаемся её, результат всё равно отбрасывается
+        cancel();
+        stopThread(4000);
+
+        {
+            const juce::ScopedLock sl(lock);
+            file = libraryFile;
+            expected = expectedHash;
+            callback = std::move(onDone);
+        }
+
+        startThread();
+    }
+
+    void ContentCheck::cancel()
+    {
+        const juce::ScopedLock sl(lock);
+        ++generation;
+        callback = nullptr;
+    }
+
+    void ContentCheck::run()
+    {
+        juce::File target;
+        juce::MemoryBlock hash;
+        uint32_t startedGeneration = 0;
+        {
+            const juce::ScopedLock sl(lock);
+            target = file;
+            hash = expected;
+            startedGeneration = generation;
+        }
+
+        const auto t0 = juce::Time::getHighResolutionTicks();
+        const bool matches = hashFile(target) == hash;
+        DBG("[SessionImage] content check " << (matches ? "ok" : "FAILED") << " in "
+            << juce::String(juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - t0) * 1000.0, 1)
+            << " ms: " << target.getFullPathName());
+
+        Callback onDone;
+        {
+            const juce::ScopedLock sl(lock);
+            if (generation != startedGeneration || threadShouldExit())
+                return;
+            onDone = std::move(callback);
+            callback = nullptr;
+        }
+
+        if (onDone != nullptr)
+            juce::MessageManager::callAsync([onDone, matches] { onDone(matches); });
+    }
+}
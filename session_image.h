@@ -0,0 +1,60 @@
+#pragma once
+#include <JuceHeader.h>
+#include <functional>
+
+struct BankLibrary;
+
+//==============================================================================
+// SessionImage — снимок активной библиотеки для быстрого старта.
+// Пишется при штатном выходе: библиотека в формате .nxb, за ней — трейлер
+// с путём исходного файла, его размером, временем изменения и SHA-256,
+// а также распакованный state банка, на котором закончился сеанс. При старте образ
+// принимается, только если исходный файл не изменился (размер, время и хеш
+// совпадают) — тогда XML не разбирается, а state банков берутся из образа
+// лениво. Иначе — обычная загрузка файла.
+// Хеш всего файла на старте дорог: read() может сверить только размер и время
+// и отдать хеш из образа — содержимое досверяет ContentCheck, когда звук уже идёт.
+//==============================================================================
+namespace SessionImage
+{
+    /** Файл образа рядом с boot_config.xml. */
+    juce::File getDefaultFile();
+
+    /** lib — содержимое libraryFile в том виде, в каком оно лежит на диске.
+        activeBank — банк, который выберет следующий старт (из boot_config.xml):
+        его state кладётся в образ уже распакованным. */
+    bool write(const juce::File& imageFile, const juce::File& libraryFile, const BankLibrary& lib, int activeBank);
+
+    /** false — образа нет, он повреждён или libraryFile с тех пор изменился.
+        deferredHash != nullptr — содержимое файла не хешируется: сюда кладётся
+        SHA-256 из образа, сверка — за вызывающим (ContentCheck). */
+    bool read(const juce::File& imageFile, const juce::File& libraryFile, BankLibrary& out,
+              juce::MemoryBlock* deferredHash = nullptr);
+
+    //==========================================================================
+    /** Фоновая сверка SHA-256 файла библиотеки с хешем из образа. */
+    class ContentCheck : private juce::Thread
+    {
+    public:
+        /** matches приходит в message thread. */
+        using Callback = std::function<void(bool matches)>;
+
+        ContentCheck();
+        ~ContentCheck() override;
+
+        /** Прежняя незавершённая сверка отменяется (её результат не придёт). */
+        void start(const juce::File& libraryFile, const juce::MemoryBlock& expectedHash, Callback onDone);
+        void cancel();
+
+    private:
+        void run() override;
+
+        juce::CriticalSection lock;
+        juce::File file;
+        juce::MemoryBlock expected;
+        Callback callback;
+        uint32_t generation = 0;    // меняется с каждым start()/cancel(): устаревший результат не отдаётся
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ContentCheck)
+    };
+}
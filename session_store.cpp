@@ -0,0 +1,183 @@
+#include "session_store.h"
+#include "bank_library.h"
+
+namespace
+{
+    // атрибуты, которыми управляет SessionStore; остальные — settings
+    const juce::Identifier filePathId("FilePath"), fileNameId("FileName"),
+                           activeBankId("ActiveBank"), activePresetId("ActivePreset"), activeSlotId("ActiveSlot");
+}
+
+SessionStore::SessionStore(const juce::File& fileToUse)
+    : juce::Thread("SessionStore"),
+      file(fileToUse)
+{
+    std::unique_ptr<juce::XmlElement> xml(juce::XmlDocument::parse(file));
+    if (xml != nullptr && xml->hasTagName("BootConfig"))
+    {
+        for (int i = 0; i < xml->getNumAttributes(); ++i)
+        {
+            const juce::Identifier name(xml->getAttributeName(i));
+            if (name != filePathId && name != fileNameId && name != activeBankId
+                && name != activePresetId && name != activeSlotId)
+                settings.set(name, xml->getAttributeValue(i));
+        }
+
+        const auto path = xml->getStringAttribute(filePathId);
+
+        // ⚠️ защита: путь, указывающий на сам boot_config.xml, игнорируем
+        if (path.isNotEmpty() && !juce::File(path).getFileName().equalsIgnoreCase(file.getFileName()))
+            state.bootTarget = juce::File(path);
+
+        state.activeBank = xml->getIntAttribute(activeBankId, -1);
+        state.activePreset = xml->getIntAttribute(activePresetId, -1);
+        state.activeSlot = xml->getIntAttribute(activeSlotId, 0);
+    }
+
+    startThread();
+}
+
+SessionStore::~SessionStore()
+{
+    signalThreadShouldExit();
+    wakeUp.signal();
+    stopThread(4000);
+    flush();
+}
+
+juce::File SessionStore::getDefaultFile()
+{
+    auto sysDir = juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+        .getChildFile("NEXUS_KONTROL_OS");
+    sysDir.createDirectory();
+    return sysDir.getChildFile("boot_config.xml");
+}
+
+SessionStore::State SessionStore::getState() const
+{
+    const juce::ScopedLock sl(lock);
+    return state;
+}
+
+void SessionStore::setBootTarget(const juce::File& target)
+{
+    const juce::ScopedLock sl(lock);
+    if (state.bootTarget == target || target.getFileName().equalsIgnoreCase(file.getFileName()))
+        return;
+
+    state.bootTarget = target;
+    markChangedLocked();
+}
+
+void SessionStore::setActiveBank(int bankIndex, int presetIndex)
+{
+    const juce::ScopedLock sl(lock);
+    if (state.activeBank == bankIndex && state.activePreset == presetIndex)
+        return;
+
+    state.activeBank = bankIndex;
+    state.activePreset = presetIndex;
+    markChangedLocked();
+}
+
+void SessionStore::setActiveSlot(int slotIndex)
+{
+    const juce::ScopedLock sl(lock);
+    if (state.activeSlot == slotIndex)
+        return;
+
+    state.activeSlot = slotIndex;
+    markChangedLocked();
+}
+
+juce::var SessionStore::getSetting(const juce::Identifier& name, const juce::var& defaultValue) const
+{
+    const juce::ScopedLock sl(lock);
+    return settings.getWithDefault(name, defaultValue);
+}
+
+SessionStore::Stats SessionStore::getStats() const
+{
+    const juce::ScopedLock sl(lock);
+    return stats;
+}
+
+void SessionStore::markChangedLocked()
+{
+    ++version;
+    ++stats.changes;
+
+    if (openTransactions == 0)
+        wakeUp.signal();
+}
+
+SessionStore::Transaction::Transaction(SessionStore& s) : store(s)
+{
+    const juce::ScopedLock sl(store.lock);
+    ++store.openTransactions;
+}
+
+SessionStore::Transaction::~Transaction()
+{
+    const juce::ScopedLock sl(store.lock);
+    if (--store.openTransactions == 0 && store.version != store.writtenVersion)
+        store.wakeUp.signal();
+}
+
+void SessionStore::flush()
+{
+    if (!writeIfChanged())
+        DBG("[SessionStore] failed to write " << file.getFullPathName());
+}
+
+void SessionStore::run()
+{
+    while (!threadShouldExit())
+    {
+        wakeUp.wait(-1);
+
+        // серия изменений (загрузка файла, быстрые NEXT/PREV) собирается в одну запись;
+        // новые изменения окно не продлевают
+        wait(debounceMs);
+        if (threadShouldExit())
+            break; // остаток допишет flush() из деструктора
+
+        if (!writeIfChanged())
+            DBG("[SessionStore] failed to write " << file.getFullPathName());
+    }
+}
+
+bool SessionStore::writeIfChanged()
+{
+    const juce::ScopedLock wl(writeLock);
+
+    juce::uint32 snapshotVersion = 0;
+    juce::XmlElement root("BootConfig");
+    {
+        const juce::ScopedLock sl(lock);
+        if (version == writtenVersion || openTransactions > 0)
+            return true;
+
+        for (const auto& s : settings)
+            root.setAttribute(s.name, s.value.toString());
+
+        if (state.bootTarget != juce::File())
+        {
+            root.setAttribute(filePathId, state.bootTarget.getFullPathName());
+            root.setAttribute(fileNameId, state.bootTarget.getFileName());
+        }
+        root.setAttribute(activeBankId, state.activeBank);
+        root.setAttribute(activePresetId, state.activePreset);
+        root.setAttribute(activeSlotId, state.activeSlot);
+        snapshotVersion = version;
+    }
+
+    const auto text = root.toString().toStdString();
+    if (!BankLibraryIO::replaceFileAtomically(file, text.data(), text.size()))
+        return false;
+
+    const juce::ScopedLock sl(lock);
+    writtenVersion = snapshotVersion;
+    ++stats.writes;
+    return true;
+}
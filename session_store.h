@@ -0,0 +1,83 @@
+#pragma once
+#include <JuceHeader.h>
+
+//==============================================================================
+// SessionStore — состояние сеанса в boot_config.xml: файл библиотеки для
+// старта, активный банк/пресет и слот VST. Изменения копятся в памяти и
+// пишутся одним атомарным replace (temp → fsync → rename) на собственном
+// потоке — не раньше debounceMs после первого изменения серии и в flush()
+// при выходе. Переключение банков и загрузка файлов диск не трогают.
+// Прочие атрибуты файла (MemoryBudgetMB и т.п.) переносятся как есть.
+//==============================================================================
+class SessionStore : private juce::Thread
+{
+public:
+    struct State
+    {
+        juce::File bootTarget;       // {} — не задан (или указывал на сам boot_config.xml)
+        int activeBank = -1;         // -1 — не задан
+        int activePreset = -1;
+        int activeSlot = 0;
+    };
+
+    struct Stats
+    {
+        int changes = 0;             // изменения, принятые сеттерами
+        int writes = 0;              // записи файла
+    };
+
+    /** Читает файл сразу; отсутствующий или повреждённый файл — пустое состояние. */
+    explicit SessionStore(const juce::File& file = getDefaultFile());
+    ~SessionStore() override;        // дописывает несохранённое
+
+    /** boot_config.xml в NEXUS_KONTROL_OS. */
+    static juce::File getDefaultFile();
+
+    State getState() const;
+
+    void setBootTarget(const juce::File& target);
+    void setActiveBank(int bankIndex, int presetIndex);
+    void setActiveSlot(int slotIndex);
+
+    /** Атрибут, которым SessionStore не управляет (настройка, заданная вручную). */
+    juce::var getSetting(const juce::Identifier& name, const juce::var& defaultValue = {}) const;
+
+    /** Пишет несохранённые изменения сейчас, в вызывающем потоке (выход из приложения). */
+    void flush();
+
+    Stats getStats() const;
+
+    /** Изменения внутри транзакции пишутся только вместе: пока она открыта, запись ждёт. */
+    class Transaction
+    {
+    public:
+        explicit Transaction(SessionStore& s);
+        ~Transaction();
+
+    private:
+        SessionStore& store;
+        JUCE_DECLARE_NON_COPYABLE(Transaction)
+    };
+
+    /** Окно, за которое серия изменений собирается в одну запись. */
+    static constexpr int debounceMs = 1000;
+
+private:
+    void run() override;
+    void markChangedLocked();
+    bool writeIfChanged();
+
+    const juce::File file;
+
+    mutable juce::CriticalSection lock;
+    State state;
+    juce::NamedValueSet settings;    // прочие атрибуты корня
+    juce::uint32 version = 0, writtenVersion = 0;
+    int openTransactions = 0;
+    Stats stats;
+
+    juce::CriticalSection writeLock; // поток и flush() не пишут одновременно
+    juce::WaitableEvent wakeUp;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SessionStore)
+};
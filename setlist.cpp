@@ -0,0 +1,61 @@
+#include "setlist.h"
+#include "bank_library.h"
+
+namespace SetlistIO
+{
+    bool read(const juce::File& file, Setlist& out)
+    {
+        std::unique_ptr<juce::XmlElement> xml(juce::XmlDocument::parse(file));
+        if (xml == nullptr || !xml->hasTagName("Setlist"))
+            return false;
+
+        const auto baseDir = file.getParentDirectory();
+
+        out = {};
+        out.name = xml->getStringAttribute("name", file.getFileNameWithoutExtension());
+
+        for (auto* el : xml->getChildWithTagNameIterator("Entry"))
+        {
+            const auto path = el->getStringAttribute("library");
+            if (path.isEmpty())
+                continue;
+
+            Setlist::Entry e;
+            e.library = baseDir.getChildFile(path); // полный путь getChildFile отдаёт как есть
+            e.bank = juce::jmax(0, el->getIntAttribute("bank", 0));
+            e.preset = juce::jmax(0, el->getIntAttribute("preset", 0));
+            e.title = el->getStringAttribute("title");
+            out.entries.push_back(std::move(e));
+        }
+
+        return true;
+    }
+
+    bool write(const juce::File& file, const Setlist& setlist)
+    {
+        const auto baseDir = file.getParentDirectory();
+
+        juce::XmlElement root("Setlist");
+        root.setAttribute("name", setlist.name);
+
+        for (const auto& e : setlist.entries)
+        {
+            auto* el = root.createNewChildElement("Entry");
+            el->setAttribute("library", e.library.isAChildOf(baseDir) ? e.library.getRelativePathFrom(baseDir)
+                                                                      : e.library.getFullPathName());
+            el->setAttribute("bank", e.bank);
+            el->setAttribute("preset", e.preset);
+            if (e.title.isNotEmpty())
+                el->setAttribute("title", e.title);
+        }
+
+        const auto text = root.toString().toStdString();
+        return BankLibraryIO::replaceFileAtomically(file, text.data(), text.size());
+    }
+
+    juce::String describe(const Setlist::Entry& entry)
+    {
+        const auto title = entry.title.isNotEmpty() ? entry.title : entry.library.getFileNameWithoutExtension();
+        return title + " (" + juce::String(entry.bank + 1) + "/" + juce::String(entry.preset + 1) + ")";
+    }
+}
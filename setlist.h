@@ -0,0 +1,45 @@
+#pragma once
+#include <JuceHeader.h>
+#include <vector>
+
+//==============================================================================
+// Setlist — упорядоченный список песен на выступление: каждая песня —
+// библиотека, банк и пресет (сцена). Хранится в XML (*.setlist):
+//
+//   <Setlist name="...">
+//     <Entry library="Rock.nxb" bank="3" preset="0" title="..."/>
+//   </Setlist>
+//
+// Путь библиотеки пишется относительно файла сет-листа, если она лежит
+// в той же папке или ниже; иначе — полным путём.
+//==============================================================================
+struct Setlist
+{
+    struct Entry
+    {
+        juce::File library;
+        int bank = 0;
+        int preset = 0;
+        juce::String title;          // пусто — имя библиотеки
+    };
+
+    juce::String name;
+    std::vector<Entry> entries;
+
+    bool isEmpty() const noexcept { return entries.empty(); }
+};
+
+namespace SetlistIO
+{
+    static constexpr const char* fileExtension = ".setlist";
+    static constexpr const char* fileWildcard = "*.setlist";
+
+    /** false — файла нет или это не сет-лист. Записи без библиотеки пропускаются. */
+    bool read(const juce::File& file, Setlist& out);
+
+    /** Атомарная запись (temp → fsync → rename). */
+    bool write(const juce::File& file, const Setlist& setlist);
+
+    /** Подпись песни для UI: title или имя библиотеки, банк и пресет с 1. */
+    juce::String describe(const Setlist::Entry& entry);
+}
@@ -0,0 +1,91 @@
+#include "setlist_engine.h"
+#include "bank_library.h"
+
+SetlistEngine::SetlistEngine()
+{
+    // всё окно из разных библиотек должно поместиться целиком
+    prefetcher.setMemoryBudget((2 * windowRadius + 1) * BankLibraryPrefetcher::defaultMemoryBudget);
+}
+
+void SetlistEngine::setSetlist(Setlist newSetlist, int newPosition)
+{
+    setlist = std::move(newSetlist);
+    position = setlist.isEmpty() ? 0 : juce::jlimit(0, (int)setlist.entries.size() - 1, newPosition);
+    restage();
+}
+
+void SetlistEngine::clear()
+{
+    setSetlist({});
+}
+
+SetlistEngine::Step SetlistEngine::moveTo(int index)
+{
+    Step result;
+    if (setlist.isEmpty())
+        return result;
+
+    position = juce::jlimit(0, (int)setlist.entries.size() - 1, index);
+    const auto& entry = setlist.entries[(size_t)position];
+    result.entry = &entry;
+    result.lib = prefetcher.take(entry.library);
+
+    if (result.lib != nullptr && juce::isPositiveAndBelow(entry.bank, (int)result.lib->banks.size()))
+    {
+        const auto& state = result.lib->banks[(size_t)entry.bank].pluginState;
+        result.staged = state.isEmpty() || state.isDecoded();
+    }
+
+    // окно — вокруг новой песни; текущая остаётся в нём, пока её применяют
+    restage();
+    return result;
+}
+
+SetlistEngine::Step SetlistEngine::step(int delta)
+{
+    const int index = position + delta;
+    if (!juce::isPositiveAndBelow(index, (int)setlist.entries.size()))
+        return {};
+
+    return moveTo(index);
+}
+
+void SetlistEngine::recordSwitch(double ms, bool wasStaged)
+{
+    ++stats.steps;
+    if (wasStaged)
+        ++stats.staged;
+
+    stats.lastSwitchMs = ms;
+    stats.averageSwitchMs += (ms - stats.averageSwitchMs) / stats.steps;
+    stats.maxSwitchMs = juce::jmax(stats.maxSwitchMs, ms);
+
+    DBG("[Setlist] step " << (position + 1) << "/" << (int)setlist.entries.size() << ": "
+        << juce::String(ms, 1) << " ms" << (wasStaged ? " (staged)" : " (cold)")
+        << ", avg " << juce::String(stats.averageSwitchMs, 1) << " ms, max " << juce::String(stats.maxSwitchMs, 1)
+        << " ms, staged " << stats.staged << "/" << stats.steps);
+}
+
+void SetlistEngine::restage()
+{
+    std::vector<BankLibraryPrefetcher::Request> window;
+
+    auto add = [&](int index)
+        {
+            if (!juce::isPositiveAndBelow(index, (int)setlist.entries.size()))
+                return;
+
+            const auto& e = setlist.entries[(size_t)index];
+            window.push_back({ e.library, { e.bank } });
+        };
+
+    // текущая, затем по удалению; следующая важнее предыдущей — при нехватке бюджета уходит дальняя
+    add(position);
+    for (int d = 1; d <= windowRadius; ++d)
+    {
+        add(position + d);
+        add(position - d);
+    }
+
+    prefetcher.prefetch(window);
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <JuceHeader.h>
+#include <memory>
+#include "setlist.h"
+#include "bank_library_prefetcher.h"
+
+struct BankLibrary;
+
+//==============================================================================
+// SetlistEngine — проход по сет-листу на сцене.
+// Держит окно из предыдущей, текущей и следующей песни: их библиотеки
+// разобраны в фоне (собственный BankLibraryPrefetcher, отдельно от соседей
+// NEXT/PREV), а state нужных банков распакован заранее. Шаг по сет-листу,
+// попавший в окно, применяется из памяти — без чтения и разбора файла.
+// Задержку каждого шага (от нажатия до применённого банка) сообщает
+// редактор через recordSwitch(). Используется только из message thread.
+//==============================================================================
+class SetlistEngine
+{
+public:
+    struct Stats
+    {
+        int steps = 0;
+        int staged = 0;              // шагов, готовых заранее (библиотека в памяти, state распакован)
+        double lastSwitchMs = 0.0;
+        double averageSwitchMs = 0.0;
+        double maxSwitchMs = 0.0;
+    };
+
+    /** Песня, на которую перешли; lib == nullptr — не готова, читать файл. */
+    struct Step
+    {
+        const Setlist::Entry* entry = nullptr;
+        std::shared_ptr<const BankLibrary> lib;
+        bool staged = false;         // lib есть и state банка песни уже распакован
+    };
+
+    SetlistEngine();
+
+    /** Новый сет-лист; окно ставится вокруг position (песню не применяет). */
+    void setSetlist(Setlist newSetlist, int position = 0);
+    void clear();
+
+    const Setlist& getSetlist() const noexcept { return setlist; }
+    bool isActive() const noexcept { return !setlist.isEmpty(); }
+    int getPosition() const noexcept { return position; }
+
+    /** Переход к песне index (в пределах сет-листа); окно сдвигается вокруг неё. */
+    Step moveTo(int index);
+
+    /** Соседняя песня; за краем сет-листа — пустой Step (entry == nullptr). */
+    Step step(int delta);
+
+    void recordSwitch(double ms, bool wasStaged);
+    Stats getStats() const noexcept { return stats; }
+
+    /** Окно: столько песен до и после текущей держатся готовыми. */
+    static constexpr int windowRadius = 1;
+
+private:
+    void restage();
+
+    Setlist setlist;
+    int position = 0;
+    BankLibraryPrefetcher prefetcher;
+    Stats stats;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SetlistEngine)
+};